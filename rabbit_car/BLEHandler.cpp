@@ -6,22 +6,80 @@ BLEServer *pServer = NULL;
 BLECharacteristic *pDataCharacteristic = NULL;
 bool deviceConnected = false;
 
+// Negotiated link, written from the BLE stack's callbacks
+static HalBleLinkInfo linkInfo = {23, HAL_BLE_PHY_1M, 0, 0, 0};
+
+// Ask the central for the link profile in config.h; it reports what it accepted through the GAP events
+static void requestLinkProfile(esp_bd_addr_t peer)
+{
+  esp_ble_gap_set_pkt_data_len(peer, BLE_DATA_LENGTH);
+  pServer->updateConnParams(peer, BLE_CONN_INTERVAL_MIN, BLE_CONN_INTERVAL_MAX, BLE_CONN_LATENCY, BLE_SUPERVISION_TIMEOUT);
+#if CONFIG_BT_BLE_50_FEATURES_SUPPORTED
+  if (BLE_PREFER_2M_PHY)
+  {
+    esp_ble_gap_set_preferred_phy(peer, 0, ESP_BLE_GAP_PHY_2M_PREF_MASK, ESP_BLE_GAP_PHY_2M_PREF_MASK, ESP_BLE_GAP_PHY_OPTIONS_NO_PREF);
+  }
+#endif
+}
+
+static void linkGapHandler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param)
+{
+  switch (event)
+  {
+  case ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT:
+    if (param->update_conn_params.status == ESP_BT_STATUS_SUCCESS)
+    {
+      linkInfo.interval = param->update_conn_params.conn_int;
+      linkInfo.latency = param->update_conn_params.latency;
+      linkInfo.supervisionTimeout = param->update_conn_params.timeout;
+      LOG_INFO(LOG_TAG_BLE, "BLE connection interval %.2f ms", linkInfo.interval * 1.25f);
+      bleRequestLinkInfo();
+    }
+    break;
+#if CONFIG_BT_BLE_50_FEATURES_SUPPORTED
+  case ESP_GAP_BLE_PHY_UPDATE_COMPLETE_EVT:
+    if (param->phy_update.status == ESP_BT_STATUS_SUCCESS)
+    {
+      linkInfo.phy = (HalBlePhy)param->phy_update.tx_phy; // ESP_BLE_GAP_PHY_1M/2M/CODED match HalBlePhy
+      LOG_INFO(LOG_TAG_BLE, "BLE PHY %d", linkInfo.phy);
+      bleRequestLinkInfo();
+    }
+    break;
+#endif
+  default:
+    break;
+  }
+}
+
 class MyServerCallbacks : public BLEServerCallbacks
 {
-  void onConnect(BLEServer *pServer)
+  void onConnect(BLEServer *pServer, esp_ble_gatts_cb_param_t *param)
   {
-    Serial.println("BLE Client Connected");
+    LOG_INFO(LOG_TAG_BLE, "BLE Client Connected");
     digitalWrite(BT_LED_PIN, HIGH);
+
+    linkInfo.mtu = 23;
+    linkInfo.phy = HAL_BLE_PHY_1M;
+    linkInfo.interval = param->connect.conn_params.interval;
+    linkInfo.latency = param->connect.conn_params.latency;
+    linkInfo.supervisionTimeout = param->connect.conn_params.timeout;
+    requestLinkProfile(param->connect.remote_bda);
     deviceConnected = true;
+    bleRequestLinkInfo();
+  }
+
+  void onMtuChanged(BLEServer *pServer, esp_ble_gatts_cb_param_t *param)
+  {
+    linkInfo.mtu = param->mtu.mtu;
+    LOG_INFO(LOG_TAG_BLE, "BLE MTU %d", linkInfo.mtu);
+    bleRequestLinkInfo();
   }
 
   void onDisconnect(BLEServer *pServer)
   {
-    Serial.println("BLE Client Disconnected");
+    LOG_INFO(LOG_TAG_BLE, "BLE Client Disconnected");
     digitalWrite(BT_LED_PIN, LOW);
-    stopESCOnDisconnect();
-    RUNNING = false;       // Reset running state
-    manualControl = false; // Reset manual control
+    postDisconnect(); // the control task stops the ESC and leaves manual control
     deviceConnected = false;
     BLEDevice::startAdvertising(); // Restart advertising to allow new connections
   }
@@ -31,200 +89,31 @@ class MyCallbacks : public BLECharacteristicCallbacks
 {
   void onWrite(BLECharacteristic *pCharacteristic)
   {
-    String rxValue = pCharacteristic->getValue();
-
-    if (rxValue.length() > 0)
-    {
-      String receivedData = String(rxValue.c_str());
-      Serial.println("Received: " + receivedData);
-
-      // Parse JSON
-      DynamicJsonDocument doc(1024); // Adjust size as needed
-      DeserializationError error = deserializeJson(doc, receivedData);
-
-      if (error)
-      {
-        Serial.print("JSON parsing failed: ");
-        Serial.println(error.c_str());
-        return;
-      }
-
-      // Process based on type
-      const char *dataType = doc["type"];
-
-      if (strcmp(dataType, "movement") == 0)
-      {
-        if (manualControl)
-        {
-          SERVO_ANGLE = doc["angle"].as<float>();
-          MOTOR_SPEED = doc["motorSpeed"].as<float>();
-        }
-      }
-      else if (strcmp(dataType, "manualControl") == 0)
-      {
-        bool previousMode = manualControl;
-        manualControl = doc["enabled"];
-        if (manualControl != previousMode)
-        {
-          startRunTimer = true;
-        }
-      }
-      else if (strcmp(dataType, "running") == 0)
-      {
-        MODE = doc["mode"].as<String>();
-        speedKP = doc["speedKP"].as<float>();
-        speedKI = doc["speedKI"].as<float>();
-        speedKD = doc["speedKD"].as<float>();
-        SPEED_MAX_INTEGRAL = doc["SPEED_MAX_INTEGRAL"].as<float>();
-        SPEED_MAX_ACCELERATION = doc["SPEED_MAX_ACCELERATION"].as<float>();
-
-        steerKP = doc["steerKP"].as<float>();
-        steerKI = doc["steerKI"].as<float>();
-        steerKD = doc["steerKD"].as<float>();
-        STEER_MAX_INTEGRAL = doc["STEER_MAX_INTEGRAL"].as<float>();
-
-        steerKP = doc["steerKP"].as<float>();
-        steerKI = doc["steerKI"].as<float>();
-        steerKD = doc["steerKD"].as<float>();
-        STEER_MAX_INTEGRAL = doc["STEER_MAX_INTEGRAL"].as<float>();
-        if (doc["running"])
-        {
-          startRunTimer = true;
-        }
-        else
-        {
-          BRAKE = true;
-        }
-        RUNNING = doc["running"];
-
-        // You can also extract other fields if needed
-        if (doc.containsKey("distance") && !doc["distance"].as<String>().isEmpty())
-        {
-          targetDistance = doc["distance"].as<float>();
-          Serial.print("distance: ");
-          Serial.println(targetDistance);
-        }
-        if (doc.containsKey("time") && !doc["time"].as<String>().isEmpty())
-        {
-          targetTime = doc["time"].as<float>();
-          Serial.print("time: ");
-          Serial.println(targetTime);
-        }
-        if (doc.containsKey("pace") && !doc["pace"].as<String>().isEmpty())
-        {
-          targetSpeed = doc["pace"].as<float>();
-          Serial.print("pace: ");
-          Serial.println(targetSpeed);
-        }
-        if (doc.containsKey("isWhiteLine") && !doc["isWhiteLine"].as<String>().isEmpty())
-        {
-          IS_WHITE_LINE = doc["isWhiteLine"];
-          Serial.print("isWhiteLine: ");
-          Serial.println(IS_WHITE_LINE);
-        }
-      }
-      else if (strcmp(dataType, "isWhiteLine") == 0)
-      {
-        IS_WHITE_LINE = doc["enabled"];
-        if (IS_WHITE_LINE)
-        {
-          lightsOn();
-        }
-        else
-        {
-          lightsOff();
-        }
-      }
-      else if (strcmp(dataType, "lights") == 0)
-      {
-        // placeholder
-      }
-      else
-      {
-        Serial.println("Unknown data type");
-      }
-    }
+    // Parse straight out of the characteristic buffer, see Commands.h for the format
+    handleCommand(pCharacteristic->getData(), pCharacteristic->getLength());
   }
 };
 
-/**
- * Function to broadcast Distance, Time, Pace, and Speed data over BLE
- * @param distance Distance value in meters
- * @param time Time value in seconds
- * @param pace Pace value in meters per second
- * @param speed Speed value in meters per second
- * @return bool True if data was sent successfully, false otherwise
- */
-bool bleBroadcastDTPS(float distance, float time, float pace, float speed, float steeringAngle, bool forceBroadcast)
+bool halBleConnected()
 {
-  // Check if 100ms has elapsed since the last broadcast
-  static unsigned long lastBroadcastTime = 0;
-  if (millis() - lastBroadcastTime < 100 && !forceBroadcast)
-  {
-    return false; // Exit early if it's too soon to broadcast
-  }
-
-  if (!deviceConnected)
-  {
-    // No need to print a message here as it could flood the serial output
-    return false;
-  }
-
-  // Create a JSON document
-  StaticJsonDocument<200> doc;
-
-  // Create nested objects
-  JsonObject speedObj = doc["currentSpeed"].to<JsonObject>();
-  speedObj["value"] = speed;
-  speedObj["units"] = "mps";
-
-  JsonObject distObj = doc["distance"].to<JsonObject>();
-  distObj["value"] = distance;
-  distObj["units"] = "m";
-
-  JsonObject paceObj = doc["averagePace"].to<JsonObject>();
-  paceObj["value"] = pace;
-  paceObj["units"] = "mps";
-
-  JsonObject timeObj = doc["time"].to<JsonObject>();
-  timeObj["value"] = time;
-  timeObj["units"] = "s";
-
-  doc["steeringAngle"] = steeringAngle;
-
-  // Serialize JSON to string
-  String jsonString;
-  serializeJson(doc, jsonString);
+  return deviceConnected;
+}
 
-  // Send the value to the app
-  pDataCharacteristic->setValue(jsonString.c_str());
+void halBleNotify(const uint8_t *data, size_t length)
+{
+  pDataCharacteristic->setValue(const_cast<uint8_t *>(data), length);
   pDataCharacteristic->notify();
-
-  // Update the last broadcast time
-  lastBroadcastTime = millis();
-
-  // Only print every 500ms to avoid flooding the serial console
-  // Serial.print("Sent data: ");
-  // Serial.println(jsonString);
-
-  return true;
 }
 
-bool bleBroadcastRunStopped(const JsonDocument& doc)
+size_t halBleMaxNotifySize()
 {
-  if (!deviceConnected)
-  {
-    return false;
-  }
-  // Serialize JSON to string
-  String jsonString;
-  serializeJson(doc, jsonString);
-
-  // Send the value to the app
-  pDataCharacteristic->setValue(jsonString.c_str());
-  pDataCharacteristic->notify();
+  uint16_t mtu = pServer->getPeerMTU(pServer->getConnId());
+  return mtu > 23 ? mtu - 3 : 20; // 23 is the default MTU, also reported before the exchange
+}
 
-  return true;
+void halBleLinkInfo(HalBleLinkInfo *info)
+{
+  *info = linkInfo;
 }
 
 void setupBLE()
@@ -233,6 +122,8 @@ void setupBLE()
   pinMode(BT_LED_PIN, OUTPUT);
   // Initialize BLE device
   BLEDevice::init("ESP32 Rabbit");
+  BLEDevice::setMTU(BLE_LOCAL_MTU); // accepted when the central asks for it, Chrome asks for 517
+  BLEDevice::setCustomGapHandler(linkGapHandler);
 
   // Create BLE server
   pServer = BLEDevice::createServer();
@@ -245,7 +136,8 @@ void setupBLE()
   BLECharacteristic *pCharacteristic = pService->createCharacteristic(
       CHARACTERISTIC_UUID,
       BLECharacteristic::PROPERTY_READ |
-          BLECharacteristic::PROPERTY_WRITE);
+          BLECharacteristic::PROPERTY_WRITE |
+          BLECharacteristic::PROPERTY_WRITE_NR); // movement is written without response
 
   // Set callbacks for command characteristic
   pCharacteristic->setCallbacks(new MyCallbacks());
@@ -266,16 +158,9 @@ void setupBLE()
   BLEAdvertising *pAdvertising = BLEDevice::getAdvertising();
   pAdvertising->addServiceUUID(SERVICE_UUID);
   pAdvertising->setScanResponse(true);
-  pAdvertising->setMinPreferred(0x06); // Functions that help with iPhone connections
-  pAdvertising->setMinPreferred(0x12);
+  pAdvertising->setMinPreferred(BLE_CONN_INTERVAL_MIN); // connection interval hint, iOS uses it
+  pAdvertising->setMaxPreferred(BLE_CONN_INTERVAL_MAX);
   BLEDevice::startAdvertising();
 
   Serial.println("BLE service started. Waiting for connections...");
-}
-
-void stopESCOnDisconnect()
-{
-  stopESC();
-  MOTOR_SPEED = 1500; // Reset MOTOR_SPEED to neutral
-  Serial.println("ESC stopped due to BLE disconnection");
 }
\ No newline at end of file
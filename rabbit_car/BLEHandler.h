@@ -8,14 +8,12 @@
 #include <BLE2902.h>
 #include "config.h"
 #include "ESCHandler.h"
-#include <ArduinoJson.h>
 #include "Lights.h"
 #include "HSHandler.h"
+#include "Telemetry.h"
+#include "Commands.h"
 // #include <arduino.h>
 
 void setupBLE();
-void stopESCOnDisconnect();
-bool bleBroadcastDTPS(float distance, float time, float pace, float speed, float steeringAngle, bool forceBroadcast = 0);
-bool bleBroadcastRunStopped(const JsonDocument&);
 
 #endif
\ No newline at end of file
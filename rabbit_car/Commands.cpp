@@ -0,0 +1,363 @@
+// Commands.cpp
+#include "Commands.h"
+#include "Telemetry.h"
+#include "Lights.h"
+#include "PacePlan.h"
+#include "Course.h"
+#include "RunControl.h"
+#include "ThrottleCalibration.h"
+#include "ESCHandler.h"
+#include <atomic>
+
+static_assert((COMMAND_MAILBOX_SIZE & (COMMAND_MAILBOX_SIZE - 1)) == 0, "COMMAND_MAILBOX_SIZE must be a power of two");
+
+// Single producer (BLE task) / single consumer (control task) mailbox; positions count commands since boot
+static Command mailbox[COMMAND_MAILBOX_SIZE];
+static std::atomic<uint32_t> mailboxHead(0); // commands posted by the BLE task
+static std::atomic<uint32_t> mailboxTail(0); // commands applied by the control task
+static std::atomic<bool> disconnectPending(false); // never dropped, so kept out of the mailbox
+static std::atomic<uint32_t> disconnectPosition(0); // mailboxHead when the link dropped
+
+// Latest-wins movement slot: joystick writes come as fast as the link allows and only the newest
+// matters, so each overwrites the slot instead of taking a mailbox entry from a critical command
+static std::atomic<uint32_t> movementSlot(0); // angle in 1/100 degree << 16 | motor speed in us
+static std::atomic<bool> movementPending(false);
+
+// BLE task: the newest movement sequence number taken since the client connected
+static bool haveMovementSeq = false;
+static uint16_t lastMovementSeq = 0;
+
+static bool postCommand(const Command &command)
+{
+  uint32_t head = mailboxHead.load(std::memory_order_relaxed);
+  uint32_t tail = mailboxTail.load(std::memory_order_acquire);
+  if (head - tail >= COMMAND_MAILBOX_SIZE)
+  {
+    LOG_WARN(LOG_TAG_BLE, "Command mailbox full, command %d dropped", command.type);
+    return false;
+  }
+
+  mailbox[head & (COMMAND_MAILBOX_SIZE - 1)] = command;
+  mailboxHead.store(head + 1, std::memory_order_release);
+  return true;
+}
+
+static void applyMovement(float angle, float motorSpeed)
+{
+  if (manualControl)
+  {
+    SERVO_ANGLE = angle;
+    MOTOR_SPEED = motorSpeed;
+  }
+}
+
+static void applyManualControl(bool enabled)
+{
+  bool previousMode = manualControl;
+  manualControl = enabled;
+  if (manualControl != previousMode)
+  {
+    startRunTimer = true;
+  }
+}
+
+static void applyIsWhiteLine(bool enabled)
+{
+  IS_WHITE_LINE = enabled;
+}
+
+// The lights follow the line colour; this only sets their base color, the telemetry task shows it
+static void showLineColour(bool white)
+{
+  if (white)
+  {
+    lightsOn();
+  }
+  else
+  {
+    lightsOff();
+  }
+}
+
+static void applyCalibrate(uint8_t action)
+{
+  switch (action)
+  {
+  case CALIBRATE_ACTION_START:
+    requestCalibration();
+    break;
+  case CALIBRATE_ACTION_CLEAR:
+    throttleClearCalibration();
+    break;
+  default:
+    break;
+  }
+  bleRequestThrottleTable();
+}
+
+static void applyDisconnect()
+{
+  stopESC();
+  MOTOR_SPEED = 1500; // Reset MOTOR_SPEED to neutral
+  RUNNING = false;       // Reset running state
+  manualControl = false; // Reset manual control
+  LOG_WARN(LOG_TAG_ESC, "ESC stopped due to BLE disconnection");
+}
+
+static void applyRunConfig(const RunConfig &config)
+{
+  if (config.mode < RUN_MODE_COUNT)
+  {
+    setRunMode((RunMode)config.mode);
+  }
+
+  if (config.flags & RUN_FLAG_HAS_GAINS)
+  {
+    speedKP = config.speedKP;
+    speedKI = config.speedKI;
+    speedKD = config.speedKD;
+    SPEED_MAX_INTEGRAL = config.speedMaxIntegral;
+    SPEED_MAX_ACCELERATION = config.speedMaxAcceleration;
+
+    steerKP = config.steerKP;
+    steerKI = config.steerKI;
+    steerKD = config.steerKD;
+    STEER_MAX_INTEGRAL = config.steerMaxIntegral;
+  }
+
+  bool running = config.flags & RUN_FLAG_RUNNING;
+  if (running)
+  {
+    startRunTimer = true;
+  }
+  else
+  {
+    BRAKE = true;
+  }
+  RUNNING = running;
+
+  if (config.flags & RUN_FLAG_HAS_DISTANCE)
+  {
+    targetDistance = config.distance;
+    LOG_INFO(LOG_TAG_RUN, "distance: %.2f", targetDistance);
+  }
+  if (config.flags & RUN_FLAG_HAS_TIME)
+  {
+    targetTime = config.time;
+    LOG_INFO(LOG_TAG_RUN, "time: %.2f", targetTime);
+  }
+  if (config.flags & RUN_FLAG_HAS_PACE)
+  {
+    targetSpeed = config.pace;
+    LOG_INFO(LOG_TAG_RUN, "pace: %.2f", targetSpeed);
+  }
+  if (config.flags & RUN_FLAG_HAS_WHITE_LINE)
+  {
+    IS_WHITE_LINE = config.flags & RUN_FLAG_WHITE_LINE;
+    LOG_INFO(LOG_TAG_RUN, "isWhiteLine: %d", IS_WHITE_LINE);
+  }
+}
+
+static void applyCommand(const Command &command)
+{
+  switch (command.type)
+  {
+  case COMMAND_MOVEMENT:
+    applyMovement(command.movement.angle, command.movement.motorSpeed);
+    break;
+  case COMMAND_MANUAL_CONTROL:
+    applyManualControl(command.enabled);
+    break;
+  case COMMAND_RUN_CONFIG:
+    applyRunConfig(command.run);
+    break;
+  case COMMAND_IS_WHITE_LINE:
+    applyIsWhiteLine(command.enabled);
+    break;
+  case COMMAND_CALIBRATE:
+    applyCalibrate(command.action);
+    break;
+  }
+}
+
+static bool parseRunConfig(const uint8_t *data, size_t length, RunConfig *config)
+{
+  if (length < CMD_RUNNING_SIZE)
+  {
+    return false;
+  }
+
+  config->flags = data[1];
+  config->mode = data[2];
+  config->distance = getF32LE(data + 3);
+  config->time = getF32LE(data + 7);
+  config->pace = getF32LE(data + 11);
+
+  if (config->flags & RUN_FLAG_HAS_GAINS)
+  {
+    if (length < CMD_RUNNING_SIZE + CMD_RUNNING_GAINS_SIZE)
+    {
+      return false;
+    }
+    const uint8_t *gains = data + CMD_RUNNING_SIZE;
+    config->speedKP = getF32LE(gains);
+    config->speedKI = getF32LE(gains + 4);
+    config->speedKD = getF32LE(gains + 8);
+    config->speedMaxIntegral = getF32LE(gains + 12);
+    config->speedMaxAcceleration = getF32LE(gains + 16);
+    config->steerKP = getF32LE(gains + 20);
+    config->steerKI = getF32LE(gains + 24);
+    config->steerKD = getF32LE(gains + 28);
+    config->steerMaxIntegral = getF32LE(gains + 32);
+  }
+
+  return true;
+}
+
+bool handleCommand(const uint8_t *data, size_t length)
+{
+  if (length == 0)
+  {
+    return false;
+  }
+
+  Command command = {};
+  switch (data[0])
+  {
+  case CMD_MOVEMENT:
+    if (length < CMD_MOVEMENT_SIZE)
+    {
+      break;
+    }
+    if (length >= CMD_MOVEMENT_SEQ_SIZE)
+    {
+      uint16_t seq = getU16LE(data + 5);
+      // Serial number comparison, so the count may wrap
+      if (haveMovementSeq && (int16_t)(seq - lastMovementSeq) <= 0)
+      {
+        LOG_DEBUG(LOG_TAG_BLE, "Stale movement %u dropped, newest %u", (unsigned)seq, (unsigned)lastMovementSeq);
+        return true;
+      }
+      haveMovementSeq = true;
+      lastMovementSeq = seq;
+    }
+    movementSlot.store((uint32_t)getU16LE(data + 1) << 16 | getU16LE(data + 3), std::memory_order_relaxed);
+    movementPending.store(true, std::memory_order_release);
+    return true;
+
+  case CMD_MANUAL_CONTROL:
+    if (length < 2)
+    {
+      break;
+    }
+    command.type = COMMAND_MANUAL_CONTROL;
+    command.enabled = data[1] != 0;
+    return postCommand(command);
+
+  case CMD_RUNNING:
+    if (!parseRunConfig(data, length, &command.run))
+    {
+      break;
+    }
+    command.type = COMMAND_RUN_CONFIG;
+    return postCommand(command);
+
+  case CMD_IS_WHITE_LINE:
+    if (length < 2)
+    {
+      break;
+    }
+    command.type = COMMAND_IS_WHITE_LINE;
+    command.enabled = data[1] != 0;
+    showLineColour(command.enabled);
+    return postCommand(command);
+
+  case CMD_LIGHTS:
+    // placeholder
+    return true;
+
+  case CMD_STATS:
+    if (length < 2)
+    {
+      break;
+    }
+    bleRequestProfileStats(data[1] & STATS_FLAG_RESET);
+    return true;
+
+  case CMD_RECORDING:
+    if (length < 2 || (data[1] == RECORDING_ACTION_READ && length < 6))
+    {
+      break;
+    }
+    bleRequestRecording(data[1], length >= 6 ? getU32LE(data + 2) : 0);
+    return true;
+
+  case CMD_PLAN:
+    if (length < 2 || length < 2 + data[1] * PLAN_SEGMENT_SIZE)
+    {
+      break;
+    }
+    return pacePlanLoad(data + 2, data[1]);
+
+  case CMD_COURSE:
+    if (length < 2 || length < 2 + data[1] * COURSE_MARKER_SIZE)
+    {
+      break;
+    }
+    return courseLoad(data + 2, data[1]);
+
+  case CMD_CALIBRATE:
+    if (length < 2)
+    {
+      break;
+    }
+    command.type = COMMAND_CALIBRATE;
+    command.action = data[1];
+    return postCommand(command);
+
+  default:
+    LOG_WARN(LOG_TAG_BLE, "Unknown command opcode 0x%02X", data[0]);
+    return false;
+  }
+
+  LOG_WARN(LOG_TAG_BLE, "Command 0x%02X too short (%u bytes)", data[0], (unsigned)length);
+  return false;
+}
+
+void postDisconnect()
+{
+  haveMovementSeq = false;
+  movementPending.store(false, std::memory_order_relaxed); // a move of the lost link is stale
+  disconnectPosition.store(mailboxHead.load(std::memory_order_relaxed), std::memory_order_relaxed);
+  disconnectPending.store(true, std::memory_order_release);
+}
+
+void applyPendingCommands()
+{
+  // The disconnect first, so the head read after it covers every command posted before the disconnect
+  bool disconnect = disconnectPending.exchange(false, std::memory_order_acquire);
+  uint32_t disconnectAt = disconnectPosition.load(std::memory_order_relaxed);
+  uint32_t tail = mailboxTail.load(std::memory_order_relaxed);
+  uint32_t head = mailboxHead.load(std::memory_order_acquire);
+  for (; tail != head; tail++)
+  {
+    if (disconnect && tail == disconnectAt)
+    {
+      applyDisconnect();
+      disconnect = false;
+    }
+    applyCommand(mailbox[tail & (COMMAND_MAILBOX_SIZE - 1)]);
+  }
+  mailboxTail.store(tail, std::memory_order_release);
+  if (disconnect)
+  {
+    applyDisconnect();
+  }
+
+  // After the mailbox, so a movement that came with a manual control toggle lands on the new mode
+  if (movementPending.exchange(false, std::memory_order_acquire))
+  {
+    uint32_t movement = movementSlot.load(std::memory_order_relaxed);
+    applyMovement((movement >> 16) / 100.0, movement & 0xFFFF);
+  }
+}
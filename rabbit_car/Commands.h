@@ -0,0 +1,126 @@
+// Commands.h
+#ifndef COMMANDS_H
+#define COMMANDS_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "PaceStrategy.h"
+
+// Binary command protocol for the control characteristic.
+// Every write starts with an opcode byte; multi-byte fields are little-endian and the
+// layouts must match the encoders in web/public/javascripts/protocol.js
+//
+//  CMD_MOVEMENT        [op][angle u16, 1/100 degree][motorSpeed u16, us]                      5 bytes
+//                      + [seq u16] optional, a write older than the last one taken is dropped  +2 bytes
+//                      latest wins: sent without response, not queued behind other commands
+//  CMD_MANUAL_CONTROL  [op][enabled u8]                                                      2 bytes
+//  CMD_RUNNING         [op][flags u8][mode u8][distance f32][time f32][pace f32]            15 bytes
+//                      + [speedKP speedKI speedKD SPEED_MAX_INTEGRAL SPEED_MAX_ACCELERATION
+//                         steerKP steerKI steerKD STEER_MAX_INTEGRAL] f32 if RUN_FLAG_HAS_GAINS  +36 bytes
+//  CMD_IS_WHITE_LINE   [op][enabled u8]                                                      2 bytes
+//  CMD_LIGHTS          [op]... (placeholder)
+//  CMD_STATS           [op][flags u8], replies with one profile frame per stage (Telemetry.h)  2 bytes
+//  CMD_RECORDING       [op][action u8][offset u32], RECORDING_ACTION_* (Telemetry.h)           6 bytes
+//                      INFO and CANCEL may omit the offset
+//  CMD_PLAN            [op][count u8][count segments, PLAN_SEGMENT_SIZE each (PacePlan.h)]   2 + 13n bytes
+//                      up to 418 bytes, sent as a long write; used from the next RUN_MODE_PLAN start
+//  CMD_CALIBRATE       [op][action u8], CALIBRATE_ACTION_*; stop a sweep with CMD_RUNNING     2 bytes
+//  CMD_COURSE          [op][count u8][count markers, COURSE_MARKER_SIZE each (Course.h)]     2 + 5n bytes
+//                      count 0 clears the course; used from the next run start
+const uint8_t CMD_MOVEMENT = 0x01;
+const uint8_t CMD_MANUAL_CONTROL = 0x02;
+const uint8_t CMD_RUNNING = 0x03;
+const uint8_t CMD_IS_WHITE_LINE = 0x04;
+const uint8_t CMD_LIGHTS = 0x05;
+const uint8_t CMD_STATS = 0x06;
+const uint8_t CMD_RECORDING = 0x07;
+const uint8_t CMD_PLAN = 0x08;
+const uint8_t CMD_CALIBRATE = 0x09;
+const uint8_t CMD_COURSE = 0x0A;
+
+// CMD_RUNNING flags
+const uint8_t RUN_FLAG_RUNNING = 0x01;
+const uint8_t RUN_FLAG_WHITE_LINE = 0x02;
+const uint8_t RUN_FLAG_HAS_DISTANCE = 0x04;
+const uint8_t RUN_FLAG_HAS_TIME = 0x08;
+const uint8_t RUN_FLAG_HAS_PACE = 0x10;
+const uint8_t RUN_FLAG_HAS_WHITE_LINE = 0x20;
+const uint8_t RUN_FLAG_HAS_GAINS = 0x40;
+
+// CMD_STATS flags
+const uint8_t STATS_FLAG_RESET = 0x01; // clear the histograms after reporting them
+
+// CMD_CALIBRATE actions
+const uint8_t CALIBRATE_ACTION_REPORT = 0; // send the throttle table (Telemetry.h)
+const uint8_t CALIBRATE_ACTION_START = 1;  // sweep the throttle on the line, the car drives ~20 m
+const uint8_t CALIBRATE_ACTION_CLEAR = 2;  // forget the calibration
+
+const uint8_t RUN_MODE_UNCHANGED = 0xFF; // CMD_RUNNING mode byte that keeps the current mode
+
+const size_t CMD_MOVEMENT_SIZE = 5;
+const size_t CMD_MOVEMENT_SEQ_SIZE = 7;
+const size_t CMD_RUNNING_SIZE = 15;
+const size_t CMD_RUNNING_GAINS_SIZE = 36;
+
+// Decoded CMD_RUNNING payload
+struct RunConfig
+{
+  uint8_t flags;
+  uint8_t mode; // RunMode or RUN_MODE_UNCHANGED
+  float distance;
+  float time;
+  float pace;
+  float speedKP, speedKI, speedKD, speedMaxIntegral, speedMaxAcceleration;
+  float steerKP, steerKI, steerKD, steerMaxIntegral;
+};
+
+// A decoded command that changes control state. handleCommand() (BLE task) posts it to a single
+// producer/single consumer mailbox and applyPendingCommands() (control task) applies it at the start
+// of the next control period, so the control loop's globals only ever change on its own core and a
+// whole run configuration lands between two periods
+enum CommandType : uint8_t
+{
+  COMMAND_MOVEMENT,
+  COMMAND_MANUAL_CONTROL,
+  COMMAND_RUN_CONFIG,
+  COMMAND_IS_WHITE_LINE,
+  COMMAND_CALIBRATE,
+};
+
+struct Command
+{
+  CommandType type;
+  union
+  {
+    struct
+    {
+      float angle;      // degrees
+      float motorSpeed; // us
+    } movement;
+    bool enabled; // COMMAND_MANUAL_CONTROL, COMMAND_IS_WHITE_LINE
+    uint8_t action; // COMMAND_CALIBRATE, CALIBRATE_ACTION_*
+    RunConfig run;
+  };
+};
+
+/**
+ * Parse a command written to the control characteristic and queue it for the control task
+ * Binary commands are parsed in place without touching the heap. Requests that only the telemetry
+ * task serves (CMD_STATS, CMD_RECORDING) and plan uploads (double buffered, see PacePlan.h) are
+ * handed over directly
+ * @param data Characteristic value
+ * @param length Number of bytes in data
+ * @return bool True if the command was recognised and queued, false if it was malformed or the mailbox was full
+ */
+bool handleCommand(const uint8_t *data, size_t length);
+
+// BLE task: stop the car and leave manual control, applied after the commands queued before it and
+// before any queued after it, e.g. a manual control toggle of the next client. Also drops a movement
+// not applied yet and forgets the last movement sequence number, the next client starts its own count
+void postDisconnect();
+
+// Control task, start of every control period: apply the queued commands and a disconnect in the order
+// they were posted, then the newest movement
+void applyPendingCommands();
+
+#endif
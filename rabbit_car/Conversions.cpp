@@ -1,150 +1,4 @@
-#include <Conversions.h>
-
-// distance conversions
-float mm_to_m(float dist)
-{
-    return dist / 1000.0;
-}
-
-float m_to_km(float dist)
-{
-    return dist / 1000.0;
-}
-
-float km_to_m(float dist)
-{
-    return dist * 1000.0;
-}
-
-float m_to_mm(float dist)
-{
-    return dist * 1000.0;
-}
-
-float m_to_in(float dist)
-{
-    return dist * 39.3701;
-}
-
-float in_to_m(float dist)
-{
-    return dist / 39.3701;
-}
-
-float in_to_cm(float dist)
-{
-    return dist * 2.54;
-}
-
-float cm_to_in(float dist)
-{
-    return dist / 2.54;
-}
-
-float m_to_ft(float dist)
-{
-    return dist * 3.28084;
-}
-
-float ft_to_m(float dist)
-{
-    return dist / 3.28084;
-}
-
-float m_to_miles(float dist)
-{
-    return dist * 0.000621371;
-}
-
-float miles_to_m(float dist)
-{
-    return dist / 0.000621371;
-}
-
-float km_to_miles(float dist)
-{
-    return dist * 0.621371;
-}
-
-float miles_to_km(float dist)
-{
-    return dist / 0.621371;
-}
-
-// speed conversions
-float mps_to_kmh(float speed)
-{
-}
-float mps_to_miph(float speed)
-{
-}
-
-float miph_to_kmh(float speed)
-{
-}
-
-float miph_to_mps(float speed)
-{
-}
-
-float kmh_to_mps(float speed)
-{
-}
-
-float kmh_to_miph(float speed)
-{
-}
-
-// time conversions
-float micros_to_s(unsigned long time)
-{
-    return time / 1000000.0;
-}
-
-unsigned long s_to_micros(float time)
-{
-    return (unsigned long)(time * 1000000);
-}
-
-float millis_to_s(unsigned long time)
-{
-    return time / 1000.0;
-}
-
-unsigned long s_to_millis(float time)
-{
-    return (unsigned long)(time * 1000);
-}
-
-float s_to_min(float time)
-{
-    return time / 60.0;
-}
-
-float min_to_s(float time)
-{
-    return time * 60.0;
-}
-
-float s_to_hr(float time)
-{
-    return time / 3600.0;
-}
-
-float hr_to_s(float time)
-{
-    return time * 3600.0;
-}
-
-float min_to_hr(float time)
-{
-    return time / 60.0;
-}
-
-float hr_to_min(float time)
-{
-    return time * 60.0;
-}
+#include "Conversions.h"
 
 String s_to_hr_min_s(float time)
 {
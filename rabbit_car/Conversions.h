@@ -1,70 +1,47 @@
 #ifndef CONVERSIONS_HANDLER_H
 #define CONVERSIONS_HANDLER_H
 
-#include <arduino.h>
+#include <Arduino.h>
+#include "Units.h"
 
-// distance conversions
-float mm_to_m(float dist);
-
-float m_to_km(float dist);
-
-float km_to_m(float dist);
-
-float m_to_mm(float dist);
-
-float m_to_in(float dist);
-
-float in_to_m(float dist);
-
-float in_to_cm(float dist);
-
-float cm_to_in(float dist);
+// Unit conversions for plain floats, resolved at compile time through Units.h. New code should
+// keep values in Quantity types and unitCast<>() them instead
 
-float m_to_ft(float dist);
-
-float ft_to_m(float dist);
-
-float m_to_miles(float dist);
-
-float miles_to_m(float dist);
-
-float km_to_miles(float dist);
-
-float miles_to_km(float dist);
+// distance conversions
+constexpr float mm_to_m(float dist) { return unitCast<Meters>(Millimeters(dist)).count(); }
+constexpr float m_to_km(float dist) { return unitCast<Kilometers>(Meters(dist)).count(); }
+constexpr float km_to_m(float dist) { return unitCast<Meters>(Kilometers(dist)).count(); }
+constexpr float m_to_mm(float dist) { return unitCast<Millimeters>(Meters(dist)).count(); }
+constexpr float m_to_in(float dist) { return unitCast<Inches>(Meters(dist)).count(); }
+constexpr float in_to_m(float dist) { return unitCast<Meters>(Inches(dist)).count(); }
+constexpr float in_to_cm(float dist) { return unitCast<Centimeters>(Inches(dist)).count(); }
+constexpr float cm_to_in(float dist) { return unitCast<Inches>(Centimeters(dist)).count(); }
+constexpr float m_to_ft(float dist) { return unitCast<Feet>(Meters(dist)).count(); }
+constexpr float ft_to_m(float dist) { return unitCast<Meters>(Feet(dist)).count(); }
+constexpr float m_to_miles(float dist) { return unitCast<Miles>(Meters(dist)).count(); }
+constexpr float miles_to_m(float dist) { return unitCast<Meters>(Miles(dist)).count(); }
+constexpr float km_to_miles(float dist) { return unitCast<Miles>(Kilometers(dist)).count(); }
+constexpr float miles_to_km(float dist) { return unitCast<Kilometers>(Miles(dist)).count(); }
 
 // speed conversions
-float mps_to_kmh(float speed);
-
-float mps_to_miph(float speed);
-
-float miph_to_kmh(float speed);
-
-float miph_to_mps(float speed);
-
-float kmh_to_mps(float speed);
-
-float kmh_to_miph(float speed);
-
-// time conversions
-float micros_to_s(unsigned long time);
-
-unsigned long s_to_micros(float time);
-
-float millis_to_s(unsigned long time);
-
-unsigned long s_to_millis(float time);
-
-float s_to_min(float time);
-
-float min_to_s(float time);
-
-float s_to_hr(float time);
-
-float hr_to_s(float time);
-
-float min_to_hr(float time);
-
-float hr_to_min(float time);
+constexpr float mps_to_kmh(float speed) { return unitCast<KilometersPerHour>(MetersPerSecond(speed)).count(); }
+constexpr float mps_to_miph(float speed) { return unitCast<MilesPerHour>(MetersPerSecond(speed)).count(); }
+constexpr float miph_to_kmh(float speed) { return unitCast<KilometersPerHour>(MilesPerHour(speed)).count(); }
+constexpr float miph_to_mps(float speed) { return unitCast<MetersPerSecond>(MilesPerHour(speed)).count(); }
+constexpr float kmh_to_mps(float speed) { return unitCast<MetersPerSecond>(KilometersPerHour(speed)).count(); }
+constexpr float kmh_to_miph(float speed) { return unitCast<MilesPerHour>(KilometersPerHour(speed)).count(); }
+
+// time conversions, micros_to_s() multiplies by 1e-6 instead of dividing
+constexpr float micros_to_s(unsigned long time) { return unitCast<Seconds>(Microseconds(time)).count(); }
+constexpr unsigned long s_to_micros(float time) { return unitCast<Microseconds>(Seconds(time)).count(); }
+constexpr float millis_to_s(unsigned long time) { return unitCast<Seconds>(Milliseconds(time)).count(); }
+constexpr unsigned long s_to_millis(float time) { return unitCast<Milliseconds>(Seconds(time)).count(); }
+constexpr float s_to_min(float time) { return unitCast<Minutes>(Seconds(time)).count(); }
+constexpr float min_to_s(float time) { return unitCast<Seconds>(Minutes(time)).count(); }
+constexpr float s_to_hr(float time) { return unitCast<Hours>(Seconds(time)).count(); }
+constexpr float hr_to_s(float time) { return unitCast<Seconds>(Hours(time)).count(); }
+constexpr float min_to_hr(float time) { return unitCast<Hours>(Minutes(time)).count(); }
+constexpr float hr_to_min(float time) { return unitCast<Minutes>(Hours(time)).count(); }
 
 String s_to_hr_min_s(float time);
 
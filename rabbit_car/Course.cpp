@@ -0,0 +1,187 @@
+// Course.cpp
+#include "Course.h"
+#include "Telemetry.h"
+#include "IRHandler.h"
+#include "HSHandler.h"
+#include "LatestFrame.h"
+#include <atomic>
+
+static_assert((MARKER_EVENT_QUEUE_SIZE & (MARKER_EVENT_QUEUE_SIZE - 1)) == 0, "MARKER_EVENT_QUEUE_SIZE must be a power of two");
+
+// Double buffered like pace plans: uploads (BLE task) fill the slot that is not published,
+// courseStart() (control task) copies the published one and retries if an upload rewrote it meanwhile
+static LatestFrame<Course> loadedCourses;
+
+// Control task state
+static Course activeCourse;
+static uint8_t nextMarker = 0; // first course marker that has not been passed
+static bool inMarker = false;
+static int markerWidth = 0;        // most active sensors seen in the current marker
+static MarkerEvent markerEvent;    // current marker, filled in at its leading edge
+static float entryOdometry = 0.0;  // hsOdometry() at the leading edge
+static float markerEndDistance = 0.0;
+static bool haveScaleReference = false; // a matched marker to measure the odometry scale from
+static float referencePosition = 0.0;   // its course position and hsOdometry() at it
+static float referenceOdometry = 0.0;
+
+// Single producer (control task) / single consumer (telemetry task) event queue, a full queue drops events
+static MarkerEvent events[MARKER_EVENT_QUEUE_SIZE];
+static std::atomic<uint32_t> eventHead(0);
+static std::atomic<uint32_t> eventTail(0);
+
+bool courseLoad(const uint8_t *data, uint8_t count)
+{
+  if (count > COURSE_MAX_MARKERS)
+  {
+    LOG_WARN(LOG_TAG_RUN, "Course rejected: %d markers", count);
+    return false;
+  }
+
+  uint32_t sequence;
+  Course *course = &latestFrameBegin(&loadedCourses, &sequence); // left unpublished if rejected
+  float lastPosition = 0.0;
+  for (uint8_t i = 0; i < count; i++)
+  {
+    const uint8_t *field = data + i * COURSE_MARKER_SIZE;
+    float position = getF32LE(field + 1);
+
+    // Written so that NaN fails too
+    if (field[0] >= MARKER_TYPE_COUNT || !(position >= lastPosition && position < 100000.0f))
+    {
+      LOG_WARN(LOG_TAG_RUN, "Course rejected: bad marker %d", i);
+      return false;
+    }
+    course->markers[i].type = (MarkerType)field[0];
+    course->markers[i].position = position;
+    lastPosition = position;
+  }
+  course->count = count;
+
+  latestFramePublish(&loadedCourses, sequence);
+  LOG_INFO(LOG_TAG_RUN, "Course loaded: %d markers", count);
+  return true;
+}
+
+void courseStart()
+{
+  if (!latestFrameRead(loadedCourses, &activeCourse))
+  {
+    activeCourse.count = 0; // nothing uploaded yet
+  }
+  nextMarker = 0;
+  inMarker = false;
+  markerEndDistance = -MARKER_MIN_GAP;
+  haveScaleReference = false;
+}
+
+// Find the course marker for the event and correct the odometry with it
+static void matchMarker(MarkerEvent *event)
+{
+  event->courseIndex = MARKER_UNMATCHED;
+  event->correction = 0.0;
+  event->odometryScale = hsOdometryScale();
+
+  float window = max(COURSE_MATCH_WINDOW, COURSE_MATCH_FRACTION * event->distance);
+  while (nextMarker < activeCourse.count && activeCourse.markers[nextMarker].position < event->distance - window)
+  {
+    nextMarker++; // missed, e.g. under glare
+  }
+
+  int best = -1;
+  float bestError = window;
+  for (int i = nextMarker; i < activeCourse.count && activeCourse.markers[i].position <= event->distance + window; i++)
+  {
+    float error = fabsf(activeCourse.markers[i].position - event->distance);
+    if (activeCourse.markers[i].type == event->type && error <= bestError)
+    {
+      best = i;
+      bestError = error;
+    }
+  }
+  if (best < 0)
+  {
+    return;
+  }
+
+  float position = activeCourse.markers[best].position;
+  float scale = event->odometryScale;
+  if (!haveScaleReference)
+  {
+    haveScaleReference = true;
+    referencePosition = position;
+    referenceOdometry = entryOdometry;
+  }
+  else if (position - referencePosition >= COURSE_SCALE_BASELINE && entryOdometry > referenceOdometry)
+  {
+    // Shorter baselines keep the reference, so the next marker measures over a longer one
+    float measured = (position - referencePosition) / (entryOdometry - referenceOdometry);
+    scale = constrain(scale + COURSE_SCALE_GAIN * (measured - scale), 1.0f - COURSE_SCALE_LIMIT, 1.0f + COURSE_SCALE_LIMIT);
+    referencePosition = position;
+    referenceOdometry = entryOdometry;
+  }
+
+  event->courseIndex = best;
+  event->correction = position - event->distance;
+  event->odometryScale = scale;
+  hsCorrectOdometry(event->correction, scale);
+  totalDistance = max(totalDistance + event->correction, 0.0f); // hsUpdate() only catches up next period
+  nextMarker = best + 1;
+}
+
+static void pushEvent(const MarkerEvent &event)
+{
+  uint32_t head = eventHead.load(std::memory_order_relaxed);
+  if (head - eventTail.load(std::memory_order_acquire) >= MARKER_EVENT_QUEUE_SIZE)
+  {
+    return;
+  }
+  events[head & (MARKER_EVENT_QUEUE_SIZE - 1)] = event;
+  eventHead.store(head + 1, std::memory_order_release);
+}
+
+void courseStep()
+{
+  int active = irActiveCount(getFilteredMask());
+
+  if (!inMarker)
+  {
+    if (active >= MARKER_MIN_SENSORS && totalDistance - markerEndDistance >= MARKER_MIN_GAP)
+    {
+      inMarker = true;
+      markerWidth = active;
+      markerEvent.time = currentRunDuration / 1000;
+      markerEvent.distance = totalDistance;
+      entryOdometry = hsOdometry();
+    }
+    return;
+  }
+
+  if (active >= MARKER_MIN_SENSORS)
+  {
+    markerWidth = max(markerWidth, active);
+    return;
+  }
+
+  // Trailing edge: the widest frame tells a cross line from a triangle
+  inMarker = false;
+  markerEvent.type = markerWidth >= MARKER_CROSS_SENSORS ? MARKER_CROSS : MARKER_TRIANGLE;
+  matchMarker(&markerEvent);
+  markerEndDistance = totalDistance;
+  pushEvent(markerEvent);
+
+  LOG_INFO(LOG_TAG_RUN, "Marker %s at %.2fm, course marker %d, correction %.3fm",
+           markerEvent.type == MARKER_CROSS ? "CROSS" : "TRIANGLE", markerEvent.distance,
+           markerEvent.courseIndex == MARKER_UNMATCHED ? -1 : markerEvent.courseIndex, markerEvent.correction);
+}
+
+bool courseTakeEvent(MarkerEvent *event)
+{
+  uint32_t tail = eventTail.load(std::memory_order_relaxed);
+  if (tail == eventHead.load(std::memory_order_acquire))
+  {
+    return false;
+  }
+  *event = events[tail & (MARKER_EVENT_QUEUE_SIZE - 1)];
+  eventTail.store(tail + 1, std::memory_order_release);
+  return true;
+}
@@ -0,0 +1,67 @@
+// Course.h
+// Track markers and the course they belong to. A marker is a pattern wider than any line: a cross line
+// spans (nearly) the whole sensor array, a triangle less. While a run is on, every marker the car passes
+// becomes a MarkerEvent; when an uploaded course lists a marker of that type near the odometry distance,
+// the run's distance snaps to the listed position and the odometry scale is re-estimated between
+// matched markers, so wheel slip and diameter error stop adding up over a long run.
+#ifndef COURSE_H
+#define COURSE_H
+
+#include <Arduino.h>
+#include "config.h"
+
+const uint8_t COURSE_MAX_MARKERS = 32;
+
+enum MarkerType : uint8_t
+{
+  MARKER_CROSS = 0,
+  MARKER_TRIANGLE,
+  MARKER_TYPE_COUNT,
+};
+
+// Wire format of one marker in CMD_COURSE (see Commands.h), little-endian
+//
+//  offset  size  field
+//  0       1     type (MarkerType)
+//  1       4     position of the marker's leading edge from the start line, f32, m
+const size_t COURSE_MARKER_SIZE = 5;
+
+struct CourseMarker
+{
+  MarkerType type;
+  float position; // m
+};
+
+struct Course
+{
+  uint8_t count;
+  CourseMarker markers[COURSE_MAX_MARKERS]; // by position
+};
+
+const uint8_t MARKER_UNMATCHED = 0xFF;
+
+struct MarkerEvent
+{
+  MarkerType type;
+  uint8_t courseIndex;  // matched course marker, MARKER_UNMATCHED if none
+  uint32_t time;        // ms since the run start when the leading edge was seen
+  float distance;       // m, the run's distance at the leading edge before any correction
+  float correction;     // m added to the run's distance, 0 if unmatched
+  float odometryScale;  // scale in use after the marker
+};
+
+/**
+ * Validate and load a course in CMD_COURSE wire format, it is used from the next run start
+ * @param data count markers of COURSE_MARKER_SIZE bytes, in increasing position
+ * @return bool False if a marker is malformed or out of order; the previous course is kept
+ */
+bool courseLoad(const uint8_t *data, uint8_t count);
+
+// Control task: at the run start, and every running control period after steering read the sensors
+void courseStart();
+void courseStep();
+
+// Telemetry task: take the oldest marker event not yet reported
+bool courseTakeEvent(MarkerEvent *event);
+
+#endif
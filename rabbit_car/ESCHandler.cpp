@@ -1,4 +1,6 @@
+// ESCHandler.cpp
 #include "ESCHandler.h"
+#include "ThrottleCalibration.h"
 
 const int ESC_MIN_PULSE_WIDTH = 1000; // Minimum pulse width in microseconds (full reverse)
 const int ESC_MID_PULSE_WIDTH = 1500; // Neutral position pulse width in microseconds
@@ -16,22 +18,25 @@ float previousError = 0.0;
 float integral = 0.0;
 
 int currentPWM = ESC_MID_PULSE_WIDTH; // Initialize to neutral
+int throttleTrim = 0;                 // us the PID adds to the feedforward, the part the throttle table does not explain
+float referenceSpeed = -1.0;          // m/s the feedforward should have reached by now, < 0 until the first update
+unsigned long lastReferenceTime = 0;
+int escPulseWidth = ESC_MID_PULSE_WIDTH; // Last pulse width sent to the ESC, the speed estimator's motor model input
 
-// Create a servo object to control the ESC
-Servo ESC;
+// Every ESC write goes through here so escPulseWidth always matches the output
+static void writeESC(int pulseWidth)
+{
+    escPulseWidth = pulseWidth;
+    halPwmWriteMicros(HAL_PWM_ESC, pulseWidth);
+}
 
 void setupESC()
 {
-    pinMode(ESC_PIN, OUTPUT);
-    // Allow allocation of timers 0,1 for ESC control
-    ESP32PWM::allocateTimer(0);
-    ESP32PWM::allocateTimer(1);
     // Initialize ESC
-    ESC.setPeriodHertz(50); // Standard 50Hz servo frequency
-    ESC.attach(ESC_PIN, ESC_MIN_PULSE_WIDTH, ESC_MAX_PULSE_WIDTH);
+    halPwmAttach(HAL_PWM_ESC, ESC_PIN, ESC_MIN_PULSE_WIDTH, ESC_MAX_PULSE_WIDTH);
     // Set to neutral position on startup
-    ESC.writeMicroseconds(ESC_MID_PULSE_WIDTH);
-    delay(1000); // Give the ESC time to initialize
+    writeESC(ESC_MID_PULSE_WIDTH);
+    halDelay(1000); // Give the ESC time to initialize
     Serial.println("ESC initialized. Ready to receive speed commands.");
 }
 
@@ -70,32 +75,52 @@ void setMotorSpeed(float speedValue)
     }
 
     // Send the command to the ESC
-    ESC.writeMicroseconds(speedValue);
-    // ESC.writeMicroseconds(pulseWidth);
+    writeESC(speedValue);
+    // writeESC(pulseWidth);
 
     // Log the command (optional)
-    Serial.print("Speed value: ");
-    Serial.print(speedValue);
-    Serial.print(" | Pulse width: ");
-    Serial.println(pulseWidth);
+    LOG_TRACE(LOG_TAG_ESC, "Speed value: %.0f | Pulse width: %d", speedValue, pulseWidth);
 }
 
 void stopESC()
 {
-    ESC.writeMicroseconds(ESC_MID_PULSE_WIDTH); // Set to neutral position
+    writeESC(ESC_MID_PULSE_WIDTH); // Set to neutral position
 }
+// Brake pulse, held by the BRAKING run state for BRAKE_DURATION
 void brakeESC()
 {
-    ESC.writeMicroseconds(ESC_MID_PULSE_WIDTH - 150); // Set to neutral position
-    delay(2000);
-    BRAKE = false;
+    writeESC(ESC_MID_PULSE_WIDTH - 150);
 }
 
 void adjustMotorSpeedPID(float currentSpeed, float targetSpeed)
 {
-    // Calculate error
+    PROFILE_SCOPE(PROFILE_STAGE_SPEED_PID);
+
+    // Without a calibration the PID alone moves the throttle away from neutral, as it always did
+    int feedforward = ESC_MID_PULSE_WIDTH;
     float error = targetSpeed - currentSpeed;
 
+    if (throttleCalibrated())
+    {
+        // Feedforward from the throttle table. The PID only corrects the residual: the error against a
+        // first order reference of how fast the car should be by now, so the lag of the motor itself
+        // does not wind the trim up while the feedforward is still taking effect
+        if (targetSpeed > 0)
+        {
+            feedforward = throttlePwmForSpeed(targetSpeed);
+        }
+        unsigned long now = halMicros();
+        if (referenceSpeed < 0)
+        {
+            referenceSpeed = currentSpeed;
+            lastReferenceTime = now;
+        }
+        float decay = expf(-micros_to_s(now - lastReferenceTime) / MOTOR_MODEL_TIME_CONSTANT);
+        referenceSpeed = targetSpeed + (referenceSpeed - targetSpeed) * decay;
+        lastReferenceTime = now;
+        error = referenceSpeed - currentSpeed;
+    }
+
     // Calculate integral component with anti-windup
     integral += error;
     integral = constrain(integral, -SPEED_MAX_INTEGRAL, SPEED_MAX_INTEGRAL);
@@ -109,25 +134,38 @@ void adjustMotorSpeedPID(float currentSpeed, float targetSpeed)
     // Limit the adjustment rate to prevent sudden changes
     adjustment = constrain(adjustment, -SPEED_MAX_ACCELERATION, SPEED_MAX_ACCELERATION);
 
-    // Update PWM value directly
-    currentPWM = constrain(currentPWM + (int)adjustment, ESC_MIN_PULSE_WIDTH, ESC_MAX_PULSE_WIDTH);
+    // The PID integrates its adjustments into the trim on top of the feedforward
+    throttleTrim = constrain(throttleTrim + (int)adjustment, ESC_MIN_PULSE_WIDTH - ESC_MID_PULSE_WIDTH, ESC_MAX_PULSE_WIDTH - ESC_MID_PULSE_WIDTH);
+    currentPWM = constrain(feedforward + throttleTrim, ESC_MIN_PULSE_WIDTH, ESC_MAX_PULSE_WIDTH);
 
     // Apply the new PWM value directly to ESC
-    ESC.writeMicroseconds(currentPWM);
+    writeESC(currentPWM);
 
     // Save error for next iteration
     previousError = error;
 
     // Debug output
-    // Serial.printf("Target: %.2f, Current: %.2f, Error: %.2f, Adjustment: %.2f, PWM: %d\n",
-    //               targetSpeed, currentSpeed, error, adjustment, currentPWM);
+    LOG_TRACE(LOG_TAG_ESC, "Target: %.2f, Current: %.2f, Error: %.2f, PWM: %d", targetSpeed, currentSpeed, error, currentPWM);
 }
 
 void resetPID()
 {
     previousError = 0.0;
     integral = 0.0;
+    throttleTrim = 0;
+    referenceSpeed = -1.0;
     currentPWM = ESC_MID_PULSE_WIDTH;  // Reset PWM to neutral
-    ESC.writeMicroseconds(currentPWM); // Apply neutral position
-    Serial.println("PID state reset");
-}
\ No newline at end of file
+    writeESC(currentPWM); // Apply neutral position
+    LOG_DEBUG(LOG_TAG_ESC, "PID state reset");
+}
+
+int getESCPulseWidth()
+{
+    return escPulseWidth;
+}
+
+void getSpeedPIDState(float *lastError, float *accumulated)
+{
+    *lastError = previousError;
+    *accumulated = integral;
+}
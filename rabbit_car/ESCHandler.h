@@ -2,7 +2,8 @@
 #ifndef ESC_HANDLER_H
 #define ESC_HANDLER_H
 
-#include <ESP32Servo.h>
+#include "Hal.h"
+#include "Profile.h"
 #include "config.h"
 
 void setupESC();
@@ -11,5 +12,9 @@ void stopESC();
 void brakeESC();
 void resetPID();
 void adjustMotorSpeedPID(float currentSpeed, float targetSpeed);
+// Pulse width currently sent to the ESC in microseconds
+int getESCPulseWidth();
+// Error (m/s) and accumulated integral of the last adjustMotorSpeedPID() call
+void getSpeedPIDState(float *error, float *integral);
 
 #endif
\ No newline at end of file
@@ -1,101 +1,199 @@
+// HSHandler.cpp
 #include "HSHandler.h"
 
-const float WHEEL_CIRCUMFERENCE = PI * WHEEL_DIAMETER; // in mm
-const float MEASUREMENT_INTERVAL = 200000;               // Time interval for speed calculation (ms)
-
-// Variables
-volatile unsigned long pulseCount = 0;         // Total pulse count
-volatile unsigned long intervalPulseCount = 0; // Pulse count within current interval
-unsigned long lastMeasurementTime = 0;         // Last time speed was calculated
+// Ring buffer of hall edge timestamps (micros)
+// Single producer (ISR) / single consumer (hsUpdate): the ISR writes the slot for the next edge
+// and only then publishes it by incrementing edgeCount, so the reader never sees a half written entry
+const uint32_t HS_EDGE_BUFFER_SIZE = 32; // must be a power of two larger than HS_SPEED_AVERAGE_EDGES
+static_assert((HS_EDGE_BUFFER_SIZE & (HS_EDGE_BUFFER_SIZE - 1)) == 0 && HS_EDGE_BUFFER_SIZE > HS_SPEED_AVERAGE_EDGES, "bad HS_EDGE_BUFFER_SIZE");
+volatile uint32_t edgeTimes[HS_EDGE_BUFFER_SIZE];
+volatile uint32_t edgeCount = 0; // Total edges seen since boot
+uint32_t runStartEdge = 0;       // edgeCount when the current run started
+unsigned long runStartTime = 0;  // halMicros() when the current run started
+
+// Fused speed estimate, see SpeedEstimator.h
+SpeedEstimator speedEstimate;
+unsigned long lastEstimateTime = 0;
+uint32_t lastObservedEdge = 0; // edgeCount at the last update
+Meters estimatedDistance;      // interpolated distance of the current run
+bool standstill = true;               // no edge for HS_STANDSTILL_TIMEOUT, the estimate was reset once
+unsigned long standstillStartTime = 0; // halMicros() when the standstill was detected
+
+// Odometry corrections from course markers (Course.h): distance at a pulse anchor plus scaled pulses since.
+// The scale is a property of the wheel, so it carries over between runs
+float odometryScale = 1.0;
+Meters pulseDistance = DISTANCE_PER_PULSE; // per pulse, scaled
+Meters distanceAnchor;                     // at anchorPulses
+uint32_t anchorPulses = 0;
+Meters odometryDistance; // uncorrected and unscaled distance of the current run
 
 // Interrupt Service Routine for hall sensor
 void IRAM_ATTR hallSensorISR()
 {
-  pulseCount++;
-  intervalPulseCount++;
+  uint32_t count = edgeCount;
+  edgeTimes[count & (HS_EDGE_BUFFER_SIZE - 1)] = halMicros();
+  __atomic_store_n(&edgeCount, count + 1, __ATOMIC_RELEASE);
 }
 
 void setupHS()
 {
-  pinMode(HS_PIN, INPUT_PULLUP);
   // Attach interrupt to hall sensor pin
-  attachInterrupt(digitalPinToInterrupt(HS_PIN), hallSensorISR, FALLING);
+  halHallAttach(HS_PIN, hallSensorISR);
 
   Serial.println("ESP32 Hall Sensor Speed & Distance Tracker");
   Serial.print("Wheel Diameter: ");
-  Serial.print(WHEEL_DIAMETER);
+  Serial.print(WHEEL_DIAMETER.count());
   Serial.println(" mm");
   Serial.print("Wheel Circumference: ");
-  Serial.print(WHEEL_CIRCUMFERENCE);
+  Serial.print(WHEEL_CIRCUMFERENCE.count());
   Serial.println(" mm");
   Serial.print("Magnets on wheel: ");
   Serial.println(MAGNETS_COUNT);
   Serial.println("Ready to measure...");
 
-  lastMeasurementTime = micros();
+  runStartEdge = __atomic_load_n(&edgeCount, __ATOMIC_ACQUIRE);
+  lastObservedEdge = runStartEdge;
+  speedEstimatorReset(&speedEstimate, 0.0);
+  lastEstimateTime = halMicros();
+  standstill = true;
+  standstillStartTime = lastEstimateTime;
 }
 
 void hsUpdate(float *currentSpeed, float *averageSpeed, float *totalDistance)
 {
-  unsigned long currentTime = micros();
+  PROFILE_SCOPE(PROFILE_STAGE_HS_UPDATE);
 
-  // Calculate speed and distance every MEASUREMENT_INTERVAL
-  if (currentTime - lastMeasurementTime >= MEASUREMENT_INTERVAL)
-  {
-    // Get pulses during this interval
-    unsigned long pulsesDuringInterval = intervalPulseCount;
-    intervalPulseCount = 0; // Reset interval counter
+  unsigned long currentTime = halMicros();
+  uint32_t count = __atomic_load_n(&edgeCount, __ATOMIC_ACQUIRE);
+  uint32_t pulses = count - runStartEdge;
+
+  // Motor model step for the time since the last update
+  speedEstimatorPredict(&speedEstimate, micros_to_s(currentTime - lastEstimateTime), getESCPulseWidth());
+  lastEstimateTime = currentTime;
 
-    // Calculate distance traveled during this interval (in meters)
-    // Each pulse represents 1/MAGNETS_COUNT of a rotation
-    float intervalDistance = (pulsesDuringInterval * WHEEL_CIRCUMFERENCE) / (MAGNETS_COUNT * 1000.0); // mm to m
+  uint32_t lastEdge = edgeTimes[(count - 1) & (HS_EDGE_BUFFER_SIZE - 1)];
+  uint32_t sinceLastEdge = currentTime - lastEdge;
 
-    // Add the interval distance to total distance
-    *totalDistance += intervalDistance;
+  if (count == 0 || sinceLastEdge >= HS_STANDSTILL_TIMEOUT)
+  {
+    // No edge for a while, the wheel has stopped. Reset once: from then on the motor model predicts
+    // the restart until the next edges confirm it
+    if (!standstill)
+    {
+      standstill = true;
+      standstillStartTime = currentTime;
+      speedEstimatorReset(&speedEstimate, 0.0);
+    }
+  }
+  else if (count != lastObservedEdge && count >= 2)
+  {
+    standstill = false;
 
-    // Calculate current speed (m/s)
-    float intervalSeconds = micros_to_s(currentTime - lastMeasurementTime);
-    *currentSpeed = intervalDistance / intervalSeconds;
-    // Serial.printf("Current Speed: %.2f\n", *currentSpeed);
+    // Hall speed over the edge periods that ended since the last update, at most HS_SPEED_AVERAGE_EDGES
+    uint32_t periods = min(min(count - lastObservedEdge, count - 1), (uint32_t)HS_SPEED_AVERAGE_EDGES);
+    uint32_t firstEdge = edgeTimes[(count - 1 - periods) & (HS_EDGE_BUFFER_SIZE - 1)];
+    uint32_t span = lastEdge - firstEdge;
 
-    // Update running average speed
-    float runTimeSeconds = micros_to_s(currentRunDuration);
-    if (runTimeSeconds > 0)
+    // The first edge after a standstill closes a period that says nothing about the current speed
+    if (span < periods * HS_STANDSTILL_TIMEOUT)
     {
-      *averageSpeed = (*totalDistance) / runTimeSeconds;
+      MetersPerSecond measuredSpeed = pulseDistance * (float)periods / unitCast<Seconds>(Microseconds(span));
+      speedEstimatorObserve(&speedEstimate, measuredSpeed.count(), SPEED_EST_MEASUREMENT_NOISE / periods);
     }
-    else
+  }
+  else
+  {
+    // While decelerating the next edge is late, the open period bounds the speed from above
+    MetersPerSecond openPeriodSpeed = pulseDistance / unitCast<Seconds>(Microseconds(sinceLastEdge));
+    if (openPeriodSpeed.count() < speedEstimate.speed)
     {
-      *averageSpeed = 0;
+      speedEstimatorObserve(&speedEstimate, openPeriodSpeed.count(), SPEED_EST_MEASUREMENT_NOISE);
     }
+  }
+  lastObservedEdge = count;
+
+  *currentSpeed = speedEstimate.speed;
+
+  // Each pulse represents 1/MAGNETS_COUNT of a rotation, in between the distance is interpolated
+  // with the estimated speed, capped at the next pulse and never moving backwards
+  unsigned long lastAnchor = pulses > 0 ? lastEdge : runStartTime;
+  if (standstill && (long)(standstillStartTime - lastAnchor) > 0)
+  {
+    lastAnchor = standstillStartTime; // the predicted restart starts where the wheel stopped
+  }
+  Meters sinceAnchor = MetersPerSecond(speedEstimate.speed) * unitCast<Seconds>(Microseconds(currentTime - lastAnchor));
+  Meters distance = distanceAnchor + pulseDistance * (float)(pulses - anchorPulses) + min(sinceAnchor, pulseDistance);
+  odometryDistance = DISTANCE_PER_PULSE * (float)pulses + min(sinceAnchor / odometryScale, DISTANCE_PER_PULSE);
+  if (distance > estimatedDistance)
+  {
+    estimatedDistance = distance;
+  }
+  *totalDistance = estimatedDistance.count();
 
-    // Update last measurement time
-    lastMeasurementTime = currentTime;
-
-    // Display results
-    // Serial.print("Pulses: ");
-    // Serial.print(pulseCount);
-    // Serial.print(" | Speed: ");
-    // Serial.print(*currentSpeed, 2);
-    // Serial.print(" m/s (");
-    // Serial.print(*currentSpeed * 3.6, 2); // Convert to km/h
-    // Serial.print(" km/h) | Distance: ");
-    // Serial.print(*totalDistance, 3);
-    // Serial.print(" m | Avg Speed: ");
-    // Serial.print(*averageSpeed, 2);
-    // Serial.println(" m/s");
+  // Update running average speed
+  float runTimeSeconds = micros_to_s(currentRunDuration);
+  if (runTimeSeconds > 0)
+  {
+    *averageSpeed = (*totalDistance) / runTimeSeconds;
+  }
+  else
+  {
+    *averageSpeed = 0;
   }
 }
 
+float hsAcceleration()
+{
+  return speedEstimate.acceleration;
+}
+
+float hsOdometry()
+{
+  return odometryDistance.count();
+}
+
+float hsOdometryScale()
+{
+  return odometryScale;
+}
+
+void hsCorrectOdometry(float correction, float scale)
+{
+  // Re-anchor at the last pulse hsUpdate() saw, so the pulses before it keep their old scale
+  uint32_t pulses = lastObservedEdge - runStartEdge;
+  distanceAnchor += pulseDistance * (float)(pulses - anchorPulses) + Meters(correction);
+  anchorPulses = pulses;
+  estimatedDistance = max(estimatedDistance + Meters(correction), Meters(0.0));
+
+  // Speeds were measured with the old pulse distance
+  speedEstimate.speed *= scale / odometryScale;
+  odometryScale = scale;
+  pulseDistance = DISTANCE_PER_PULSE * scale;
+}
+
+uint32_t hsEdgeCount()
+{
+  return __atomic_load_n(&edgeCount, __ATOMIC_ACQUIRE);
+}
+
+uint32_t hsEdgeTime(uint32_t edge)
+{
+  return edgeTimes[edge & (HS_EDGE_BUFFER_SIZE - 1)];
+}
+
 void hsStart()
 {
-  Serial.printf("HS Cleared, Last Run Length: %.2f\n", micros_to_s(currentRunDuration));
+  LOG_INFO(LOG_TAG_HS, "HS Cleared, Last Run Length: %.2f", micros_to_s(currentRunDuration));
 
   totalDistance = 0.0;
   currentSpeed = 0.0;
   averageSpeed = 0.0;
-
-  pulseCount = 0;
-  intervalPulseCount = 0;
-  lastMeasurementTime = micros();
+  estimatedDistance = Meters(0.0);
+  distanceAnchor = Meters(0.0);
+  anchorPulses = 0;
+  odometryDistance = Meters(0.0);
+
+  // The speed estimate carries over, a run can start while the car is still rolling
+  runStartEdge = __atomic_load_n(&edgeCount, __ATOMIC_ACQUIRE);
+  runStartTime = halMicros();
 }
\ No newline at end of file
@@ -2,11 +2,31 @@
 #ifndef HS_HANDLER_H
 #define HS_HANDLER_H
 
-#include <arduino.h>
+#include <Arduino.h>
+#include "Hal.h"
+#include "Profile.h"
 #include "config.h"
+#include "SpeedEstimator.h"
+#include "ESCHandler.h"
+
+// Distance the wheel travels between two hall edges
+constexpr Millimeters WHEEL_CIRCUMFERENCE = WHEEL_DIAMETER * (float)PI;
+constexpr Meters DISTANCE_PER_PULSE = unitCast<Meters>(WHEEL_CIRCUMFERENCE) / (float)MAGNETS_COUNT;
 
 void setupHS();
+// Update the fused speed estimate and the run's distance and average speed, once per control period
 void hsUpdate(float *, float *, float *);
 void hsStart();
+// Smoothed acceleration of the speed estimate in m/s^2
+float hsAcceleration();
+// Distance of the current run from the hall pulses alone, without marker corrections or scale
+float hsOdometry();
+// Course marker correction (Course.h): shift the run's distance by correction meters and measure
+// distance and speed with DISTANCE_PER_PULSE * scale from now on
+void hsCorrectOdometry(float correction, float scale);
+float hsOdometryScale();
+// Hall edges seen since boot, and the halMicros() timestamp of one of the last 32 of them
+uint32_t hsEdgeCount();
+uint32_t hsEdgeTime(uint32_t edge);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,120 @@
+// Hal.h
+// Hardware abstraction layer: the control core only talks to the car through these functions.
+// HalESP32.cpp implements them on the car, host/HalLinux.cpp implements them for the Linux build.
+#ifndef HAL_H
+#define HAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Time
+unsigned long halMicros();
+unsigned long halMillis();
+void halDelay(unsigned long ms);
+
+// Free running CPU cycle counter for profiling, wraps; only compare counts taken on the same core
+uint32_t halCycleCount();
+uint32_t halCyclesPerMicro();
+
+// I2C line sensor modules, one 8 channel module per bus. Both buses are read concurrently in the
+// background; the newest frame is taken without waiting for either bus
+struct HalLineFrame
+{
+  uint8_t module1;      // raw channel byte of sensors 0-7, 0 if the module did not answer
+  uint8_t module2;      // sensors 8-15, 0 if the module did not answer
+  bool ok;              // both modules answered
+  uint32_t captureTime; // halMicros() when the reads were issued
+  uint32_t sequence;    // frames since halLineSensorsBegin(), a repeat of the last frame has the same one
+};
+
+// Start the background acquisition
+void halLineSensorsBegin();
+/**
+ * Copy the newest complete frame, never waits for the bus
+ * @param frame Filled in when a frame exists
+ * @return bool False before the first frame
+ */
+bool halLineSensorsLatest(HalLineFrame *frame);
+
+// PWM outputs (50 Hz servo style pulses)
+enum HalPwmChannel : uint8_t
+{
+  HAL_PWM_ESC = 0,
+  HAL_PWM_SERVO,
+  HAL_PWM_COUNT,
+};
+
+void halPwmAttach(HalPwmChannel channel, int pin, int minPulseWidth, int maxPulseWidth);
+void halPwmWriteMicros(HalPwmChannel channel, int pulseWidth);
+
+// Hall sensor input, isr is called on every falling edge
+void halHallAttach(int pin, void (*isr)());
+
+// Addressable LED strips
+enum HalLedStrip : uint8_t
+{
+  HAL_LED_HEAD = 0,
+  HAL_LED_LEFT,
+  HAL_LED_RIGHT,
+  HAL_LED_STRIP_COUNT,
+};
+
+void halLedBegin(HalLedStrip strip, int pin, uint16_t count, uint8_t brightness);
+void halLedSetPixel(HalLedStrip strip, uint16_t index, uint32_t color);
+void halLedShow(HalLedStrip strip);
+
+// Packed 0x00RRGGBB, same as Adafruit_NeoPixel::Color()
+constexpr uint32_t halLedColor(uint8_t r, uint8_t g, uint8_t b)
+{
+  return ((uint32_t)r << 16) | ((uint32_t)g << 8) | b;
+}
+
+// BLE transport for the data characteristic
+bool halBleConnected();
+void halBleNotify(const uint8_t *data, size_t length);
+// Largest notification payload the current connection carries (ATT MTU - 3)
+size_t halBleMaxNotifySize();
+
+enum HalBlePhy : uint8_t
+{
+  HAL_BLE_PHY_UNKNOWN = 0,
+  HAL_BLE_PHY_1M,
+  HAL_BLE_PHY_2M,
+  HAL_BLE_PHY_CODED,
+};
+
+// Parameters the central agreed to for the current connection
+struct HalBleLinkInfo
+{
+  uint16_t mtu;                // ATT MTU
+  HalBlePhy phy;               // transmit PHY
+  uint16_t interval;           // connection interval in 1.25 ms units
+  uint16_t latency;            // connection events the car may skip
+  uint16_t supervisionTimeout; // 10 ms units
+};
+
+void halBleLinkInfo(HalBleLinkInfo *info);
+
+// File storage (LittleFS on the car), a few files open at a time
+enum HalFileMode : uint8_t
+{
+  HAL_FILE_READ = 0,
+  HAL_FILE_WRITE, // truncates
+};
+
+bool halStorageBegin();
+// Returns a handle >= 0, or -1 on failure
+int halFileOpen(const char *path, HalFileMode mode);
+size_t halFileWrite(int file, const uint8_t *data, size_t length);
+// Returns the bytes read, 0 at the end of the file or on failure
+size_t halFileRead(int file, uint32_t offset, uint8_t *data, size_t length);
+uint32_t halFileSize(int file);
+void halFileClose(int file);
+
+// Small persistent settings (NVS on the car), each key holds one fixed size blob
+// Read fails if the key is missing or was stored with a different length
+bool halSettingsRead(const char *key, uint8_t *data, size_t length);
+bool halSettingsWrite(const char *key, const uint8_t *data, size_t length);
+void halSettingsErase(const char *key);
+
+#endif
@@ -0,0 +1,268 @@
+// HalESP32.cpp
+// Hal.h on the car: the ESP-IDF I2C master driver, ESP32Servo, attachInterrupt and Adafruit_NeoPixel
+#include "Hal.h"
+#include <Arduino.h>
+#include <driver/i2c_master.h>
+#include <ESP32Servo.h>
+#include <Adafruit_NeoPixel.h>
+#include <LittleFS.h>
+#include <Preferences.h>
+#include "config.h"
+#include "LatestFrame.h"
+
+// I2C address of the line patrol module
+const byte SENSOR_ADDR = 0x12; // Default address of the 8-channel line patrol module
+const byte SENSOR_REG = 0x30;  // Register to read sensor values from
+
+Servo pwmOutputs[HAL_PWM_COUNT];
+Adafruit_NeoPixel ledStrips[HAL_LED_STRIP_COUNT];
+
+const int HAL_MAX_OPEN_FILES = 2;
+File openFiles[HAL_MAX_OPEN_FILES];
+
+Preferences settings;
+bool settingsOpen = false;
+
+unsigned long IRAM_ATTR halMicros()
+{
+  return micros();
+}
+
+unsigned long halMillis()
+{
+  return millis();
+}
+
+void halDelay(unsigned long ms)
+{
+  delay(ms);
+}
+
+uint32_t IRAM_ATTR halCycleCount()
+{
+  return ESP.getCycleCount();
+}
+
+uint32_t halCyclesPerMicro()
+{
+  return getCpuFrequencyMhz();
+}
+
+// Line sensor acquisition: a task issues the register read on both buses at once through the
+// asynchronous I2C master driver (trans_queue_depth > 0), sleeps until both done callbacks have
+// fired, and publishes the frame; the buses no longer wait on each other or on the control loop
+const int LINE_MODULE_COUNT = 2;
+const int LINE_MODULE_SDA[LINE_MODULE_COUNT] = {IR1_SDA_PIN, IR2_SDA_PIN}; // sensors 0-7, 8-15
+const int LINE_MODULE_SCL[LINE_MODULE_COUNT] = {IR1_SCL_PIN, IR2_SCL_PIN};
+
+static i2c_master_bus_handle_t lineBuses[LINE_MODULE_COUNT];
+static i2c_master_dev_handle_t lineModules[LINE_MODULE_COUNT]; // same address on both buses
+static TaskHandle_t lineSensorTask = NULL;
+
+// Transfer buffers, owned by the driver until the done callback
+static const uint8_t lineSensorRegister = SENSOR_REG;
+static uint8_t lineReadBytes[LINE_MODULE_COUNT];
+static volatile bool lineReadOk[LINE_MODULE_COUNT];
+
+// Published by the task, read by halLineSensorsLatest() on any core
+static LatestFrame<HalLineFrame> lineFrames;
+
+static bool IRAM_ATTR lineReadDone(i2c_master_dev_handle_t device, const i2c_master_event_data_t *event, void *arg)
+{
+  lineReadOk[(intptr_t)arg] = event->event == I2C_EVENT_DONE;
+  BaseType_t higherPriorityTaskWoken = pdFALSE;
+  vTaskNotifyGiveFromISR(lineSensorTask, &higherPriorityTaskWoken);
+  return higherPriorityTaskWoken == pdTRUE;
+}
+
+static void publishLineFrame(uint32_t captureTime)
+{
+  uint32_t sequence;
+  HalLineFrame &frame = latestFrameBegin(&lineFrames, &sequence);
+  frame.module1 = lineReadOk[0] ? lineReadBytes[0] : 0;
+  frame.module2 = lineReadOk[1] ? lineReadBytes[1] : 0;
+  frame.ok = lineReadOk[0] && lineReadOk[1];
+  frame.captureTime = captureTime;
+  frame.sequence = sequence;
+  latestFramePublish(&lineFrames, sequence);
+}
+
+static void lineSensorLoop(void *parameter)
+{
+  TickType_t lastWakeTime = xTaskGetTickCount();
+  for (;;)
+  {
+    ulTaskNotifyTake(pdTRUE, 0); // drop a late callback of a timed out read
+    uint32_t captureTime = micros();
+    int pending = 0;
+    for (int i = 0; i < LINE_MODULE_COUNT; i++)
+    {
+      lineReadOk[i] = false;
+      if (lineModules[i] && i2c_master_transmit_receive(lineModules[i], &lineSensorRegister, 1, &lineReadBytes[i], 1, IR_I2C_TIMEOUT_MS) == ESP_OK)
+      {
+        pending++;
+      }
+    }
+    while (pending > 0 && ulTaskNotifyTake(pdFALSE, pdMS_TO_TICKS(IR_I2C_TIMEOUT_MS) + 1) > 0)
+    {
+      pending--;
+    }
+
+    publishLineFrame(captureTime);
+    vTaskDelayUntil(&lastWakeTime, pdMS_TO_TICKS(IR_ACQUISITION_PERIOD_MS));
+  }
+}
+
+void halLineSensorsBegin()
+{
+  for (int i = 0; i < LINE_MODULE_COUNT; i++)
+  {
+    i2c_master_bus_config_t busConfig = {};
+    busConfig.i2c_port = i;
+    busConfig.sda_io_num = (gpio_num_t)LINE_MODULE_SDA[i];
+    busConfig.scl_io_num = (gpio_num_t)LINE_MODULE_SCL[i];
+    busConfig.clk_source = I2C_CLK_SRC_DEFAULT;
+    busConfig.glitch_ignore_cnt = 7;
+    busConfig.trans_queue_depth = 1; // asynchronous transfers
+    busConfig.flags.enable_internal_pullup = true;
+
+    i2c_device_config_t moduleConfig = {};
+    moduleConfig.dev_addr_length = I2C_ADDR_BIT_LEN_7;
+    moduleConfig.device_address = SENSOR_ADDR;
+    moduleConfig.scl_speed_hz = IR_I2C_CLOCK_HZ;
+
+    i2c_master_event_callbacks_t callbacks = {};
+    callbacks.on_trans_done = lineReadDone;
+
+    if (i2c_new_master_bus(&busConfig, &lineBuses[i]) != ESP_OK ||
+        i2c_master_bus_add_device(lineBuses[i], &moduleConfig, &lineModules[i]) != ESP_OK ||
+        i2c_master_register_event_callbacks(lineModules[i], &callbacks, (void *)(intptr_t)i) != ESP_OK)
+    {
+      lineModules[i] = NULL; // reads as a module that does not answer
+      LOG_ERROR(LOG_TAG_IR, "Line sensor bus %d could not be set up", i + 1);
+    }
+  }
+
+  xTaskCreatePinnedToCore(lineSensorLoop, "irAcquire", IR_ACQUISITION_STACK_SIZE, NULL, IR_ACQUISITION_PRIORITY, &lineSensorTask, IR_ACQUISITION_CORE);
+}
+
+bool halLineSensorsLatest(HalLineFrame *frame)
+{
+  return latestFrameRead(lineFrames, frame);
+}
+
+void halPwmAttach(HalPwmChannel channel, int pin, int minPulseWidth, int maxPulseWidth)
+{
+  pinMode(pin, OUTPUT);
+  // Two LEDC timers per output: 0,1 for the ESC and 2,3 for the steering servo
+  ESP32PWM::allocateTimer(channel * 2);
+  ESP32PWM::allocateTimer(channel * 2 + 1);
+  pwmOutputs[channel].setPeriodHertz(50); // Standard 50Hz servo frequency
+  pwmOutputs[channel].attach(pin, minPulseWidth, maxPulseWidth);
+}
+
+void halPwmWriteMicros(HalPwmChannel channel, int pulseWidth)
+{
+  pwmOutputs[channel].writeMicroseconds(pulseWidth);
+}
+
+void halHallAttach(int pin, void (*isr)())
+{
+  pinMode(pin, INPUT_PULLUP);
+  attachInterrupt(digitalPinToInterrupt(pin), isr, FALLING);
+}
+
+void halLedBegin(HalLedStrip strip, int pin, uint16_t count, uint8_t brightness)
+{
+  Adafruit_NeoPixel &leds = ledStrips[strip];
+  leds.updateType(NEO_GRB + NEO_KHZ800);
+  leds.updateLength(count);
+  leds.setPin(pin);
+  leds.begin();
+  leds.show(); // Initialize all pixels to 'off'
+  leds.setBrightness(brightness);
+}
+
+void halLedSetPixel(HalLedStrip strip, uint16_t index, uint32_t color)
+{
+  ledStrips[strip].setPixelColor(index, color);
+}
+
+void halLedShow(HalLedStrip strip)
+{
+  ledStrips[strip].show();
+}
+
+bool halStorageBegin()
+{
+  return LittleFS.begin(true); // formats the partition on first use
+}
+
+int halFileOpen(const char *path, HalFileMode mode)
+{
+  for (int i = 0; i < HAL_MAX_OPEN_FILES; i++)
+  {
+    if (!openFiles[i])
+    {
+      openFiles[i] = LittleFS.open(path, mode == HAL_FILE_WRITE ? FILE_WRITE : FILE_READ);
+      return openFiles[i] ? i : -1;
+    }
+  }
+  return -1;
+}
+
+size_t halFileWrite(int file, const uint8_t *data, size_t length)
+{
+  return openFiles[file].write(data, length);
+}
+
+size_t halFileRead(int file, uint32_t offset, uint8_t *data, size_t length)
+{
+  if (openFiles[file].position() != offset && !openFiles[file].seek(offset))
+  {
+    return 0;
+  }
+  int count = openFiles[file].read(data, length);
+  return count > 0 ? count : 0; // -1 on a read error
+}
+
+uint32_t halFileSize(int file)
+{
+  return openFiles[file].size();
+}
+
+void halFileClose(int file)
+{
+  openFiles[file].close();
+}
+
+static bool beginSettings()
+{
+  if (!settingsOpen)
+  {
+    settingsOpen = settings.begin("rabbit", false);
+  }
+  return settingsOpen;
+}
+
+bool halSettingsRead(const char *key, uint8_t *data, size_t length)
+{
+  if (!beginSettings() || settings.getBytesLength(key) != length)
+  {
+    return false;
+  }
+  return settings.getBytes(key, data, length) == length;
+}
+
+bool halSettingsWrite(const char *key, const uint8_t *data, size_t length)
+{
+  return beginSettings() && settings.putBytes(key, data, length) == length;
+}
+
+void halSettingsErase(const char *key)
+{
+  if (beginSettings())
+  {
+    settings.remove(key);
+  }
+}
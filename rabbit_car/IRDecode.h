@@ -0,0 +1,181 @@
+// IRDecode.h
+// Table driven decoding of the 16 channel line sensor mask
+// Plain C++ with no Arduino dependencies so it can also be built on the host (see host/bench)
+#ifndef IR_DECODE_H
+#define IR_DECODE_H
+
+#include <stdint.h>
+
+// Sensor mask layout: module 1 is the high byte, module 2 the low byte.
+// Sensor 0 (module 1 bit 7) is mask bit 15 and sensor 15 (module 2 bit 0) is mask bit 0,
+// so a set bit means the sensor sees the line after irMaskFromModules()
+const int IR_SENSOR_COUNT = 16;
+const int IR_POSITION_SCALE = 1000; // position units per sensor, positions run 0-15000
+
+// Normal line: 2-8 active sensors spanning 2-8 sensors; wider patterns are triangles/markings
+const int IR_MIN_LINE_WIDTH = 2;
+const int IR_MAX_LINE_WIDTH = 8;
+
+// Temporal mask filter (irFilterMask): a sensor that turns on within IR_FILTER_REACH sensors of the
+// filtered line, since a real line moves at most that far per control period, or in one unbroken run
+// with such a sensor (a marker growing out of the line) is accepted at once; one further away (glare,
+// a stray mark) only once it has been on for IR_FILTER_CONFIRM_FRAMES frames
+const int IR_FILTER_REACH = 2;
+const int IR_FILTER_CONFIRM_FRAMES = 7; // 14 ms at CONTROL_LOOP_HZ
+const int IR_FILTER_COUNT_BITS = 3; // counter planes, counts saturate at IR_FILTER_CONFIRM_FRAMES
+
+static_assert(IR_FILTER_CONFIRM_FRAMES < (1 << IR_FILTER_COUNT_BITS), "IR_FILTER_COUNT_BITS too small");
+
+// Per byte lookup: sum of the sensor indices (0-7, bit 7 = index 0) of the set bits
+struct IRByteTable
+{
+  uint8_t weight[256];
+};
+
+constexpr IRByteTable makeIRByteTable()
+{
+  IRByteTable table = {};
+  for (int b = 0; b < 256; b++)
+  {
+    int weight = 0;
+    for (int j = 0; j < 8; j++)
+    {
+      if (b & (0x80 >> j))
+      {
+        weight += j;
+      }
+    }
+    table.weight[b] = weight;
+  }
+  return table;
+}
+
+static constexpr IRByteTable IR_BYTE_TABLE = makeIRByteTable();
+
+// Combine the two module bytes, inverting with a single XOR when following a black line
+inline uint16_t irMaskFromModules(uint8_t module1, uint8_t module2, bool whiteLine)
+{
+  uint16_t invert = whiteLine ? 0x0000 : 0xFFFF;
+  return (uint16_t)(((module1 << 8) | module2) ^ invert);
+}
+
+inline bool irSensorActive(uint16_t mask, int sensor)
+{
+  return (mask >> (IR_SENSOR_COUNT - 1 - sensor)) & 1;
+}
+
+inline int irActiveCount(uint16_t mask)
+{
+  return __builtin_popcount(mask);
+}
+
+// Number of sensors from the first to the last active one, 0 for an empty mask
+inline int irSpan(uint16_t mask)
+{
+  if (mask == 0)
+  {
+    return 0;
+  }
+  return (31 - __builtin_clz(mask)) - __builtin_ctz(mask) + 1;
+}
+
+// Sum of the active sensor indices
+inline int irWeightedSum(uint16_t mask)
+{
+  uint8_t high = mask >> 8;
+  uint8_t low = mask & 0xFF;
+  return IR_BYTE_TABLE.weight[high] + IR_BYTE_TABLE.weight[low] + 8 * __builtin_popcount(low);
+}
+
+// Weighted average line position (0-15000), or lastPosition when no sensor sees the line
+inline int irPosition(uint16_t mask, int lastPosition)
+{
+  int count = irActiveCount(mask);
+  if (count == 0)
+  {
+    return lastPosition;
+  }
+  return irWeightedSum(mask) * IR_POSITION_SCALE / count;
+}
+
+inline bool irIsValidLinePattern(uint16_t mask)
+{
+  unsigned count = irActiveCount(mask);
+  unsigned span = irSpan(mask);
+  return count - IR_MIN_LINE_WIDTH <= (unsigned)(IR_MAX_LINE_WIDTH - IR_MIN_LINE_WIDTH) &&
+         span - IR_MIN_LINE_WIDTH <= (unsigned)(IR_MAX_LINE_WIDTH - IR_MIN_LINE_WIDTH);
+}
+
+// Filter state: one consecutive-frames counter per sensor, bit sliced so that plane b holds bit b
+// of all 16 counters and every update is a handful of bitwise operations
+struct IRMaskFilter
+{
+  uint16_t planes[IR_FILTER_COUNT_BITS];
+  uint16_t filtered; // last irFilterMask() result
+};
+
+// Sensors whose counter is at least IR_FILTER_CONFIRM_FRAMES, a bit sliced compare from the top plane
+inline uint16_t irFilterConfirmed(const IRMaskFilter &filter)
+{
+  uint16_t above = 0, equal = 0xFFFF;
+  for (int b = IR_FILTER_COUNT_BITS - 1; b >= 0; b--)
+  {
+    if (IR_FILTER_CONFIRM_FRAMES & (1 << b))
+    {
+      equal &= filter.planes[b];
+    }
+    else
+    {
+      above |= equal & filter.planes[b];
+      equal &= ~filter.planes[b];
+    }
+  }
+  return above | equal;
+}
+
+// Bits of mask connected to seed through unbroken runs of mask, in both directions. Kogge-Stone
+// occluded fill: four doubling steps per direction instead of one step per sensor
+inline uint16_t irConnectedRuns(uint16_t seed, uint16_t mask)
+{
+  uint16_t up = seed & mask, upPass = mask;
+  uint16_t down = up, downPass = mask;
+  for (int shift = 1; shift < IR_SENSOR_COUNT; shift <<= 1)
+  {
+    up |= upPass & (uint16_t)(up << shift);
+    upPass &= (uint16_t)(upPass << shift);
+    down |= downPass & (down >> shift);
+    downPass &= downPass >> shift;
+  }
+  return up | down;
+}
+
+// Filter one frame. Sensors that turn off are dropped at once, so the line's edges follow the raw
+// mask without delay; when the filtered line was empty the raw mask is taken as it is
+inline uint16_t irFilterMask(IRMaskFilter *filter, uint16_t mask)
+{
+  // Count frames each sensor has been on: clear where off, saturating increment where on
+  uint16_t carry = mask & ~irFilterConfirmed(*filter);
+  for (int b = 0; b < IR_FILTER_COUNT_BITS; b++)
+  {
+    uint16_t plane = filter->planes[b] & mask;
+    filter->planes[b] = plane ^ carry;
+    carry &= plane;
+  }
+
+  uint16_t last = filter->filtered;
+  if (last == 0)
+  {
+    filter->filtered = mask;
+    return mask;
+  }
+
+  uint16_t near = last;
+  for (int r = 1; r <= IR_FILTER_REACH; r++)
+  {
+    near |= (uint16_t)(last << r) | (uint16_t)(last >> r);
+  }
+  filter->filtered = irConnectedRuns(near, mask) | (mask & irFilterConfirmed(*filter));
+  return filter->filtered;
+}
+
+#endif
@@ -1,17 +1,15 @@
 // IRHandler.cpp
-// ESP32 Line Sensor Reader using I2C method
+// Line Sensor Reader, the I2C transfers are in the HAL
 // Only handles sensor reading and direction determination
 
 #include "IRHandler.h"
 
-// I2C address of the line patrol module
-const int IR_SENSOR_COUNT = 16;
-const byte SENSOR_ADDR = 0x12; // Default address of the 8-channel line patrol module
-const byte SENSOR_REG = 0x30;  // Register to read sensor values from
-
 // Variables for line following
-int sensorValues[IR_SENSOR_COUNT]; // Array to store sensor readings
-int linePosition = 0;              // Position of the line (0-7000)
+uint16_t sensorMask = 0;   // Sensor readings, one bit per sensor (see IRDecode.h), 1 = on the line
+uint16_t filteredMask = 0; // sensorMask without single frame glare, what the line logic uses
+IRMaskFilter maskFilter = {};
+uint32_t lastFrameSequence = 0; // HalLineFrame::sequence of the frame behind sensorMask
+int linePosition = 0;    // Position of the line (0-15000)
 
 // Add these variables to your IRHandler
 int previousValidPosition = 7500; // Last known good position
@@ -22,70 +20,57 @@ int minConsecutiveReadings = 0; // Require X consecutive similar readings
 void irSetup()
 {
   // Initialize I2C communication
-  Wire.begin(IR1_SDA_PIN, IR1_SCL_PIN);
-  Wire1.begin(IR2_SDA_PIN, IR2_SCL_PIN);
+  halLineSensorsBegin();
 
   // Wait for sensor module to initialize
-  delay(1000);
+  halDelay(1000);
 
   Serial.println("I2C Line sensor reader ready!");
 }
 
-void readIRSensorsI2C() {
-    // Read from first module (sensors 0-7)
-    Wire.beginTransmission(SENSOR_ADDR);
-    Wire.write(SENSOR_REG);
-    Wire.endTransmission();
-    Wire.requestFrom(SENSOR_ADDR, 1);
-    
-    byte data1 = 0;
-    if (Wire.available()) {
-        data1 = Wire.read();
-    }
-    
-    // Read from second module (sensors 8-15)
-    Wire1.beginTransmission(SENSOR_ADDR);  // Assuming same address
-    Wire1.write(SENSOR_REG);
-    Wire1.endTransmission();
-    Wire1.requestFrom(SENSOR_ADDR, 1);
-    
-    byte data2 = 0;
-    if (Wire1.available()) {
-        data2 = Wire1.read();
-    }
-    
-    // Extract sensor values from first module (0-7)
-    for (int i = 0; i < 8; i++) {
-        sensorValues[i] = ((data1 >> (7-i)) & 0x01) ^ (!IS_WHITE_LINE);
-    }
-    
-    // Extract sensor values from second module (8-15)
-    for (int i = 0; i < 8; i++) {
-        sensorValues[i + 8] = ((data2 >> (7-i)) & 0x01) ^ (!IS_WHITE_LINE);
-    }
-}
-
-int getPosition()
+void readIRSensors()
 {
-  // Calculate weighted average for line position
-  int sum = 0;
-  int weightedSum = 0;
+  PROFILE_SCOPE(PROFILE_STAGE_IR_READ);
 
-  for (int i = 0; i < IR_SENSOR_COUNT; i++)
+  // Module 1 is sensors 0-7, module 2 is sensors 8-15; a module that does not answer reads as 0,
+  // and so do both when the acquisition has stopped delivering frames
+  HalLineFrame frame = {};
+  if (!halLineSensorsLatest(&frame) || halMicros() - frame.captureTime > IR_FRAME_STALE_TIME)
   {
-    if (sensorValues[i] == 1)
-    {
-      weightedSum += i * 1000;
-      sum += 1;
-    }
+    frame.module1 = 0;
+    frame.module2 = 0;
   }
-
-  // Check if we found the line (sum > 0 means at least one sensor detected it)
-  if (sum > 0)
+  else if (frame.sequence == lastFrameSequence)
   {
-    linePosition = weightedSum / sum; //This gives 0-15000 range now
+    return; // nothing new, the temporal filter counts frames and must not see one twice
   }
+  lastFrameSequence = frame.sequence;
+
+  // Sensors 0-7 in the high byte, 8-15 in the low byte
+  sensorMask = irMaskFromModules(frame.module1, frame.module2, IS_WHITE_LINE);
+  filteredMask = irFilterMask(&maskFilter, sensorMask);
+}
+
+uint16_t getSensorMask()
+{
+  return sensorMask;
+}
 
+uint16_t getFilteredMask()
+{
+  return filteredMask;
+}
+
+int getPosition()
+{
+  // Weighted average for line position from the lookup tables, holds the last position when the line is lost
+  linePosition = irPosition(filteredMask, linePosition);
+
+  return linePosition;
+}
+
+int getLinePosition()
+{
   return linePosition;
 }
 
@@ -101,67 +86,29 @@ int getFilteredPosition() {
         previousValidPosition = rawPosition;
         return rawPosition;
     } else {
-        Serial.print("REJECTED - Change: ");
-        Serial.print(positionChange);
-        Serial.print(" | Valid pattern: ");
-        Serial.println(validPattern);
+        LOG_DEBUG(LOG_TAG_IR, "REJECTED - Change: %d | Valid pattern: %d", positionChange, validPattern);
         return previousValidPosition;
     }
 }
 
 bool isValidLinePattern() {
-    int activeSensors = 0;
-    int firstActive = -1, lastActive = -1;
+    int activeSensors = irActiveCount(filteredMask);
+    int lineWidth = irSpan(filteredMask);
+    bool valid = irIsValidLinePattern(filteredMask);
     
-    for (int i = 0; i < IR_SENSOR_COUNT; i++) {
-        if (sensorValues[i] == 1) {
-            activeSensors++;
-            if (firstActive == -1) firstActive = i;
-            lastActive = i;
-        }
-    }
-    
-    int lineWidth = lastActive - firstActive + 1;
-    
-    // Normal line: 3-7 active sensors, width 3-7
-    // Triangle/marking: 8+ active sensors, width 8+
-    bool normalWidth = (activeSensors >= 2 && activeSensors <= 8);
-    bool normalSpan = (lineWidth >= 2 && lineWidth <= 8);
+    LOG_TRACE(LOG_TAG_IR, "Active sensors: %d | Line width: %d | Valid: %d", activeSensors, lineWidth, valid);
     
-    Serial.print("Active sensors: ");
-    Serial.print(activeSensors);
-    Serial.print(" | Line width: ");
-    Serial.print(lineWidth);
-    Serial.print(" | Valid: ");
-    Serial.println(normalWidth && normalSpan);
-    
-    return normalWidth && normalSpan;
+    return valid;
 }
 
 void printIRDebugInfo()
 {
-  // Print sensor values
-  Serial.print("Sensors: ");
-  for (int i = 0; i < IR_SENSOR_COUNT; i++)
-  {
-    Serial.print(sensorValues[i]);
-    Serial.print(" ");
-  }
-
-  // Print position and error
-  Serial.print(" | Position: ");
-  Serial.print(linePosition);
+  // Sensor mask (sensor 0 is the most significant bit) and position
+  LOG_TRACE(LOG_TAG_IR, "Sensors: %04X | Filtered: %04X | Position: %d", sensorMask, filteredMask, linePosition);
 }
 
 // Helper function to check if on line
 bool isOnLine()
 {
-  for (int i = 0; i < IR_SENSOR_COUNT; i++)
-  {
-    if (sensorValues[i] == 1)
-    {
-      return true;
-    }
-  }
-  return false;
+  return filteredMask != 0;
 }
\ No newline at end of file
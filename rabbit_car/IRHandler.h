@@ -2,14 +2,22 @@
 #ifndef IR_HANDLER_H
 #define IR_HANDLER_H
 
-#include <Wire.h>
-#include <arduino.h>
+#include <Arduino.h>
+#include "Hal.h"
 #include "config.h"
+#include "IRDecode.h"
+#include "Profile.h"
 
 // Function prototypes
 void irSetup();
-void readIRSensorsI2C();
+// Take the newest line sensor frame (halLineSensorsLatest), never waits for the I2C buses
+void readIRSensors();
+// Raw mask of the newest frame, and the same after the temporal filter (irFilterMask) that the line logic uses
+uint16_t getSensorMask();
+uint16_t getFilteredMask();
 int getPosition();
+// Position from the last getPosition() call, without updating it
+int getLinePosition();
 int getFilteredPosition();
 bool isValidLinePattern();
 void resetSteeringPID();
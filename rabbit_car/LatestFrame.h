@@ -0,0 +1,69 @@
+// LatestFrame.h
+// Newest value handoff from one writer to any number of readers: a double buffer where the writer
+// fills the slot that is not the newest and readers copy the newest without waiting for the writer.
+// Used for the line sensor frames (HalESP32.cpp) and the pace plan and course uploads; plain C++ so
+// the host tests can stress it
+#ifndef LATEST_FRAME_H
+#define LATEST_FRAME_H
+
+#include <stdint.h>
+#include <atomic>
+
+// started tells a reader that the slot it copied was being rewritten meanwhile, only possible when the
+// reader was preempted for a whole frame
+template <typename T>
+struct LatestFrame
+{
+  T slots[2];
+  std::atomic<uint32_t> published; // newest value is slots[published & 1], 0 before the first
+  std::atomic<uint32_t> started;
+};
+
+/**
+ * Writer: begin the next value
+ * @param latest Buffer
+ * @param sequence Set to the sequence the value is published as, counts from 1
+ * @return T& The slot to fill in before latestFramePublish()
+ */
+template <typename T>
+inline T &latestFrameBegin(LatestFrame<T> *latest, uint32_t *sequence)
+{
+  *sequence = latest->published.load(std::memory_order_relaxed) + 1;
+  latest->started.store(*sequence, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  return latest->slots[*sequence & 1];
+}
+
+// Writer: make the value filled in since latestFrameBegin() the newest
+template <typename T>
+inline void latestFramePublish(LatestFrame<T> *latest, uint32_t sequence)
+{
+  latest->published.store(sequence, std::memory_order_release);
+}
+
+/**
+ * Reader: copy the newest value, retries only while the writer laps the reader
+ * @param latest Buffer
+ * @param value Filled in when a value exists
+ * @return bool False before the first value
+ */
+template <typename T>
+inline bool latestFrameRead(const LatestFrame<T> &latest, T *value)
+{
+  for (;;)
+  {
+    uint32_t sequence = latest.published.load(std::memory_order_acquire);
+    if (sequence == 0)
+    {
+      return false;
+    }
+    *value = latest.slots[sequence & 1];
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (latest.started.load(std::memory_order_relaxed) - sequence < 2)
+    {
+      return true;
+    }
+  }
+}
+
+#endif
@@ -1,117 +1,216 @@
+// Lights.cpp
 #include "Lights.h"
-
-// Define pin constants (these should be in Lights.h)
-// If not already defined in Lights.h, add them there:
-// #define HEADLIGHT_PIN 6
-// #define LEFT_LIGHT_PIN 7
-// #define RIGHT_LIGHT_PIN 8
+#include "RunControl.h"
+#include <atomic>
 
 const int NUM_LEDS_PER_STRIP = 5;
+const uint8_t LIGHTS_BRIGHTNESS = 100;
 
-// Initialize NeoPixel strip objects (GRB order, 4 LEDs per strip)
-Adafruit_NeoPixel HEAD_LIGHT(NUM_LEDS_PER_STRIP, HEADLIGHT_PIN, NEO_GRB + NEO_KHZ800);
-Adafruit_NeoPixel LEFT_LIGHT(NUM_LEDS_PER_STRIP, LEFT_LIGHT_PIN, NEO_GRB + NEO_KHZ800);
-Adafruit_NeoPixel RIGHT_LIGHT(NUM_LEDS_PER_STRIP, RIGHT_LIGHT_PIN, NEO_GRB + NEO_KHZ800);
+// Effects, see Lights.h
+const uint32_t LIGHTS_STARTUP_STEP_MS = 200;    // per startup color
+const uint32_t LIGHTS_BLINK_PERIOD_MS = 500;    // on for half of it
+const float LIGHTS_TURN_ON_ANGLE = 10.0;        // degrees off center that start a turn signal
+const float LIGHTS_TURN_OFF_ANGLE = 6.0;        // and that stop it, so a straight line does not flicker
+const float LIGHTS_MOVING_SPEED = 0.1;          // m/s, turn signals only while the car moves
+const float LIGHTS_PACE_TOLERANCE = 0.05;       // fraction of the target speed that still counts as on pace
+const float LIGHTS_STEERING_CENTER = 90.0;      // degrees, SERVO_MID_ANGLE; smaller is left
 
-// Array of all light strips
-Adafruit_NeoPixel LIGHTS[] = {
-  HEAD_LIGHT,
-  LEFT_LIGHT,
-  RIGHT_LIGHT
-};
-const int NUM_LIGHTS = sizeof(LIGHTS) / sizeof(LIGHTS[0]);
-
-// Color definitions
-struct Colors {
-  static uint32_t white(Adafruit_NeoPixel &strip) { return strip.Color(255, 255, 255); }
-  static uint32_t red(Adafruit_NeoPixel &strip) { return strip.Color(255, 0, 0); }
-  static uint32_t green(Adafruit_NeoPixel &strip) { return strip.Color(0, 255, 0); }
-  static uint32_t blue(Adafruit_NeoPixel &strip) { return strip.Color(0, 0, 255); }
-  static uint32_t yellow(Adafruit_NeoPixel &strip) { return strip.Color(255, 255, 0); }
-  static uint32_t purple(Adafruit_NeoPixel &strip) { return strip.Color(255, 0, 255); }
-  static uint32_t cyan(Adafruit_NeoPixel &strip) { return strip.Color(0, 255, 255); }
-  static uint32_t off(Adafruit_NeoPixel &strip) { return strip.Color(0, 0, 0); }
+// Pin of each strip, indexed by HalLedStrip
+const int LIGHT_PINS[HAL_LED_STRIP_COUNT] = {HEADLIGHT_PIN, LEFT_LIGHT_PIN, RIGHT_LIGHT_PIN};
+
+// Packed colors, indexed by LightColor
+static constexpr uint32_t PALETTE[LIGHT_COLOR_COUNT] = {
+    halLedColor(0, 0, 0),
+    halLedColor(255, 255, 255),
+    halLedColor(255, 0, 0),
+    halLedColor(0, 255, 0),
+    halLedColor(0, 0, 255),
+    halLedColor(255, 255, 0),
+    halLedColor(255, 0, 255),
+    halLedColor(0, 255, 255),
+    halLedColor(255, 120, 0),
 };
 
-// Get color from string name
-uint32_t getColorFromName(const String &colorName, Adafruit_NeoPixel &strip) {
-  if (colorName.equalsIgnoreCase("white")) return Colors::white(strip);
-  if (colorName.equalsIgnoreCase("red")) return Colors::red(strip);
-  if (colorName.equalsIgnoreCase("green")) return Colors::green(strip);
-  if (colorName.equalsIgnoreCase("blue")) return Colors::blue(strip);
-  if (colorName.equalsIgnoreCase("yellow")) return Colors::yellow(strip);
-  if (colorName.equalsIgnoreCase("purple")) return Colors::purple(strip);
-  if (colorName.equalsIgnoreCase("cyan")) return Colors::cyan(strip);
-  if (colorName.equalsIgnoreCase("off")) return Colors::off(strip);
-  
-  // Default to white if unknown color
-  return Colors::white(strip);
+const LightColor STARTUP_COLORS[] = {LIGHT_WHITE, LIGHT_RED, LIGHT_GREEN, LIGHT_BLUE, LIGHT_YELLOW, LIGHT_PURPLE, LIGHT_CYAN};
+const uint32_t STARTUP_COLOR_COUNT = sizeof(STARTUP_COLORS) / sizeof(STARTUP_COLORS[0]);
+
+// Base colors, written by any task, read by lightsStep()
+static std::atomic<uint8_t> baseColors[HAL_LED_STRIP_COUNT];
+
+// Telemetry task state
+static LightColor shownColors[HAL_LED_STRIP_COUNT]; // what the strip's LEDs show
+static bool dirty[HAL_LED_STRIP_COUNT];              // shownColors changed since the last show()
+static uint32_t startupStart = 0;
+static bool startupDone = false;
+static int8_t turnSide = 0; // -1 left, 1 right, 0 none
+
+LightColor getColorFromName(const String &colorName)
+{
+  const char *const names[LIGHT_COLOR_COUNT] = {"off", "white", "red", "green", "blue", "yellow", "purple", "cyan", "amber"};
+  for (int i = 0; i < LIGHT_COLOR_COUNT; i++)
+  {
+    if (colorName.equalsIgnoreCase(names[i]))
+    {
+      return (LightColor)i;
+    }
+  }
+  return LIGHT_WHITE;
 }
 
-// Get light from string name
-Adafruit_NeoPixel* getLightFromName(const String &lightName) {
-    if (lightName.equalsIgnoreCase("headlight")) return &HEAD_LIGHT;
-    if (lightName.equalsIgnoreCase("leftlight")) return &LEFT_LIGHT;
-    if (lightName.equalsIgnoreCase("rightlight")) return &RIGHT_LIGHT;
-    
-    // Return nullptr if the light name is not recognized
-    return nullptr;
+int getLightFromName(const String &lightName)
+{
+  if (lightName.equalsIgnoreCase("headlight"))
+    return HAL_LED_HEAD;
+  if (lightName.equalsIgnoreCase("leftlight"))
+    return HAL_LED_LEFT;
+  if (lightName.equalsIgnoreCase("rightlight"))
+    return HAL_LED_RIGHT;
+  return -1;
 }
 
-// Initialize all light strips
-void setupLights() {
-  for (int i = 0; i < NUM_LIGHTS; i++) {
-    LIGHTS[i].begin();
-    LIGHTS[i].show(); // Initialize all pixels to 'off'
-    LIGHTS[i].setBrightness(100); // Set brightness to 50%
+void setupLights()
+{
+  for (int i = 0; i < HAL_LED_STRIP_COUNT; i++)
+  {
+    halLedBegin((HalLedStrip)i, LIGHT_PINS[i], NUM_LEDS_PER_STRIP, LIGHTS_BRIGHTNESS); // starts off
+    baseColors[i].store(LIGHT_OFF, std::memory_order_relaxed);
+    shownColors[i] = LIGHT_OFF;
+    dirty[i] = false;
   }
-  cycleLights(200);
+  startupStart = halMillis();
+  startupDone = false;
 }
 
-// Turn all lights off
-void lightsOff() {
-  for (int i = 0; i < NUM_LIGHTS; i++) {
-    LIGHTS[i].clear();
-    LIGHTS[i].show();
+void lightsOff()
+{
+  lightsOn(LIGHT_OFF);
+}
+
+void lightOff(HalLedStrip strip)
+{
+  lightOn(strip, LIGHT_OFF);
+}
+
+void lightsOn(LightColor color)
+{
+  for (int i = 0; i < HAL_LED_STRIP_COUNT; i++)
+  {
+    lightOn((HalLedStrip)i, color);
   }
 }
 
-// Turn off a specific light strip
-void lightOff(Adafruit_NeoPixel &strip) {
-  strip.clear();
-  strip.show();
+void lightOn(HalLedStrip strip, LightColor color)
+{
+  baseColors[strip].store(color, std::memory_order_relaxed);
+}
+
+static void setColor(HalLedStrip strip, LightColor color)
+{
+  if (shownColors[strip] != color)
+  {
+    shownColors[strip] = color;
+    dirty[strip] = true;
+  }
 }
 
-// Set all lights to a specific color
-void lightsOn(const String &color) {
-  for (int i = 0; i < NUM_LIGHTS; i++) {
-    uint32_t pixelColor = getColorFromName(color, LIGHTS[i]);
-    for (int j = 0; j < NUM_LEDS_PER_STRIP; j++) {
-      LIGHTS[i].setPixelColor(j, pixelColor);
+// Only the strips whose color changed; a show() holds the core for about 30 us per LED
+static void showDirty()
+{
+  for (int i = 0; i < HAL_LED_STRIP_COUNT; i++)
+  {
+    if (!dirty[i])
+    {
+      continue;
     }
-    LIGHTS[i].show();
+    for (int j = 0; j < NUM_LEDS_PER_STRIP; j++)
+    {
+      halLedSetPixel((HalLedStrip)i, j, PALETTE[shownColors[i]]);
+    }
+    halLedShow((HalLedStrip)i);
+    dirty[i] = false;
   }
 }
 
-// Set a specific light strip to a color
-void lightOn(Adafruit_NeoPixel &strip, const String &color) {
-  uint32_t pixelColor = getColorFromName(color, strip);
-  for (int j = 0; j < NUM_LEDS_PER_STRIP; j++) {
-    strip.setPixelColor(j, pixelColor);
+static LightColor paceColor(float speed, float target)
+{
+  if (target <= 0)
+  {
+    return LIGHT_GREEN;
+  }
+  if (speed < target * (1.0f - LIGHTS_PACE_TOLERANCE))
+  {
+    return LIGHT_RED;
+  }
+  if (speed > target * (1.0f + LIGHTS_PACE_TOLERANCE))
+  {
+    return LIGHT_BLUE;
+  }
+  return LIGHT_GREEN;
+}
+
+static void updateTurnSide(float steeringAngle, bool moving)
+{
+  float offset = steeringAngle - LIGHTS_STEERING_CENTER;
+  if (!moving || fabsf(offset) < LIGHTS_TURN_OFF_ANGLE)
+  {
+    turnSide = 0;
+  }
+  else if (fabsf(offset) >= LIGHTS_TURN_ON_ANGLE)
+  {
+    turnSide = offset < 0 ? -1 : 1;
+  }
+  else if ((offset < 0) != (turnSide < 0))
+  {
+    turnSide = 0; // between the thresholds a signal only holds on its own side
   }
-  strip.show();
 }
 
-// Cycle colors on all lights
-void cycleLights(int delayMs) {
-  // Array of colors to cycle through
-  String colors[] = {"white", "red", "green", "blue", "yellow", "purple", "cyan"};
-  const int numColors = sizeof(colors) / sizeof(colors[0]);
-  
-  for (int colorIndex = 0; colorIndex < numColors; colorIndex++) {
-    lightsOn(colors[colorIndex]);
-    delay(delayMs);
+void lightsStep(const TelemetrySnapshot &snapshot)
+{
+  uint32_t now = halMillis();
+  LightColor colors[HAL_LED_STRIP_COUNT];
+
+  if (!startupDone)
+  {
+    uint32_t step = (now - startupStart) / LIGHTS_STARTUP_STEP_MS;
+    startupDone = step >= STARTUP_COLOR_COUNT;
+    for (int i = 0; i < HAL_LED_STRIP_COUNT; i++)
+    {
+      colors[i] = startupDone ? (LightColor)baseColors[i].load(std::memory_order_relaxed) : STARTUP_COLORS[step];
+    }
+  }
+  else
+  {
+    for (int i = 0; i < HAL_LED_STRIP_COUNT; i++)
+    {
+      colors[i] = (LightColor)baseColors[i].load(std::memory_order_relaxed);
+    }
+
+    bool blinkOn = now % LIGHTS_BLINK_PERIOD_MS < LIGHTS_BLINK_PERIOD_MS / 2;
+    if (snapshot.runState == RUN_STATE_CALIBRATING)
+    {
+      for (int i = 0; i < HAL_LED_STRIP_COUNT; i++)
+      {
+        colors[i] = blinkOn ? LIGHT_YELLOW : LIGHT_OFF;
+      }
+    }
+    else
+    {
+      if (snapshot.runState == RUN_STATE_RUNNING)
+      {
+        colors[HAL_LED_HEAD] = paceColor(snapshot.sample.speed, snapshot.targetSpeed);
+      }
+      updateTurnSide(snapshot.sample.steeringAngle, snapshot.sample.speed >= LIGHTS_MOVING_SPEED);
+      if (turnSide != 0)
+      {
+        colors[turnSide < 0 ? HAL_LED_LEFT : HAL_LED_RIGHT] = blinkOn ? LIGHT_AMBER : LIGHT_OFF;
+      }
+    }
+  }
+
+  for (int i = 0; i < HAL_LED_STRIP_COUNT; i++)
+  {
+    setColor((HalLedStrip)i, colors[i]);
   }
-  
-  lightsOff();
-}
\ No newline at end of file
+  showDirty();
+}
@@ -1,31 +1,55 @@
-// IRHandler.h
+// Lights.h
+// Head and side light strips. Commands only set a base color per strip; lightsStep() (telemetry task)
+// works out every strip's color for the frame from the base colors and the run's effects, and writes a
+// strip to the LEDs only when its color changed, so neither the BLE task nor the control task ever
+// waits on a strip.
+//
+// Effects, over the base colors:
+//   startup       the palette cycles for LIGHTS_STARTUP_MS after setupLights()
+//   calibrating   all strips blink yellow
+//   running       the head light shows the pace status: green on the target speed, red behind, blue ahead
+//   moving        the side strip on the steering side blinks amber as a turn signal
 #ifndef LIGHTS_H
 #define LIGHTS_H
 
-#include <Adafruit_NeoPixel.h>
+#include <Arduino.h>
+#include "Hal.h"
 #include "config.h"
-
-// Get color from string name
-uint32_t getColorFromName(const String &colorName, Adafruit_NeoPixel &strip);
-
-Adafruit_NeoPixel *getLightFromName(const String &lightName);
-
-// Initialize all light strips
+#include "Telemetry.h"
+
+enum LightColor : uint8_t
+{
+  LIGHT_OFF = 0,
+  LIGHT_WHITE,
+  LIGHT_RED,
+  LIGHT_GREEN,
+  LIGHT_BLUE,
+  LIGHT_YELLOW,
+  LIGHT_PURPLE,
+  LIGHT_CYAN,
+  LIGHT_AMBER,
+  LIGHT_COLOR_COUNT,
+};
+
+// Get color from string name, white if the name is not recognized
+LightColor getColorFromName(const String &colorName);
+
+// Get light from string name, -1 if the name is not recognized
+int getLightFromName(const String &lightName);
+
+// Initialize all light strips and start the startup cycle, returns at once
 void setupLights();
 
-// Turn all lights off
+// Base colors, any task; shown from the next lightsStep()
 void lightsOff();
+void lightOff(HalLedStrip strip);
+void lightsOn(LightColor color = LIGHT_WHITE);
+void lightOn(HalLedStrip strip, LightColor color = LIGHT_WHITE);
 
-// Turn off a specific light strip
-void lightOff(Adafruit_NeoPixel &strip);
-
-// Set all lights to a specific color
-void lightsOn(const String &color = "white");
-
-// Set a specific light strip to a color
-void lightOn(Adafruit_NeoPixel &strip, const String &color = "white");
-
-// Cycle colors on all lights
-void cycleLights(int delayMs = 500);
+/**
+ * Telemetry task, every period: advance the effects and write the strips whose color changed
+ * @param snapshot The control task's latest state (run state, speed, target speed, steering angle)
+ */
+void lightsStep(const TelemetrySnapshot &snapshot);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,206 @@
+// Log.cpp
+#include "Log.h"
+#include <atomic>
+
+static_assert((LOG_BUFFER_SIZE & (LOG_BUFFER_SIZE - 1)) == 0, "LOG_BUFFER_SIZE must be a power of two");
+
+const char *const LOG_TAG_NAMES[LOG_TAG_COUNT] = {"SYS", "RUN", "IR", "SERVO", "ESC", "HS", "BLE", "LIGHTS"};
+const char LOG_LEVEL_LETTERS[] = "-EWIDT";
+
+uint8_t logLevels[LOG_TAG_COUNT];
+
+// Bounded multi-producer queue (Vyukov): each cell carries a sequence number that tells
+// producers and the consumer whose turn it is, so writers on both cores never take a lock
+struct LogCell
+{
+  std::atomic<uint32_t> sequence;
+  LogRecord record;
+};
+
+static LogCell logCells[LOG_BUFFER_SIZE];
+static std::atomic<uint32_t> enqueuePos(0);
+static std::atomic<uint32_t> dequeuePos(0);
+static std::atomic<uint32_t> writtenCount(0);
+static std::atomic<uint32_t> droppedCount(0);
+
+void logSetup()
+{
+  for (uint32_t i = 0; i < LOG_BUFFER_SIZE; i++)
+  {
+    logCells[i].sequence.store(i, std::memory_order_relaxed);
+  }
+  logSetLevelAll((LogLevel)LOG_DEFAULT_LEVEL);
+}
+
+void logSetLevel(LogTag tag, LogLevel level)
+{
+  if (tag < LOG_TAG_COUNT)
+  {
+    logLevels[tag] = level;
+  }
+}
+
+void logSetLevelAll(LogLevel level)
+{
+  for (int i = 0; i < LOG_TAG_COUNT; i++)
+  {
+    logLevels[i] = level;
+  }
+}
+
+bool logWrite(const LogRecord &record)
+{
+  uint32_t pos = enqueuePos.load(std::memory_order_relaxed);
+  LogCell *cell;
+  for (;;)
+  {
+    cell = &logCells[pos & (LOG_BUFFER_SIZE - 1)];
+    uint32_t sequence = cell->sequence.load(std::memory_order_acquire);
+    int32_t diff = (int32_t)(sequence - pos);
+    if (diff == 0)
+    {
+      if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+      {
+        break;
+      }
+    }
+    else if (diff < 0)
+    {
+      // Buffer full, never block the caller
+      droppedCount.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    else
+    {
+      pos = enqueuePos.load(std::memory_order_relaxed);
+    }
+  }
+
+  cell->record = record;
+  cell->sequence.store(pos + 1, std::memory_order_release);
+  writtenCount.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+// Single consumer, only called from logDrain()
+static bool logRead(LogRecord *record)
+{
+  uint32_t pos = dequeuePos.load(std::memory_order_relaxed);
+  LogCell *cell = &logCells[pos & (LOG_BUFFER_SIZE - 1)];
+  uint32_t sequence = cell->sequence.load(std::memory_order_acquire);
+  if ((int32_t)(sequence - (pos + 1)) < 0)
+  {
+    return false; // empty
+  }
+
+  *record = cell->record;
+  cell->sequence.store(pos + LOG_BUFFER_SIZE, std::memory_order_release);
+  dequeuePos.store(pos + 1, std::memory_order_relaxed);
+  return true;
+}
+
+// printf style formatting from the stored arguments; each conversion is formatted on its own
+// with the argument cast to what the conversion expects
+static size_t formatRecord(const LogRecord &record, char *out, size_t size)
+{
+  int length = snprintf(out, size, "[%lu.%03lu][%c][%s] ",
+                        (unsigned long)(record.timestamp / 1000), (unsigned long)(record.timestamp % 1000),
+                        LOG_LEVEL_LETTERS[record.level < sizeof(LOG_LEVEL_LETTERS) - 1 ? record.level : 0],
+                        record.tag < LOG_TAG_COUNT ? LOG_TAG_NAMES[record.tag] : "?");
+  size_t used = length > 0 ? min((size_t)length, size - 1) : 0;
+
+  int argIndex = 0;
+  const char *p = record.format;
+  while (*p && used < size - 1)
+  {
+    if (*p != '%')
+    {
+      out[used++] = *p++;
+      continue;
+    }
+    if (p[1] == '%')
+    {
+      out[used++] = '%';
+      p += 2;
+      continue;
+    }
+
+    // Copy one conversion specification, e.g. "%-6.2f"
+    char spec[16];
+    size_t specLength = 0;
+    const char *start = p++;
+    while (*p && !strchr("diuxXcfeEgGs", *p))
+    {
+      p++;
+    }
+    if (!*p)
+    {
+      break;
+    }
+    specLength = min((size_t)(p - start + 1), sizeof(spec) - 1);
+    memcpy(spec, start, specLength);
+    spec[specLength] = '\0';
+    char conversion = *p++;
+
+    int written = 0;
+    if (argIndex >= record.argCount)
+    {
+      written = snprintf(out + used, size - used, "<?>");
+    }
+    else
+    {
+      const LogArg &arg = record.args[argIndex++];
+      double asFloat = arg.type == LOG_ARG_FLOAT ? arg.f : arg.type == LOG_ARG_UINT ? (double)arg.u : (double)arg.i;
+      int32_t asInt = arg.type == LOG_ARG_FLOAT ? (int32_t)arg.f : arg.i;
+
+      switch (conversion)
+      {
+      case 'f':
+      case 'e':
+      case 'E':
+      case 'g':
+      case 'G':
+        written = snprintf(out + used, size - used, spec, asFloat);
+        break;
+      case 's':
+        written = snprintf(out + used, size - used, spec, arg.type == LOG_ARG_STR && arg.s ? arg.s : "<?>");
+        break;
+      default:
+        written = snprintf(out + used, size - used, spec, (int)asInt);
+        break;
+      }
+    }
+    if (written > 0)
+    {
+      used = min(used + written, size - 1);
+    }
+  }
+
+  out[used] = '\0';
+  return used;
+}
+
+int logDrain(int maxRecords)
+{
+  const size_t LINE_SIZE = 160;
+  char line[LINE_SIZE];
+  LogRecord record;
+  int printed = 0;
+
+  while (printed < maxRecords && Serial.availableForWrite() >= (int)LINE_SIZE && logRead(&record))
+  {
+    size_t length = formatRecord(record, line, LINE_SIZE);
+    Serial.write((const uint8_t *)line, length);
+    Serial.println();
+    printed++;
+  }
+
+  return printed;
+}
+
+void logGetStats(LogStats *stats)
+{
+  stats->written = writtenCount.load(std::memory_order_relaxed);
+  stats->dropped = droppedCount.load(std::memory_order_relaxed);
+  stats->pending = enqueuePos.load(std::memory_order_relaxed) - dequeuePos.load(std::memory_order_relaxed);
+}
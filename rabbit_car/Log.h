@@ -0,0 +1,163 @@
+// Log.h
+// Deferred logging: the hot path only copies the format pointer and raw arguments into a
+// lock-free ring buffer, logDrain() formats and prints them later from the telemetry task
+#ifndef LOG_H
+#define LOG_H
+
+#include <Arduino.h>
+#include "Hal.h"
+
+enum LogLevel : uint8_t
+{
+  LOG_LEVEL_NONE = 0,
+  LOG_LEVEL_ERROR,
+  LOG_LEVEL_WARN,
+  LOG_LEVEL_INFO,
+  LOG_LEVEL_DEBUG,
+  LOG_LEVEL_TRACE,
+};
+
+// Module tags, each with its own runtime level
+enum LogTag : uint8_t
+{
+  LOG_TAG_SYS = 0,
+  LOG_TAG_RUN,
+  LOG_TAG_IR,
+  LOG_TAG_SERVO,
+  LOG_TAG_ESC,
+  LOG_TAG_HS,
+  LOG_TAG_BLE,
+  LOG_TAG_LIGHTS,
+  LOG_TAG_COUNT,
+};
+
+// Records above this level are compiled out entirely
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+// Runtime level every tag starts at
+#ifndef LOG_DEFAULT_LEVEL
+#define LOG_DEFAULT_LEVEL LOG_LEVEL_INFO
+#endif
+
+const int LOG_MAX_ARGS = 4;
+const uint32_t LOG_BUFFER_SIZE = 128; // records, must be a power of two
+
+enum LogArgType : uint8_t
+{
+  LOG_ARG_INT,
+  LOG_ARG_UINT,
+  LOG_ARG_FLOAT,
+  LOG_ARG_STR, // pointer is stored, so only string literals / static strings may be logged
+};
+
+struct LogArg
+{
+  uint8_t type;
+  union
+  {
+    int32_t i;
+    uint32_t u;
+    float f;
+    const char *s;
+  };
+};
+
+struct LogRecord
+{
+  uint32_t timestamp; // halMillis()
+  const char *format; // must point to a string literal
+  uint8_t level;
+  uint8_t tag;
+  uint8_t argCount;
+  LogArg args[LOG_MAX_ARGS];
+};
+
+struct LogStats
+{
+  uint32_t written; // records accepted into the buffer
+  uint32_t dropped; // records lost because the buffer was full
+  uint32_t pending; // records waiting to be printed
+};
+
+extern uint8_t logLevels[LOG_TAG_COUNT];
+
+void logSetup();
+void logSetLevel(LogTag tag, LogLevel level);
+void logSetLevelAll(LogLevel level);
+bool logWrite(const LogRecord &record);
+// Format and print up to maxRecords buffered records, stops early if Serial would block
+int logDrain(int maxRecords);
+void logGetStats(LogStats *stats);
+
+inline bool logEnabled(LogLevel level, LogTag tag)
+{
+  return level <= logLevels[tag];
+}
+
+inline LogArg logArg(int value)
+{
+  LogArg arg;
+  arg.type = LOG_ARG_INT;
+  arg.i = value;
+  return arg;
+}
+inline LogArg logArg(long value) { return logArg((int)value); }
+inline LogArg logArg(bool value) { return logArg((int)value); }
+inline LogArg logArg(unsigned int value)
+{
+  LogArg arg;
+  arg.type = LOG_ARG_UINT;
+  arg.u = value;
+  return arg;
+}
+inline LogArg logArg(unsigned long value) { return logArg((unsigned int)value); }
+inline LogArg logArg(float value)
+{
+  LogArg arg;
+  arg.type = LOG_ARG_FLOAT;
+  arg.f = value;
+  return arg;
+}
+inline LogArg logArg(double value) { return logArg((float)value); }
+inline LogArg logArg(const char *value)
+{
+  LogArg arg;
+  arg.type = LOG_ARG_STR;
+  arg.s = value;
+  return arg;
+}
+
+template <typename... Args>
+inline void logRecord(LogLevel level, LogTag tag, const char *format, Args... args)
+{
+  static_assert(sizeof...(Args) <= LOG_MAX_ARGS, "too many log arguments");
+  LogRecord record;
+  record.timestamp = halMillis();
+  record.format = format;
+  record.level = level;
+  record.tag = tag;
+  record.argCount = sizeof...(Args);
+  int i = 0;
+  ((record.args[i++] = logArg(args)), ...);
+  (void)i;
+  logWrite(record);
+}
+
+#define LOG_AT(level, tag, ...)                                     \
+  do                                                                \
+  {                                                                 \
+    if ((level) <= LOG_COMPILE_LEVEL && logEnabled((level), (tag))) \
+    {                                                               \
+      logRecord((level), (tag), __VA_ARGS__);                       \
+    }                                                               \
+  } while (0)
+
+#define LOG_ERROR(tag, ...) LOG_AT(LOG_LEVEL_ERROR, tag, __VA_ARGS__)
+#define LOG_WARN(tag, ...) LOG_AT(LOG_LEVEL_WARN, tag, __VA_ARGS__)
+#define LOG_INFO(tag, ...) LOG_AT(LOG_LEVEL_INFO, tag, __VA_ARGS__)
+#define LOG_DEBUG(tag, ...) LOG_AT(LOG_LEVEL_DEBUG, tag, __VA_ARGS__)
+#define LOG_TRACE(tag, ...) LOG_AT(LOG_LEVEL_TRACE, tag, __VA_ARGS__)
+
+#endif
@@ -0,0 +1,126 @@
+// PacePlan.cpp
+#include "PacePlan.h"
+#include "Telemetry.h"
+#include "LatestFrame.h"
+
+// Double buffered: uploads (BLE task) fill the slot that is not published, pacePlanStart()
+// (control task) copies the published one, so a plan never changes under a running car. The copy is
+// retried if two uploads land meanwhile and the second one rewrites the slot being copied
+static LatestFrame<PacePlan> loadedPlans;
+
+// Plan of the current run and the position in it, control task only
+static PacePlan activePlan;
+static uint8_t segmentIndex = 0;
+static float segmentStartTime = 0.0;     // s since the run start
+static float segmentStartDistance = 0.0; // m since the run start
+
+bool pacePlanLoad(const uint8_t *data, uint8_t count)
+{
+  if (count == 0 || count > PACE_PLAN_MAX_SEGMENTS)
+  {
+    LOG_WARN(LOG_TAG_RUN, "Pace plan rejected: %d segments", count);
+    return false;
+  }
+
+  uint32_t sequence;
+  PacePlan *plan = &latestFrameBegin(&loadedPlans, &sequence); // left unpublished if rejected
+  for (uint8_t i = 0; i < count; i++)
+  {
+    const uint8_t *field = data + i * PLAN_SEGMENT_SIZE;
+    float length = getF32LE(field + 1);
+    float startSpeed = getF32LE(field + 5);
+    float endSpeed = getF32LE(field + 9);
+
+    // Same speed limits as RACE mode; written so that NaN fails too
+    if (!(length > 0.0f) || !(startSpeed >= 0.0f && startSpeed <= 15.0f) || !(endSpeed >= 0.0f && endSpeed <= 15.0f))
+    {
+      LOG_WARN(LOG_TAG_RUN, "Pace plan rejected: bad segment %d", i);
+      return false;
+    }
+
+    PacePlanSegment *segment = &plan->segments[i];
+    segment->byTime = field[0] & PLAN_SEGMENT_TIME;
+    segment->length = length;
+    segment->startSpeed = startSpeed;
+    segment->slope = (endSpeed - startSpeed) / length;
+  }
+  plan->count = count;
+
+  latestFramePublish(&loadedPlans, sequence);
+  LOG_INFO(LOG_TAG_RUN, "Pace plan loaded: %d segments", count);
+  return true;
+}
+
+void pacePlanStart()
+{
+  if (!latestFrameRead(loadedPlans, &activePlan))
+  {
+    activePlan.count = 0; // nothing uploaded yet
+  }
+  segmentIndex = 0;
+  segmentStartTime = 0.0;
+  segmentStartDistance = 0.0;
+}
+
+// Progress into the current segment, in the segment's own unit
+static float segmentProgress(const PacePlanSegment &segment, float elapsedTime)
+{
+  return segment.byTime ? elapsedTime - segmentStartTime : totalDistance - segmentStartDistance;
+}
+
+// Move past every segment that is complete; a boundary is placed where the segment ended in its
+// own unit, so rounding to control periods does not accumulate over the plan
+static void advancePlan()
+{
+  float elapsedTime = micros_to_s(currentRunDuration);
+  while (segmentIndex < activePlan.count)
+  {
+    const PacePlanSegment &segment = activePlan.segments[segmentIndex];
+    if (segmentProgress(segment, elapsedTime) < segment.length)
+    {
+      return;
+    }
+
+    if (segment.byTime)
+    {
+      segmentStartTime += segment.length;
+      segmentStartDistance = totalDistance;
+    }
+    else
+    {
+      segmentStartDistance += segment.length;
+      segmentStartTime = elapsedTime;
+    }
+    segmentIndex++;
+    LOG_DEBUG(LOG_TAG_RUN, "Pace plan segment %d at %.2fs, %.2fm", segmentIndex, elapsedTime, totalDistance);
+  }
+}
+
+float pacePlanTargetSpeed()
+{
+  advancePlan();
+  if (segmentIndex >= activePlan.count)
+  {
+    return 0.0;
+  }
+
+  const PacePlanSegment &segment = activePlan.segments[segmentIndex];
+  return segment.startSpeed + segment.slope * segmentProgress(segment, micros_to_s(currentRunDuration));
+}
+
+bool pacePlanEnded()
+{
+  advancePlan();
+  return segmentIndex >= activePlan.count;
+}
+
+void pacePlanSummary(const RunResult &run)
+{
+  LOG_INFO(LOG_TAG_RUN, "Plan: %d of %d segments completed", run.segmentsDone, run.segmentCount);
+}
+
+void pacePlanProgress(uint8_t *done, uint8_t *count)
+{
+  *done = segmentIndex;
+  *count = activePlan.count;
+}
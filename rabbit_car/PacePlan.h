@@ -0,0 +1,54 @@
+// PacePlan.h
+// Uploaded pace plans for RUN_MODE_PLAN: a list of segments, each lasting a distance or a time and
+// holding a constant target speed or ramping between two. Slopes are computed once when the plan is
+// loaded, so the per tick target is one multiply-add.
+#ifndef PACE_PLAN_H
+#define PACE_PLAN_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "PaceStrategy.h"
+
+const uint8_t PACE_PLAN_MAX_SEGMENTS = 32;
+
+// Wire format of one segment in CMD_PLAN (see Commands.h), little-endian
+//
+//  offset  size  field
+//  0       1     flags (PLAN_SEGMENT_*)
+//  1       4     length, f32, meters or seconds
+//  5       4     target speed at the start of the segment, f32, m/s
+//  9       4     target speed at the end of the segment, f32, m/s
+const size_t PLAN_SEGMENT_SIZE = 13;
+
+const uint8_t PLAN_SEGMENT_TIME = 0x01; // length is in seconds, otherwise meters
+
+struct PacePlanSegment
+{
+  bool byTime;      // length in seconds instead of meters
+  float length;     // m or s
+  float startSpeed; // m/s
+  float slope;      // m/s per m or per s of the segment
+};
+
+struct PacePlan
+{
+  uint8_t count;
+  PacePlanSegment segments[PACE_PLAN_MAX_SEGMENTS];
+};
+
+/**
+ * Validate and load a plan in CMD_PLAN wire format, it is used from the next run start
+ * @param data count segments of PLAN_SEGMENT_SIZE bytes
+ * @return bool False if the plan is empty, too long or has a bad segment; the previous plan is kept
+ */
+bool pacePlanLoad(const uint8_t *data, uint8_t count);
+
+// RUN_MODE_PLAN strategy hooks, see PaceStrategy.h
+void pacePlanStart();
+float pacePlanTargetSpeed();
+bool pacePlanEnded();
+void pacePlanSummary(const RunResult &run);
+// Segments completed in the current or last run and the plan's segment count, control task
+void pacePlanProgress(uint8_t *done, uint8_t *count);
+
+#endif
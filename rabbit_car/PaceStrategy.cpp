@@ -0,0 +1,126 @@
+// PaceStrategy.cpp
+#include "PaceStrategy.h"
+#include "PacePlan.h"
+
+// RACE, TEMPO and DISTANCE_PACE keep no state of their own
+static void noStart()
+{
+}
+
+// RACE mode: Adjust pace dynamically to finish distance in target time
+static bool checkRaceEndCondition()
+{
+  // End when we've reached the target distance
+  return (totalDistance >= targetDistance);
+}
+
+static float calculateRacePace()
+{
+  float elapsedTime = micros_to_s(currentRunDuration);
+  float remainingDistance = targetDistance - totalDistance;
+  float remainingTime = targetTime - elapsedTime;
+
+  // Prevent division by zero and negative time
+  if (remainingTime <= 0.1) // 0.1 second buffer
+  {
+    return 0.0; // Stop if we're out of time
+  }
+
+  // Calculate required pace to finish on time
+  float requiredPace = remainingDistance / remainingTime;
+
+  // Clamp to reasonable limits (adjust these based on your car's capabilities)
+  requiredPace = constrain(requiredPace, 0.5, 15.0);
+
+  LOG_DEBUG(LOG_TAG_RUN, "Race Mode - Remaining: %.2fm in %.2fs, Required pace: %.2fm/s",
+            remainingDistance, remainingTime, requiredPace);
+
+  return requiredPace;
+}
+
+static void raceSummary(const RunResult &run)
+{
+  LOG_INFO(LOG_TAG_RUN, "Target: %.2fm in %.2fs, distance error %.2fm, time error %.2fs", run.targetDistance,
+           run.targetTime, run.targetDistance - run.distance, run.targetTime - run.time);
+}
+
+// param1 = distance, param2 = time
+static void raceConfigure(float param1, float param2)
+{
+  targetDistance = param1;
+  targetTime = param2;
+  LOG_INFO(LOG_TAG_RUN, "RACE Mode: %.2fm in %.2fs", targetDistance, targetTime);
+}
+
+// TEMPO and DISTANCE_PACE hold the user entered speed
+static float constantPace()
+{
+  return targetSpeed;
+}
+
+// TEMPO mode: Maintain constant speed for set time
+static bool checkTempoEndCondition()
+{
+  float elapsedTime = micros_to_s(currentRunDuration);
+  return elapsedTime >= targetTime;
+}
+
+static void tempoSummary(const RunResult &run)
+{
+  LOG_INFO(LOG_TAG_RUN, "Target: %.2fm/s for %.2fs, speed error %.2fm/s", run.targetSpeed, run.targetTime,
+           run.targetSpeed - run.pace);
+}
+
+// param1 = speed, param2 = time
+static void tempoConfigure(float param1, float param2)
+{
+  targetSpeed = param1;
+  targetTime = param2;
+  LOG_INFO(LOG_TAG_RUN, "TEMPO Mode: %.2fm/s for %.2fs", targetSpeed, targetTime);
+}
+
+// DISTANCE_PACE mode: Maintain constant speed until distance is reached
+static bool checkDistancePaceEndCondition()
+{
+  return totalDistance >= targetDistance;
+}
+
+static void distancePaceSummary(const RunResult &run)
+{
+  LOG_INFO(LOG_TAG_RUN, "Target: %.2fm at %.2fm/s, distance error %.2fm, speed error %.2fm/s", run.targetDistance,
+           run.targetSpeed, run.targetDistance - run.distance, run.targetSpeed - run.pace);
+}
+
+// param1 = speed, param2 = distance
+static void distancePaceConfigure(float param1, float param2)
+{
+  targetSpeed = param1;
+  targetDistance = param2;
+  LOG_INFO(LOG_TAG_RUN, "DISTANCE_PACE Mode: %.2fm/s for %.2fm", targetSpeed, targetDistance);
+}
+
+// PLAN mode: the segments come from CMD_PLAN, the run parameters are not used
+static void planConfigure(float param1, float param2)
+{
+  LOG_INFO(LOG_TAG_RUN, "PLAN Mode");
+}
+
+const PaceStrategy PACE_STRATEGIES[RUN_MODE_COUNT] = {
+    {"RACE", noStart, calculateRacePace, checkRaceEndCondition, raceSummary, raceConfigure},
+    {"TEMPO", noStart, constantPace, checkTempoEndCondition, tempoSummary, tempoConfigure},
+    {"DISTANCE_PACE", noStart, constantPace, checkDistancePaceEndCondition, distancePaceSummary, distancePaceConfigure},
+    {"PLAN", pacePlanStart, pacePlanTargetSpeed, pacePlanEnded, pacePlanSummary, planConfigure},
+};
+
+RunMode MODE = RUN_MODE_RACE;
+const PaceStrategy *paceStrategy = &PACE_STRATEGIES[RUN_MODE_RACE];
+
+void setRunMode(RunMode mode)
+{
+  if (mode >= RUN_MODE_COUNT)
+  {
+    return;
+  }
+  MODE = mode;
+  paceStrategy = &PACE_STRATEGIES[mode];
+}
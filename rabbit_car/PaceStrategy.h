@@ -0,0 +1,58 @@
+// PaceStrategy.h
+// Pacing modes: each RunMode has an entry in PACE_STRATEGIES, selected once with setRunMode()
+// when a run is configured, so the control loop never looks at the mode itself
+#ifndef PACE_STRATEGY_H
+#define PACE_STRATEGY_H
+
+#include <Arduino.h>
+#include "config.h"
+
+enum RunMode : uint8_t
+{
+  RUN_MODE_RACE = 0,      // Time + Distance -> vary speed to hit the exact finish time
+  RUN_MODE_TEMPO,         // Speed + Time -> constant speed for a set time
+  RUN_MODE_DISTANCE_PACE, // Speed + Distance -> constant speed until the distance is complete
+  RUN_MODE_PLAN,          // Uploaded segment plan (PacePlan.h): intervals, splits, progressions
+  RUN_MODE_COUNT,
+};
+
+// A finished run as the control task saw it at the run end, published in the telemetry snapshot so the
+// summary never reads the control task's globals
+struct RunResult
+{
+  RunMode mode;
+  float distance;       // m
+  float time;           // s
+  float pace;           // m/s, average speed
+  float targetDistance; // m, the mode's targets
+  float targetTime;     // s
+  float targetSpeed;    // m/s
+  uint8_t segmentsDone; // PLAN: segments completed out of segmentCount
+  uint8_t segmentCount;
+};
+
+struct PaceStrategy
+{
+  const char *name; // protocol/UI name, e.g. "RACE"
+  // Called whenever the run timer restarts, i.e. at every run start
+  void (*start)();
+  // Target speed in m/s, read whenever the speed PID runs
+  float (*targetSpeed)();
+  // True once the run is complete
+  bool (*shouldEnd)();
+  // Mode specific lines of the run summary, telemetry task
+  void (*summary)(const RunResult &run);
+  // Set the mode's targets from the two generic parameters of updateModeParameters()
+  void (*configure)(float param1, float param2);
+};
+
+// Indexed by RunMode
+extern const PaceStrategy PACE_STRATEGIES[RUN_MODE_COUNT];
+
+// Currently selected mode and its strategy
+extern RunMode MODE;
+extern const PaceStrategy *paceStrategy;
+
+void setRunMode(RunMode mode);
+
+#endif
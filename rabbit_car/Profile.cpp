@@ -0,0 +1,135 @@
+// Profile.cpp
+#include "Profile.h"
+#include "config.h"
+
+const char *const PROFILE_STAGE_NAMES[PROFILE_STAGE_COUNT] = {"controlStep", "irRead", "steerPID", "hsUpdate", "speedPID", "broadcast"};
+
+// Overrun threshold of each stage, the period of the task it runs in
+const uint32_t CONTROL_PERIOD_US = 1000000 / CONTROL_LOOP_HZ;
+const uint32_t TELEMETRY_PERIOD_US = 1000000 / TELEMETRY_TASK_HZ;
+const uint32_t PROFILE_BUDGET_US[PROFILE_STAGE_COUNT] = {
+    CONTROL_PERIOD_US, CONTROL_PERIOD_US, CONTROL_PERIOD_US, CONTROL_PERIOD_US, CONTROL_PERIOD_US, TELEMETRY_PERIOD_US};
+
+struct ProfileHistogram
+{
+  volatile bool resetPending;
+  uint32_t count;
+  uint32_t min;
+  uint32_t max;
+  uint32_t overruns;
+  uint32_t buckets[PROFILE_BUCKET_COUNT];
+};
+
+static ProfileHistogram histograms[PROFILE_STAGE_COUNT];
+static uint32_t cyclesPerMicro = 1;
+
+static void clearHistogram(ProfileHistogram &h)
+{
+  memset(h.buckets, 0, sizeof(h.buckets));
+  h.count = 0;
+  h.min = UINT32_MAX;
+  h.max = 0;
+  h.overruns = 0;
+  h.resetPending = false;
+}
+
+static int bucketIndex(uint32_t us)
+{
+  if (us < 8)
+  {
+    return us;
+  }
+  int msb = 31 - __builtin_clz(us);
+  int index = 8 + (msb - 3) * 4 + ((us >> (msb - 2)) & 3);
+  return index < PROFILE_BUCKET_COUNT ? index : PROFILE_BUCKET_COUNT - 1;
+}
+
+// Largest value that falls into a bucket
+static uint32_t bucketUpperBound(int index)
+{
+  if (index < 8)
+  {
+    return index;
+  }
+  int msb = 3 + (index - 8) / 4;
+  uint32_t width = 1u << (msb - 2);
+  return (4 + (index - 8) % 4) * width + width - 1;
+}
+
+void profileSetup()
+{
+  cyclesPerMicro = halCyclesPerMicro();
+  if (cyclesPerMicro == 0)
+  {
+    cyclesPerMicro = 1;
+  }
+  for (int i = 0; i < PROFILE_STAGE_COUNT; i++)
+  {
+    clearHistogram(histograms[i]);
+  }
+}
+
+void IRAM_ATTR profileRecord(ProfileStage stage, uint32_t cycles)
+{
+  ProfileHistogram &h = histograms[stage];
+  if (h.resetPending)
+  {
+    clearHistogram(h);
+  }
+
+  uint32_t us = cycles / cyclesPerMicro;
+  h.buckets[bucketIndex(us)]++;
+  h.count++;
+  if (us < h.min)
+  {
+    h.min = us;
+  }
+  if (us > h.max)
+  {
+    h.max = us;
+  }
+  if (us > PROFILE_BUDGET_US[stage])
+  {
+    h.overruns++;
+  }
+}
+
+// Upper bound of the bucket holding the sample at rank, clamped to the exact min/max
+static uint32_t percentile(const ProfileHistogram &h, uint32_t rank)
+{
+  uint32_t seen = 0;
+  for (int i = 0; i < PROFILE_BUCKET_COUNT; i++)
+  {
+    seen += h.buckets[i];
+    if (seen > rank)
+    {
+      uint32_t value = bucketUpperBound(i);
+      return constrain(value, h.min, h.max);
+    }
+  }
+  return h.max;
+}
+
+// Reads while the owning task may be recording, so a field can be one sample off
+void profileGetStats(ProfileStage stage, ProfileStats *stats)
+{
+  const ProfileHistogram &h = histograms[stage];
+  stats->count = h.count;
+  stats->overruns = h.overruns;
+  if (h.count == 0 || h.resetPending)
+  {
+    stats->count = 0;
+    stats->overruns = 0;
+    stats->min = stats->p50 = stats->p99 = stats->max = 0;
+    return;
+  }
+  stats->min = h.min;
+  stats->max = h.max;
+  stats->p50 = percentile(h, h.count / 2);
+  stats->p99 = percentile(h, (uint32_t)((uint64_t)h.count * 99 / 100));
+}
+
+void profileReset(ProfileStage stage)
+{
+  histograms[stage].resetPending = true;
+}
@@ -0,0 +1,70 @@
+// Profile.h
+// Control loop profiling: PROFILE_SCOPE() times a function with the CPU cycle counter and adds the
+// duration to a fixed-bucket histogram for its stage. Stats are read on demand with CMD_STATS.
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <Arduino.h>
+#include "Hal.h"
+
+// Set to 0 to compile the probes out
+#ifndef PROFILE_ENABLED
+#define PROFILE_ENABLED 1
+#endif
+
+enum ProfileStage : uint8_t
+{
+  PROFILE_STAGE_CONTROL_STEP = 0, // whole controlStep(), i.e. one control period
+  PROFILE_STAGE_IR_READ,          // readIRSensors()
+  PROFILE_STAGE_STEER_PID,        // steerServoByPID(), includes PROFILE_STAGE_IR_READ
+  PROFILE_STAGE_HS_UPDATE,        // hsUpdate()
+  PROFILE_STAGE_SPEED_PID,        // adjustMotorSpeedPID()
+  PROFILE_STAGE_BROADCAST,        // bleBroadcastDTPS() and bleBroadcastSamples(), run in the telemetry task
+  PROFILE_STAGE_COUNT,
+};
+
+// Histogram buckets in microseconds: 1 us wide below 8 us, then 4 buckets per power of two.
+// The last bucket also collects everything above ~131 ms; min and max are always exact.
+const int PROFILE_BUCKET_COUNT = 64;
+
+struct ProfileStats
+{
+  uint32_t count;    // samples since the last reset
+  uint32_t min;      // us
+  uint32_t p50;      // us, upper bound of the bucket holding the median
+  uint32_t p99;      // us, upper bound of the bucket holding the 99th percentile
+  uint32_t max;      // us
+  uint32_t overruns; // samples longer than the stage's budget (its task period)
+};
+
+extern const char *const PROFILE_STAGE_NAMES[PROFILE_STAGE_COUNT];
+
+void profileSetup();
+// Add one sample, only called from the task that owns the stage
+void profileRecord(ProfileStage stage, uint32_t cycles);
+void profileGetStats(ProfileStage stage, ProfileStats *stats);
+// Clear a stage; applied by the owning task on its next sample so it never races profileRecord()
+void profileReset(ProfileStage stage);
+
+// Times the enclosing scope
+class ProfileScope
+{
+public:
+  explicit ProfileScope(ProfileStage stage) : stage_(stage), start_(halCycleCount()) {}
+  ~ProfileScope() { profileRecord(stage_, halCycleCount() - start_); }
+
+private:
+  ProfileStage stage_;
+  uint32_t start_;
+};
+
+#if PROFILE_ENABLED
+#define PROFILE_SCOPE(stage) ProfileScope profileScope_(stage)
+#else
+#define PROFILE_SCOPE(stage) \
+  do                         \
+  {                          \
+  } while (0)
+#endif
+
+#endif
@@ -0,0 +1,356 @@
+// RunControl.cpp
+// Control core shared by the firmware and the host build: run state, pacing and the per-task steps
+#include "RunControl.h"
+#include "ESCHandler.h"
+#include "ServoHandler.h"
+#include "IRHandler.h"
+#include "HSHandler.h"
+#include "Telemetry.h"
+#include "Profile.h"
+#include "PaceStrategy.h"
+#include "PacePlan.h"
+#include "RunRecorder.h"
+#include "ThrottleCalibration.h"
+#include "Lights.h"
+#include "Commands.h"
+#include "Course.h"
+
+// Define direction variables
+float MOTOR_SPEED = 1500;
+float SERVO_ANGLE = 90;
+bool RUNNING = false;
+bool startRunTimer = true;
+bool manualControl = false;
+bool IS_WHITE_LINE = false; // determines whether the logic follows a white or black line
+
+volatile unsigned long startTime = 0;          // start of pacing
+volatile unsigned long currentRunDuration = 0; // current total time of the run
+volatile unsigned long endTime = 0;            // final end time
+
+// Mode variables (the mode itself is in PaceStrategy.cpp)
+bool BRAKE = false;
+
+// Universal parameters (set based on mode)
+float targetDistance = 0.0; // user entered target distance in meters
+float targetTime = 0.0;     // user entered run time in seconds
+float targetSpeed = 0.0;    // user entered target speed in m/s (for TEMPO and DISTANCE_PACE)
+
+// Runtime tracking
+float averageSpeed = 0.0;  // average speed for the current run
+float currentSpeed = 0.0;  // Current speed in m/s
+float totalDistance = 0.0; // Total distance in m
+unsigned long currentTime = halMicros();
+unsigned long lastSpeedUpdateTime = halMicros();
+static float lastTargetSpeed = 0.0; // m/s, the speed PID's last target, for the pace lights
+
+uint32_t runsEnded = 0;            // published in the telemetry snapshot, which sends the final frame and summary
+static RunResult lastRun = {};     // published with runsEnded
+bool calibrationRequested = false; // set by a command, consumed by runStateStep()
+
+volatile RunState runState = RUN_STATE_IDLE;
+unsigned long runStateEnteredTime = 0; // halMicros() when runState last changed
+
+const char *const RUN_STATE_NAMES[] = {"IDLE", "RUNNING", "BRAKING", "COASTING", "CALIBRATING"};
+
+static void enterRunState(RunState state)
+{
+  LOG_DEBUG(LOG_TAG_RUN, "Run state %s -> %s", RUN_STATE_NAMES[runState], RUN_STATE_NAMES[state]);
+  runState = state;
+  runStateEnteredTime = currentTime;
+
+  switch (state)
+  {
+  case RUN_STATE_RUNNING:
+    recorderStart(MODE);
+    lastTargetSpeed = 0.0;
+    break;
+  case RUN_STATE_CALIBRATING:
+    calibrationStart();
+    recorderStart(MODE);
+    break;
+  case RUN_STATE_BRAKING:
+    brakeESC();
+    break;
+  case RUN_STATE_COASTING:
+    stopESC();
+    break;
+  case RUN_STATE_IDLE:
+    stopESC();
+    recorderStop();
+    break;
+  default:
+    break;
+  }
+}
+
+static void recordRunResult()
+{
+  lastRun.mode = MODE;
+  lastRun.distance = totalDistance;
+  lastRun.time = micros_to_s(endTime - startTime);
+  lastRun.pace = averageSpeed;
+  lastRun.targetDistance = targetDistance;
+  lastRun.targetTime = targetTime;
+  lastRun.targetSpeed = targetSpeed;
+  pacePlanProgress(&lastRun.segmentsDone, &lastRun.segmentCount);
+}
+
+// Speed only, so the run's distance and average stay as they were at the finish
+static void updateCoastSpeed()
+{
+  float coastAverage, coastDistance;
+  hsUpdate(&currentSpeed, &coastAverage, &coastDistance);
+}
+
+static void runningStep()
+{
+  hsUpdate(&currentSpeed, &averageSpeed, &totalDistance);
+
+  // Mode-specific logic, see PaceStrategy.cpp; read once in case a command switches modes mid-step
+  const PaceStrategy *pace = paceStrategy;
+  bool shouldEnd = pace->shouldEnd();
+
+  steerServoByPID();
+  courseStep();
+
+  if (shouldEnd)
+  {
+    RUNNING = false;
+    endTime = currentTime;
+    recordRunResult();
+    runsEnded++;
+    enterRunState(RUN_STATE_COASTING);
+  }
+  else
+  {
+    // Use PID control for speed adjustment - run every SPEED_PID_INTERVAL seconds for smoother transitions
+    if (Microseconds(currentTime - lastSpeedUpdateTime) >= unitCast<Microseconds>(SPEED_PID_INTERVAL))
+    {
+      lastTargetSpeed = pace->targetSpeed();
+      adjustMotorSpeedPID(currentSpeed, lastTargetSpeed);
+      lastSpeedUpdateTime = currentTime;
+    }
+  }
+}
+
+// Pace mode: apply commands, then advance the run state by one control period
+static void runStateStep()
+{
+  if (BRAKE)
+  {
+    BRAKE = false;
+    if (runState != RUN_STATE_IDLE)
+    {
+      enterRunState(RUN_STATE_BRAKING);
+    }
+  }
+  if (calibrationRequested)
+  {
+    calibrationRequested = false;
+    if (runState == RUN_STATE_IDLE && !RUNNING)
+    {
+      enterRunState(RUN_STATE_CALIBRATING);
+    }
+    else
+    {
+      LOG_WARN(LOG_TAG_RUN, "Calibration ignored, the car is not idle");
+    }
+  }
+  if (RUNNING && runState != RUN_STATE_RUNNING)
+  {
+    enterRunState(RUN_STATE_RUNNING);
+  }
+  else if (!RUNNING && runState == RUN_STATE_RUNNING)
+  {
+    enterRunState(RUN_STATE_COASTING);
+  }
+
+  unsigned long inState = currentTime - runStateEnteredTime;
+  switch (runState)
+  {
+  case RUN_STATE_RUNNING:
+    runningStep();
+    break;
+
+  case RUN_STATE_CALIBRATING:
+    hsUpdate(&currentSpeed, &averageSpeed, &totalDistance);
+    steerServoByPID();
+    if (calibrationStep())
+    {
+      enterRunState(RUN_STATE_COASTING);
+    }
+    break;
+
+  case RUN_STATE_BRAKING:
+    steerServoByPID();
+    updateCoastSpeed();
+    if (inState >= BRAKE_DURATION)
+    {
+      enterRunState(RUN_STATE_COASTING);
+    }
+    break;
+
+  case RUN_STATE_COASTING:
+    steerServoByPID();
+    updateCoastSpeed();
+    if (currentSpeed == 0.0 || inState >= COAST_HOLD_DURATION)
+    {
+      enterRunState(RUN_STATE_IDLE);
+    }
+    break;
+
+  case RUN_STATE_IDLE:
+  default:
+    stopESC();
+    // centerSteering();
+    steerServoByPID();
+    break;
+  }
+}
+
+void telemetryStep()
+{
+  logDrain(LOG_DRAIN_PER_TICK);
+
+  static unsigned long lastLogStatsTime = 0;
+  if (halMillis() - lastLogStatsTime >= LOG_STATS_INTERVAL_MS)
+  {
+    bleBroadcastLogStats();
+    bleRequestLinkInfo(); // refreshes the throughput counters
+    lastLogStatsTime = halMillis();
+  }
+
+  bleBroadcastProfileStats();
+
+  if (throttleSaveIfPending())
+  {
+    bleRequestThrottleTable(); // show the new calibration
+  }
+  bleBroadcastThrottleTable();
+  bleBroadcastMarkers();
+  bleBroadcastLinkInfo();
+
+  recorderFlush();
+  bleBroadcastRecording();
+
+  // Everything below reads the control task's state through the snapshot only
+  static uint32_t reportedRunsEnded = 0;
+  TelemetrySnapshot snapshot;
+  telemetryReadSnapshot(&snapshot);
+  const TelemetrySample &sample = snapshot.sample;
+
+  if (snapshot.runsEnded != reportedRunsEnded)
+  {
+    reportedRunsEnded = snapshot.runsEnded;
+    bleBroadcastSamples(true); // the run's last samples before the stopped frame
+    bleBroadcastDTPS(sample.distance, snapshot.lastRun.time, sample.pace, sample.speed, sample.steeringAngle, true);
+    bleBroadcastRunStopped();
+    printRunSummary(snapshot);
+  }
+  else
+  {
+    bleBroadcastSamples();
+  }
+
+  lightsStep(snapshot);
+}
+
+static void publishSnapshot()
+{
+  TelemetrySnapshot snapshot;
+  snapshot.sample.distance = totalDistance;
+  snapshot.sample.time = micros_to_s(currentRunDuration);
+  snapshot.sample.pace = averageSpeed;
+  snapshot.sample.speed = currentSpeed;
+  snapshot.sample.steeringAngle = SERVO_ANGLE;
+  snapshot.lastRun = lastRun;
+  snapshot.runsEnded = runsEnded;
+  snapshot.runState = runState;
+  snapshot.targetSpeed = runState == RUN_STATE_RUNNING ? lastTargetSpeed : 0.0f;
+  telemetryPublish(snapshot);
+
+  // Samples stream during manual control, a run or a calibration sweep
+  bool streaming = manualControl || RUNNING || runState == RUN_STATE_CALIBRATING;
+  static uint32_t periodsSinceSample = 0;
+  if (streaming && ++periodsSinceSample >= CONTROL_LOOP_HZ / TELEMETRY_SAMPLE_HZ)
+  {
+    periodsSinceSample = 0;
+    telemetryPushSample(snapshot.sample);
+  }
+}
+
+void controlStep()
+{
+  PROFILE_SCOPE(PROFILE_STAGE_CONTROL_STEP);
+
+  applyPendingCommands();
+
+  if (startRunTimer)
+  {
+    resetPID();
+    resetSteeringPID();
+    hsStart();
+    paceStrategy->start();
+    courseStart();
+    startTime = halMicros();
+    startRunTimer = false;
+  }
+
+  currentTime = halMicros();
+  currentRunDuration = currentTime - startTime;
+
+  if (manualControl)
+  {
+    BRAKE = false; // the throttle is the user's
+    setMotorSpeed(MOTOR_SPEED);
+    setSteering(SERVO_ANGLE);
+    hsUpdate(&currentSpeed, &averageSpeed, &totalDistance);
+  }
+  else // pace mode
+  {
+    runStateStep();
+    if (recorderActive())
+    {
+      recorderRecordTick(runState);
+    }
+  }
+
+  publishSnapshot();
+}
+
+void requestCalibration()
+{
+  if (manualControl)
+  {
+    LOG_WARN(LOG_TAG_RUN, "Calibration needs pace mode");
+    return;
+  }
+  startRunTimer = true; // fresh distance and PID state, like a run start
+  calibrationRequested = true;
+}
+
+void printRunSummary(const TelemetrySnapshot &snapshot)
+{
+  const RunResult &run = snapshot.lastRun;
+  const PaceStrategy &pace = PACE_STRATEGIES[run.mode];
+
+  LOG_INFO(LOG_TAG_RUN, "Run summary: %s, %.2fm in %.2fs, average %.2fm/s", pace.name, run.distance, run.time,
+           run.pace);
+  pace.summary(run);
+}
+
+// Function to be called when BLE receives new parameters
+void updateModeParameters(RunMode mode, float param1, float param2)
+{
+  setRunMode(mode);
+  paceStrategy->configure(param1, param2);
+
+  // Reset run state for new parameters
+  if (!manualControl)
+  {
+    RUNNING = false;
+    startRunTimer = true;
+    totalDistance = 0.0;
+    averageSpeed = 0.0;
+  }
+}
\ No newline at end of file
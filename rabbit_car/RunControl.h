@@ -0,0 +1,44 @@
+// RunControl.h
+#ifndef RUN_CONTROL_H
+#define RUN_CONTROL_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "PaceStrategy.h"
+#include "Telemetry.h"
+
+// Pace mode run state, advanced once per control period by controlStep()
+//   RUNNING  -> COASTING  when the pace strategy ends the run, or RUNNING is cleared without a brake
+//   RUNNING  -> BRAKING   on a stop command (BRAKE)
+//   BRAKING  -> COASTING  after BRAKE_DURATION
+//   COASTING -> IDLE      once the wheel stops or after COAST_HOLD_DURATION
+//   any      -> RUNNING   on a start command, immediately
+//   IDLE     -> CALIBRATING on a calibration command, -> COASTING when the throttle sweep is done
+// Every state except RUNNING holds the throttle at neutral (or brake) and keeps steering on the line.
+enum RunState : uint8_t
+{
+  RUN_STATE_IDLE = 0,
+  RUN_STATE_RUNNING,
+  RUN_STATE_BRAKING,
+  RUN_STATE_COASTING,
+  RUN_STATE_CALIBRATING, // throttle sweep, see ThrottleCalibration.h
+};
+
+extern volatile RunState runState;
+extern const char *const RUN_STATE_NAMES[]; // indexed by RunState
+
+// One control period: queued commands (Commands.h), run start/stop, steering, speed estimation and
+// speed control, then the telemetry snapshot
+void controlStep();
+
+// One telemetry period: log draining, telemetry frames and the end of run summary, from the snapshot
+void telemetryStep();
+
+// Control task: start a throttle calibration sweep in this control period, only from RUN_STATE_IDLE
+void requestCalibration();
+
+// Telemetry task: log the summary of the run that just ended, printed by logDrain()
+void printRunSummary(const TelemetrySnapshot &snapshot);
+void updateModeParameters(RunMode mode, float param1, float param2);
+
+#endif
@@ -0,0 +1,260 @@
+// RunRecorder.cpp
+#include "RunRecorder.h"
+#include "Telemetry.h"
+#include "IRHandler.h"
+#include "ServoHandler.h"
+#include "ESCHandler.h"
+#include "HSHandler.h"
+#include <atomic>
+
+static_assert((RECORDER_BUFFER_SIZE & (RECORDER_BUFFER_SIZE - 1)) == 0, "RECORDER_BUFFER_SIZE must be a power of two");
+
+// Single producer (control task) / single consumer (telemetry task) byte ring. Positions count
+// bytes since boot; a record is either written whole or dropped, so the file never holds a torn one
+static uint8_t ringBuffer[RECORDER_BUFFER_SIZE];
+static std::atomic<uint32_t> ringHead(0); // bytes written by the control task
+static std::atomic<uint32_t> ringTail(0); // bytes flushed by the telemetry task
+static std::atomic<uint32_t> droppedBytes(0);
+
+// A new recording starts at runBoundary; the consumer finishes the previous file up to there,
+// then truncates the file and clears boundaryPending
+static std::atomic<uint32_t> runBoundary(0);
+static std::atomic<bool> boundaryPending(false);
+static std::atomic<bool> recording(false);
+
+// Control task state
+static unsigned long recordStartTime = 0; // halMicros() at recorderStart()
+static uint32_t lastRecordedEdge = 0;
+
+// Telemetry task state
+static bool storageReady = false;
+static int writeFile = -1;
+static int readFile = -1;
+static std::atomic<uint32_t> fileBytes(0);
+
+static int16_t toI16(float value)
+{
+  return (int16_t)constrain(lroundf(value), -32768L, 32767L);
+}
+
+static uint16_t toU16(float value)
+{
+  return (uint16_t)constrain(lroundf(value), 0L, 65535L);
+}
+
+// Copy a whole record into the ring, or count it as dropped
+static bool ringWrite(const uint8_t *data, size_t length)
+{
+  uint32_t head = ringHead.load(std::memory_order_relaxed);
+  uint32_t tail = ringTail.load(std::memory_order_acquire);
+  if (RECORDER_BUFFER_SIZE - (head - tail) < length)
+  {
+    droppedBytes.fetch_add(length, std::memory_order_relaxed);
+    return false;
+  }
+
+  for (size_t i = 0; i < length; i++)
+  {
+    ringBuffer[(head + i) & (RECORDER_BUFFER_SIZE - 1)] = data[i];
+  }
+  ringHead.store(head + length, std::memory_order_release);
+  return true;
+}
+
+void recorderSetup()
+{
+  storageReady = halStorageBegin();
+  if (!storageReady)
+  {
+    LOG_ERROR(LOG_TAG_SYS, "Run recorder: storage unavailable, runs will not be recorded");
+  }
+}
+
+void recorderStart(uint8_t mode)
+{
+  if (boundaryPending.load(std::memory_order_acquire))
+  {
+    // The telemetry task has not opened the previous recording yet, keep appending to it
+    LOG_WARN(LOG_TAG_RUN, "Run recorder: previous recording still opening, not restarted");
+    recording.store(true, std::memory_order_release);
+    return;
+  }
+
+  recordStartTime = halMicros();
+  lastRecordedEdge = hsEdgeCount();
+  droppedBytes.store(0, std::memory_order_relaxed);
+  runBoundary.store(ringHead.load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+  uint8_t header[RECORDER_HEADER_SIZE];
+  memcpy(header, "RBR1", 4);
+  header[4] = RECORDER_VERSION;
+  header[5] = RECORD_TICK_SIZE;
+  header[6] = RECORD_EDGE_SIZE;
+  header[7] = mode;
+  putU16LE(header + 8, CONTROL_LOOP_HZ);
+  putU16LE(header + 10, 0);
+  putU32LE(header + 12, halMillis());
+  ringWrite(header, sizeof(header));
+
+  boundaryPending.store(true, std::memory_order_release);
+  recording.store(true, std::memory_order_release);
+}
+
+void recorderStop()
+{
+  recording.store(false, std::memory_order_release);
+}
+
+bool recorderActive()
+{
+  return recording.load(std::memory_order_relaxed);
+}
+
+void recorderRecordTick(uint8_t runState)
+{
+  unsigned long now = halMicros();
+
+  // Hall edges since the last tick, oldest first; the edge buffer only holds the last 32
+  uint32_t edges = hsEdgeCount();
+  if (edges - lastRecordedEdge > 32)
+  {
+    lastRecordedEdge = edges - 32;
+  }
+  for (; lastRecordedEdge != edges; lastRecordedEdge++)
+  {
+    uint8_t edge[RECORD_EDGE_SIZE];
+    edge[0] = RECORD_EDGE;
+    edge[1] = 0;
+    putU32LE(edge + 2, hsEdgeTime(lastRecordedEdge) - recordStartTime);
+    ringWrite(edge, sizeof(edge));
+  }
+
+  int steerError;
+  float steerIntegral, speedError, speedIntegral;
+  getSteeringPIDState(&steerError, &steerIntegral);
+  getSpeedPIDState(&speedError, &speedIntegral);
+
+  uint8_t tick[RECORD_TICK_SIZE];
+  tick[0] = RECORD_TICK;
+  tick[1] = runState;
+  putU32LE(tick + 2, now - recordStartTime);
+  putU16LE(tick + 6, getSensorMask());
+  putU16LE(tick + 8, toU16(getLinePosition()));
+  putU16LE(tick + 10, toU16(SERVO_ANGLE * 100.0f));
+  putU16LE(tick + 12, toU16(getESCPulseWidth()));
+  putU16LE(tick + 14, toU16(currentSpeed * 1000.0f));
+  putU32LE(tick + 16, (uint32_t)lroundf(totalDistance * 1000.0f));
+  putU16LE(tick + 20, toI16(steerError));
+  putU16LE(tick + 22, toI16(steerIntegral));
+  putU16LE(tick + 24, toI16(speedError * 1000.0f));
+  putU16LE(tick + 26, toI16(speedIntegral * 100.0f));
+  ringWrite(tick, sizeof(tick));
+}
+
+// Write ring bytes [tail, end) to the open file, or discard them if there is none
+static void flushRange(uint32_t tail, uint32_t end)
+{
+  while (tail != end)
+  {
+    uint32_t index = tail & (RECORDER_BUFFER_SIZE - 1);
+    uint32_t length = min(end - tail, RECORDER_BUFFER_SIZE - index); // up to the wrap
+    if (writeFile >= 0)
+    {
+      size_t written = halFileWrite(writeFile, ringBuffer + index, length);
+      fileBytes.fetch_add(written, std::memory_order_relaxed);
+      if (written < length)
+      {
+        LOG_ERROR(LOG_TAG_SYS, "Run recorder: file write failed, recording truncated");
+        halFileClose(writeFile);
+        writeFile = -1;
+      }
+    }
+    tail += length;
+  }
+  ringTail.store(tail, std::memory_order_release);
+}
+
+void recorderFlush()
+{
+  uint32_t tail = ringTail.load(std::memory_order_relaxed);
+  uint32_t budget = RECORDER_FLUSH_PER_TICK;
+
+  if (boundaryPending.load(std::memory_order_acquire))
+  {
+    // Finish the previous recording, then replace the file with the new one
+    uint32_t boundary = runBoundary.load(std::memory_order_relaxed);
+    uint32_t end = tail + min(boundary - tail, budget);
+    budget -= end - tail;
+    flushRange(tail, end);
+    tail = end;
+    if (tail != boundary)
+    {
+      return;
+    }
+
+    if (writeFile >= 0)
+    {
+      halFileClose(writeFile);
+    }
+    if (readFile >= 0)
+    {
+      halFileClose(readFile);
+      readFile = -1;
+    }
+    writeFile = storageReady ? halFileOpen(RECORDER_FILE_PATH, HAL_FILE_WRITE) : -1;
+    fileBytes.store(0, std::memory_order_relaxed);
+    boundaryPending.store(false, std::memory_order_release);
+  }
+
+  bool stopped = !recording.load(std::memory_order_acquire);
+  uint32_t head = ringHead.load(std::memory_order_acquire);
+  uint32_t end = tail + min(head - tail, budget);
+  flushRange(tail, end);
+
+  // Close once the run has ended and everything is written, so readers see the whole file
+  if (stopped && end == head && writeFile >= 0 && !boundaryPending.load(std::memory_order_acquire))
+  {
+    halFileClose(writeFile);
+    writeFile = -1;
+    LOG_INFO(LOG_TAG_RUN, "Run recorded: %u bytes, %u dropped", fileBytes.load(), droppedBytes.load());
+  }
+}
+
+void recorderGetInfo(RecorderInfo *info)
+{
+  if (recording.load(std::memory_order_acquire))
+  {
+    info->state = RECORDER_STATE_RECORDING;
+  }
+  else if (writeFile >= 0 || boundaryPending.load(std::memory_order_acquire))
+  {
+    info->state = RECORDER_STATE_FLUSHING;
+  }
+  else
+  {
+    info->state = RECORDER_STATE_IDLE;
+  }
+  info->size = fileBytes.load(std::memory_order_relaxed);
+  info->dropped = droppedBytes.load(std::memory_order_relaxed);
+}
+
+size_t recorderRead(uint32_t offset, uint8_t *data, size_t length)
+{
+  RecorderInfo info;
+  recorderGetInfo(&info);
+  if (info.state != RECORDER_STATE_IDLE || !storageReady || offset >= info.size)
+  {
+    return 0;
+  }
+
+  // Kept open between chunks, closed when the next recording replaces the file
+  if (readFile < 0)
+  {
+    readFile = halFileOpen(RECORDER_FILE_PATH, HAL_FILE_READ);
+    if (readFile < 0)
+    {
+      return 0;
+    }
+  }
+  return halFileRead(readFile, offset, data, min((uint32_t)length, info.size - offset));
+}
@@ -0,0 +1,82 @@
+// RunRecorder.h
+// Full rate run recording: the control task appends one record per control period and one per hall
+// edge to a RAM ring, the telemetry task flushes the ring to RECORDER_FILE_PATH in the background.
+// Only the last run is kept; it is downloaded over BLE with CMD_RECORDING (see Telemetry.h).
+#ifndef RUN_RECORDER_H
+#define RUN_RECORDER_H
+
+#include <Arduino.h>
+#include "Hal.h"
+#include "config.h"
+
+// File layout, all fields little-endian; must match decodeRecording() in web/public/javascripts/protocol.js
+//
+// Header
+//  offset  size  field
+//  0       4     magic "RBR1"
+//  4       1     version (RECORDER_VERSION)
+//  5       1     tick record size
+//  6       1     edge record size
+//  7       1     run mode (RunMode)
+//  8       2     control loop rate in Hz
+//  10      2     reserved
+//  12      4     halMillis() at the start of the recording
+//
+// Followed by records, each starting with its type byte
+//
+// RECORD_TICK, once per control period
+//  0       1     type
+//  1       1     run state (RunState)
+//  2       4     us since the start of the recording
+//  6       2     raw IR sensor mask
+//  8       2     line position
+//  10      2     steering angle in 1/100 degree
+//  12      2     ESC pulse width in us
+//  14      2     speed estimate in mm/s
+//  16      4     distance in mm
+//  20      2     steering error, signed
+//  22      2     steering integral, signed
+//  24      2     speed error in mm/s, signed
+//  26      2     speed integral * 100, signed
+//
+// RECORD_EDGE, once per hall edge
+//  0       1     type
+//  1       1     reserved
+//  2       4     us since the start of the recording
+const uint8_t RECORDER_VERSION = 1;
+const size_t RECORDER_HEADER_SIZE = 16;
+
+const uint8_t RECORD_TICK = 0x01;
+const size_t RECORD_TICK_SIZE = 28;
+const uint8_t RECORD_EDGE = 0x02;
+const size_t RECORD_EDGE_SIZE = 6;
+
+enum RecorderState : uint8_t
+{
+  RECORDER_STATE_IDLE = 0,  // the file holds the last run and can be read
+  RECORDER_STATE_RECORDING, // a run is being recorded
+  RECORDER_STATE_FLUSHING,  // the run ended, the rest of the ring is still being written
+};
+
+struct RecorderInfo
+{
+  uint8_t state;    // RecorderState
+  uint32_t size;    // bytes in the file
+  uint32_t dropped; // bytes lost because the ring was full, for the current/last recording
+};
+
+void recorderSetup();
+
+// Control task: start a new recording (replacing the last one), stop it, and add one control period
+void recorderStart(uint8_t mode);
+void recorderStop();
+bool recorderActive();
+void recorderRecordTick(uint8_t runState);
+
+// Telemetry task: write buffered records to the file
+void recorderFlush();
+void recorderGetInfo(RecorderInfo *info);
+// Read from the finished file, 0 while recording or flushing, past the end or if the file cannot be read
+size_t recorderRead(uint32_t offset, uint8_t *data, size_t length);
+
+#endif
@@ -1,4 +1,4 @@
-// ESCHandler.cpp
+// ServoHandler.cpp
 #include "ServoHandler.h"
 
 const int SERVO_MIN_PULSE_WIDTH = 1250; // Minimum pulse width in microseconds (full reverse)
@@ -21,23 +21,14 @@ int previousSteeringError = 0;
 float steeringIntegral = 0;
 unsigned long lastSteeringPIDTime = 0;
 
-// Create a servo object to control the servo
-Servo steeringServo;
-
 void setupServo()
 {
-  pinMode(SERVO_PIN, OUTPUT);
-
-  // Allow allocation of timers 2, 3 for servo control
-  ESP32PWM::allocateTimer(2);
-  ESP32PWM::allocateTimer(3);
-
   // Initialize SERVO
-  steeringServo.attach(SERVO_PIN, SERVO_MIN_PULSE_WIDTH, SERVO_MAX_PULSE_WIDTH);
+  halPwmAttach(HAL_PWM_SERVO, SERVO_PIN, SERVO_MIN_PULSE_WIDTH, SERVO_MAX_PULSE_WIDTH);
 
   // Set to neutral position on startup
   centerSteering();
-  delay(500); // Give the servo time to initialize
+  halDelay(500); // Give the servo time to initialize
 
   Serial.println("Steering servo initialized. Ready to receive steering commands.");
 }
@@ -75,25 +66,24 @@ int setSteering(float angle)
   int pulseWidth = (int)(pulseWidthFloat + 0.5);
 
   // Send the command to the servo
-  steeringServo.writeMicroseconds(pulseWidth);
+  halPwmWriteMicros(HAL_PWM_SERVO, pulseWidth);
 
-  // Log the command (uncommented for debugging precision)
-  Serial.print("Steering angle: ");
-  Serial.print(angle, 1); // Print with 1 decimal place
-  Serial.print("° | Pulse width: ");
-  Serial.println(pulseWidth);
+  // Log the command
+  LOG_TRACE(LOG_TAG_SERVO, "Steering angle: %.1f deg | Pulse width: %d", angle, pulseWidth);
 
   return pulseWidth;
 }
 
 void centerSteering()
 {
-  steeringServo.writeMicroseconds(SERVO_MID_PULSE_WIDTH); // Set to center
+  halPwmWriteMicros(HAL_PWM_SERVO, SERVO_MID_PULSE_WIDTH); // Set to center
 }
 
 void steerServoByPID()
 {
-  readIRSensorsI2C();
+  PROFILE_SCOPE(PROFILE_STAGE_STEER_PID);
+
+  readIRSensors();
   printIRDebugInfo();
   int position = getPosition();
 
@@ -115,7 +105,7 @@ void steerServoByPID()
   // }
 
   // Calculate time delta for derivative and integral
-  unsigned long currentTime = micros();
+  unsigned long currentTime = halMicros();
   float deltaTime = micros_to_s(currentTime - lastSteeringPIDTime); // Convert to seconds
   lastSteeringPIDTime = currentTime;
 
@@ -181,7 +171,7 @@ void resetSteeringPID()
 {
   steeringIntegral = 0;
   previousSteeringError = 0;
-  lastSteeringPIDTime = micros();
+  lastSteeringPIDTime = halMicros();
 }
 
 // Function to tune PID parameters during runtime
@@ -190,4 +180,10 @@ void updateSteeringPIDConstants(float kp, float ki, float kd)
   steerKP = kp;
   steerKI = ki;
   steerKD = kd;
-}
\ No newline at end of file
+}
+
+void getSteeringPIDState(int *error, float *integral)
+{
+  *error = steeringError;
+  *integral = steeringIntegral;
+}
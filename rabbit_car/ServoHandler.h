@@ -2,7 +2,7 @@
 #ifndef SERVO_HANDLER_H
 #define SERVO_HANDLER_H
 
-#include <ESP32Servo.h>
+#include "Hal.h"
 #include "IRHandler.h"
 #include "config.h"
 
@@ -20,4 +20,7 @@ void resetSteeringPID();
 // Function to tune PID parameters during runtime
 void updateSteeringPIDConstants(float kp, float ki, float kd);
 
+// Error and accumulated integral of the last steerServoByPID() call
+void getSteeringPIDState(int *error, float *integral);
+
 #endif
\ No newline at end of file
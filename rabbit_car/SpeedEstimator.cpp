@@ -0,0 +1,51 @@
+// SpeedEstimator.cpp
+#include "SpeedEstimator.h"
+#include "ThrottleCalibration.h"
+
+float motorModelSpeed(int pulseWidth)
+{
+  // Neutral, brake and reverse are below the table and settle at standstill
+  return throttleSpeedForPwm(pulseWidth);
+}
+
+void speedEstimatorReset(SpeedEstimator *est, float speed)
+{
+  est->speed = speed;
+  est->acceleration = 0.0;
+  est->variance = SPEED_EST_MEASUREMENT_NOISE;
+  est->periodStartSpeed = speed;
+  est->periodLength = 0.0;
+}
+
+void speedEstimatorPredict(SpeedEstimator *est, float dt, int pulseWidth)
+{
+  if (dt <= 0)
+  {
+    return;
+  }
+
+  // Change over the previous period, model step and hall correction included
+  if (est->periodLength > 0)
+  {
+    float acceleration = (est->speed - est->periodStartSpeed) / est->periodLength;
+    est->acceleration = SPEED_EST_ACCEL_SMOOTHING * est->acceleration + (1.0 - SPEED_EST_ACCEL_SMOOTHING) * acceleration;
+  }
+  est->periodStartSpeed = est->speed;
+  est->periodLength = dt;
+
+  // First order response towards the model's steady state speed, exact for a constant input
+  float decay = expf(-dt / MOTOR_MODEL_TIME_CONSTANT);
+  est->speed = motorModelSpeed(pulseWidth) + (est->speed - motorModelSpeed(pulseWidth)) * decay;
+  est->variance = est->variance * decay * decay + SPEED_EST_PROCESS_NOISE * dt;
+}
+
+void speedEstimatorObserve(SpeedEstimator *est, float measuredSpeed, float measurementVariance)
+{
+  float gain = est->variance / (est->variance + measurementVariance);
+  est->speed += gain * (measuredSpeed - est->speed);
+  est->variance *= 1.0 - gain;
+  if (est->speed < 0)
+  {
+    est->speed = 0.0; // the hall sensor cannot tell direction, reverse is not estimated
+  }
+}
@@ -0,0 +1,38 @@
+// SpeedEstimator.h
+// One state Kalman filter for wheel speed: a first order motor model driven by the ESC pulse width
+// predicts every control period, hall speed measurements correct it whenever new edges arrive
+#ifndef SPEED_ESTIMATOR_H
+#define SPEED_ESTIMATOR_H
+
+#include <Arduino.h>
+#include "config.h"
+
+struct SpeedEstimator
+{
+  float speed;        // m/s
+  float acceleration; // m/s^2, smoothed derivative of speed
+  float variance;     // (m/s)^2, uncertainty of speed
+  float periodStartSpeed; // speed and length of the previous period, for acceleration
+  float periodLength;
+};
+
+// Steady state speed the motor model expects for an ESC pulse width, from the throttle table
+float motorModelSpeed(int pulseWidth);
+
+void speedEstimatorReset(SpeedEstimator *est, float speed);
+
+/**
+ * Advance the estimate by one period with the motor model
+ * @param dt Time since the last predict in seconds
+ * @param pulseWidth ESC pulse width applied during that time in microseconds
+ */
+void speedEstimatorPredict(SpeedEstimator *est, float dt, int pulseWidth);
+
+/**
+ * Correct the estimate with a measured speed
+ * @param measuredSpeed Speed in m/s
+ * @param measurementVariance Variance of measuredSpeed in (m/s)^2
+ */
+void speedEstimatorObserve(SpeedEstimator *est, float measuredSpeed, float measurementVariance);
+
+#endif
@@ -0,0 +1,594 @@
+// Telemetry.cpp
+#include "Telemetry.h"
+#include "config.h"
+#include <atomic>
+
+// Telemetry frame state
+uint16_t telemetrySeq = 0;
+TelemetrySample lastSample = {0.0, 0.0, 0.0, 0.0, 90.0};
+
+static_assert(CONTROL_LOOP_HZ % TELEMETRY_SAMPLE_HZ == 0, "TELEMETRY_SAMPLE_HZ must divide CONTROL_LOOP_HZ");
+static_assert((TELEMETRY_SAMPLE_QUEUE_SIZE & (TELEMETRY_SAMPLE_QUEUE_SIZE - 1)) == 0, "TELEMETRY_SAMPLE_QUEUE_SIZE must be a power of two");
+static_assert(TELEMETRY_BATCH_HEADER_SIZE + TELEMETRY_BATCH_MAX_SAMPLES * TELEMETRY_BATCH_SAMPLE_SIZE <= BLE_LOCAL_MTU - 3, "a full batch must fit BLE_LOCAL_MTU");
+
+// Single producer (control task) / single consumer (telemetry task) sample queue
+static TimedSample sampleQueue[TELEMETRY_SAMPLE_QUEUE_SIZE];
+static std::atomic<uint32_t> sampleHead(0);
+static std::atomic<uint32_t> sampleTail(0);
+static std::atomic<uint32_t> samplesDropped(0);
+
+// Batch being filled by the telemetry task, oldest first
+static TimedSample batch[TELEMETRY_BATCH_MAX_SAMPLES];
+static uint8_t batchCount = 0;
+
+// Notification counters, telemetry task only
+static uint32_t notificationCount = 0;
+static uint32_t notificationBytes = 0;
+
+volatile bool linkInfoPending = false;
+
+// Latest control task snapshot; the sequence is odd while the control task is copying it
+static TelemetrySnapshot snapshotData;
+static std::atomic<uint32_t> snapshotSeq(0);
+
+// Next ProfileStage to report, PROFILE_STAGE_COUNT when no report is pending
+volatile uint8_t profileReportStage = PROFILE_STAGE_COUNT;
+volatile bool profileReportReset = false;
+
+// Next throttle table point to report, THROTTLE_TABLE_SIZE when no report is pending
+volatile uint8_t throttleReportPoint = THROTTLE_TABLE_SIZE;
+
+// Recording download requests from the BLE task: the offset is stored before the action, and the
+// telemetry task takes the action before the offset, so a newer request is at worst applied twice
+const uint8_t RECORDING_REQUEST_NONE = 0xFF; // no request since the last telemetry tick
+static std::atomic<uint8_t> recordingRequest(RECORDING_REQUEST_NONE);
+static std::atomic<uint32_t> recordingRequestOffset(0);
+
+// Recording download state, only touched by the telemetry task
+static bool recordingInfoPending = false;
+static bool recordingReadActive = false;
+static uint32_t recordingReadOffset = 0;
+
+// Scale a float to an unsigned fixed-point field, rounding and saturating instead of wrapping
+static uint32_t toFixed(float value, float scale, uint32_t maxValue)
+{
+  float scaled = value * scale + 0.5f;
+  if (!(scaled > 0.0f)) // also catches NaN
+  {
+    return 0;
+  }
+  if (scaled >= (float)maxValue)
+  {
+    return maxValue;
+  }
+  return (uint32_t)scaled;
+}
+
+// Signed 16 bit fixed-point field, rounding and saturating
+static int16_t toFixedI16(float value, float scale)
+{
+  float scaled = roundf(value * scale);
+  if (!(scaled == scaled)) // NaN
+  {
+    return 0;
+  }
+  return (int16_t)constrain(scaled, -32768.0f, 32767.0f);
+}
+
+void putU16LE(uint8_t *buf, uint16_t value)
+{
+  buf[0] = value & 0xFF;
+  buf[1] = value >> 8;
+}
+
+void putU32LE(uint8_t *buf, uint32_t value)
+{
+  buf[0] = value & 0xFF;
+  buf[1] = (value >> 8) & 0xFF;
+  buf[2] = (value >> 16) & 0xFF;
+  buf[3] = value >> 24;
+}
+
+uint16_t getU16LE(const uint8_t *buf)
+{
+  return (uint16_t)buf[0] | ((uint16_t)buf[1] << 8);
+}
+
+uint32_t getU32LE(const uint8_t *buf)
+{
+  return (uint32_t)buf[0] | ((uint32_t)buf[1] << 8) | ((uint32_t)buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+float getF32LE(const uint8_t *buf)
+{
+  uint32_t bits = getU32LE(buf);
+  float value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+// The 14 sample bytes shared by the DTPS and batch frames: run time, distance, pace, speed, steering
+static void encodeSampleFields(uint8_t *buf, const TelemetrySample &sample)
+{
+  putU32LE(buf, toFixed(sample.time, 1000.0f, UINT32_MAX));
+  putU32LE(buf + 4, toFixed(sample.distance, 1000.0f, UINT32_MAX));
+  putU16LE(buf + 8, toFixed(sample.pace, 1000.0f, UINT16_MAX));
+  putU16LE(buf + 10, toFixed(sample.speed, 1000.0f, UINT16_MAX));
+  putU16LE(buf + 12, toFixed(sample.steeringAngle, 100.0f, UINT16_MAX));
+}
+
+size_t encodeTelemetryFrame(uint8_t *buf, uint16_t seq, uint32_t timestampMs, const TelemetrySample &sample, uint8_t flags)
+{
+  buf[0] = TELEMETRY_FRAME_DTPS_V1;
+  buf[1] = flags;
+  putU16LE(buf + 2, seq);
+  putU16LE(buf + 4, (uint16_t)timestampMs);
+  encodeSampleFields(buf + 6, sample);
+  return TELEMETRY_FRAME_SIZE;
+}
+
+size_t encodeTelemetryBatch(uint8_t *buf, uint16_t seq, const TimedSample *samples, uint8_t count)
+{
+  buf[0] = TELEMETRY_FRAME_BATCH_V1;
+  buf[1] = count;
+  putU16LE(buf + 2, seq);
+  putU32LE(buf + 4, samples[0].timestamp);
+  uint8_t *field = buf + TELEMETRY_BATCH_HEADER_SIZE;
+  for (uint8_t i = 0; i < count; i++, field += TELEMETRY_BATCH_SAMPLE_SIZE)
+  {
+    uint32_t offset = samples[i].timestamp - samples[0].timestamp;
+    putU16LE(field, offset > UINT16_MAX ? UINT16_MAX : offset);
+    encodeSampleFields(field + 2, samples[i].sample);
+  }
+  return TELEMETRY_BATCH_HEADER_SIZE + count * TELEMETRY_BATCH_SAMPLE_SIZE;
+}
+
+size_t encodeLinkFrame(uint8_t *buf, const HalBleLinkInfo &link, const BleLinkStats &stats)
+{
+  buf[0] = TELEMETRY_FRAME_LINK_V1;
+  buf[1] = link.phy;
+  putU16LE(buf + 2, link.mtu);
+  putU16LE(buf + 4, link.interval);
+  putU16LE(buf + 6, link.latency);
+  putU16LE(buf + 8, link.supervisionTimeout);
+  putU32LE(buf + 10, stats.notifications);
+  putU32LE(buf + 14, stats.bytes);
+  putU16LE(buf + 18, stats.samplesDropped > UINT16_MAX ? UINT16_MAX : stats.samplesDropped);
+  return LINK_FRAME_SIZE;
+}
+
+// Every notification goes through here so the link frame can count them
+static void notify(const uint8_t *data, size_t length)
+{
+  halBleNotify(data, length);
+  notificationCount++;
+  notificationBytes += length;
+}
+
+size_t encodeLogStatsFrame(uint8_t *buf, const LogStats &stats)
+{
+  buf[0] = TELEMETRY_FRAME_LOG_STATS_V1;
+  buf[1] = 0;
+  putU32LE(buf + 2, stats.written);
+  putU32LE(buf + 6, stats.dropped);
+  putU16LE(buf + 10, stats.pending > UINT16_MAX ? UINT16_MAX : stats.pending);
+  return LOG_STATS_FRAME_SIZE;
+}
+
+size_t encodeProfileFrame(uint8_t *buf, ProfileStage stage, const ProfileStats &stats)
+{
+  buf[0] = TELEMETRY_FRAME_PROFILE_V1;
+  buf[1] = stage;
+  putU32LE(buf + 2, stats.count);
+  putU16LE(buf + 6, stats.min > UINT16_MAX ? UINT16_MAX : stats.min);
+  putU16LE(buf + 8, stats.p50 > UINT16_MAX ? UINT16_MAX : stats.p50);
+  putU16LE(buf + 10, stats.p99 > UINT16_MAX ? UINT16_MAX : stats.p99);
+  putU32LE(buf + 12, stats.max);
+  putU32LE(buf + 16, stats.overruns);
+  return PROFILE_FRAME_SIZE;
+}
+
+size_t encodeRecordingInfoFrame(uint8_t *buf, const RecorderInfo &info)
+{
+  buf[0] = TELEMETRY_FRAME_RECORDING_INFO_V1;
+  buf[1] = info.state;
+  putU32LE(buf + 2, info.size);
+  putU32LE(buf + 6, info.dropped);
+  return RECORDING_INFO_FRAME_SIZE;
+}
+
+size_t encodeThrottleFrame(uint8_t *buf, const ThrottleTable &table, uint8_t point)
+{
+  buf[0] = TELEMETRY_FRAME_THROTTLE_V1;
+  buf[1] = point;
+  buf[2] = THROTTLE_TABLE_SIZE;
+  buf[3] = table.calibrated ? THROTTLE_FLAG_CALIBRATED : 0;
+  putU16LE(buf + 4, table.pwm[point]);
+  putU16LE(buf + 6, toFixed(table.speed[point], 1000.0f, UINT16_MAX));
+  return THROTTLE_FRAME_SIZE;
+}
+
+size_t encodeMarkerFrame(uint8_t *buf, const MarkerEvent &event)
+{
+  buf[0] = TELEMETRY_FRAME_MARKER_V1;
+  buf[1] = event.type;
+  buf[2] = event.courseIndex;
+  buf[3] = 0;
+  putU32LE(buf + 4, event.time);
+  putU32LE(buf + 8, toFixed(event.distance, 1000.0f, UINT32_MAX));
+  putU16LE(buf + 12, toFixedI16(event.correction, 1000.0f));
+  putU16LE(buf + 14, toFixedI16(event.odometryScale - 1.0f, 100000.0f));
+  return MARKER_FRAME_SIZE;
+}
+
+// Encode the last sample and notify it on the data characteristic
+static void notifyTelemetryFrame(uint8_t flags)
+{
+  uint8_t frame[TELEMETRY_FRAME_SIZE];
+  size_t length = encodeTelemetryFrame(frame, telemetrySeq++, halMillis(), lastSample, flags);
+  notify(frame, length);
+}
+
+// DTPS frame of one sample, at most one per TELEMETRY_INTERVAL_MS unless forced
+static bool broadcastSample(const TelemetrySample &sample, bool forceBroadcast)
+{
+  // Check if the broadcast interval has elapsed since the last broadcast
+  static unsigned long lastBroadcastTime = 0;
+  if (halMillis() - lastBroadcastTime < TELEMETRY_INTERVAL_MS && !forceBroadcast)
+  {
+    return false; // Exit early if it's too soon to broadcast
+  }
+
+  // Keep the latest values so the run stopped frame can repeat them
+  lastSample = sample;
+
+  if (!halBleConnected())
+  {
+    // No need to print a message here as it could flood the serial output
+    return false;
+  }
+
+  notifyTelemetryFrame(forceBroadcast ? TELEMETRY_FLAG_FORCED : 0);
+
+  // Update the last broadcast time
+  lastBroadcastTime = halMillis();
+
+  return true;
+}
+
+/**
+ * Function to broadcast Distance, Time, Pace, and Speed data over BLE
+ * Sent as a single TELEMETRY_FRAME_SIZE byte binary frame, see Telemetry.h for the layout
+ * @param distance Distance value in meters
+ * @param time Time value in seconds
+ * @param pace Pace value in meters per second
+ * @param speed Speed value in meters per second
+ * @return bool True if data was sent successfully, false otherwise
+ */
+bool bleBroadcastDTPS(float distance, float time, float pace, float speed, float steeringAngle, bool forceBroadcast)
+{
+  PROFILE_SCOPE(PROFILE_STAGE_BROADCAST);
+
+  TelemetrySample sample = {distance, time, pace, speed, steeringAngle};
+  return broadcastSample(sample, forceBroadcast);
+}
+
+void telemetryPushSample(const TelemetrySample &sample)
+{
+  uint32_t head = sampleHead.load(std::memory_order_relaxed);
+  if (head - sampleTail.load(std::memory_order_acquire) >= TELEMETRY_SAMPLE_QUEUE_SIZE)
+  {
+    samplesDropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  TimedSample &slot = sampleQueue[head & (TELEMETRY_SAMPLE_QUEUE_SIZE - 1)];
+  slot.timestamp = halMillis();
+  slot.sample = sample;
+  sampleHead.store(head + 1, std::memory_order_release);
+}
+
+static bool takeSample(TimedSample *sample)
+{
+  uint32_t tail = sampleTail.load(std::memory_order_relaxed);
+  if (tail == sampleHead.load(std::memory_order_acquire))
+  {
+    return false;
+  }
+  *sample = sampleQueue[tail & (TELEMETRY_SAMPLE_QUEUE_SIZE - 1)];
+  sampleTail.store(tail + 1, std::memory_order_release);
+  return true;
+}
+
+static void sendBatch()
+{
+  lastSample = batch[batchCount - 1].sample;
+  if (halBleConnected())
+  {
+    uint8_t frame[TELEMETRY_BATCH_HEADER_SIZE + TELEMETRY_BATCH_MAX_SAMPLES * TELEMETRY_BATCH_SAMPLE_SIZE];
+    size_t length = encodeTelemetryBatch(frame, telemetrySeq++, batch, batchCount);
+    notify(frame, length);
+  }
+  batchCount = 0;
+}
+
+bool bleBroadcastSamples(bool flush)
+{
+  PROFILE_SCOPE(PROFILE_STAGE_BROADCAST);
+
+  size_t maxSize = halBleMaxNotifySize();
+  size_t capacity = 0;
+  if (maxSize >= TELEMETRY_BATCH_HEADER_SIZE + TELEMETRY_BATCH_SAMPLE_SIZE)
+  {
+    capacity = min((maxSize - TELEMETRY_BATCH_HEADER_SIZE) / TELEMETRY_BATCH_SAMPLE_SIZE, (size_t)TELEMETRY_BATCH_MAX_SAMPLES);
+  }
+
+  bool sent = false;
+  TimedSample sample;
+  if (capacity == 0)
+  {
+    // Default MTU: no batches, the newest sample goes out as a DTPS frame
+    bool haveSample = false;
+    while (takeSample(&sample))
+    {
+      haveSample = true;
+    }
+    return haveSample && broadcastSample(sample.sample, false);
+  }
+
+  while (takeSample(&sample))
+  {
+    if (batchCount >= capacity)
+    {
+      sendBatch();
+      sent = true;
+    }
+    batch[batchCount++] = sample;
+  }
+  if (batchCount > 0 && (flush || batchCount >= capacity || halMillis() - batch[0].timestamp >= TELEMETRY_BATCH_INTERVAL_MS))
+  {
+    sendBatch();
+    sent = true;
+  }
+  return sent;
+}
+
+void bleRequestLinkInfo()
+{
+  linkInfoPending = true;
+}
+
+bool bleBroadcastLinkInfo()
+{
+  if (!linkInfoPending || !halBleConnected())
+  {
+    return false;
+  }
+  linkInfoPending = false;
+
+  HalBleLinkInfo link;
+  halBleLinkInfo(&link);
+  BleLinkStats stats = {notificationCount, notificationBytes, samplesDropped.load(std::memory_order_relaxed)};
+
+  uint8_t frame[LINK_FRAME_SIZE];
+  size_t length = encodeLinkFrame(frame, link, stats);
+  notify(frame, length);
+  return true;
+}
+
+bool bleBroadcastRunStopped()
+{
+  if (!halBleConnected())
+  {
+    return false;
+  }
+
+  notifyTelemetryFrame(TELEMETRY_FLAG_RUN_STOPPED | TELEMETRY_FLAG_FORCED);
+
+  return true;
+}
+
+bool bleBroadcastLogStats()
+{
+  if (!halBleConnected())
+  {
+    return false;
+  }
+
+  LogStats stats;
+  logGetStats(&stats);
+
+  uint8_t frame[LOG_STATS_FRAME_SIZE];
+  size_t length = encodeLogStatsFrame(frame, stats);
+  notify(frame, length);
+
+  return true;
+}
+
+void telemetryPublish(const TelemetrySnapshot &snapshot)
+{
+  uint32_t seq = snapshotSeq.load(std::memory_order_relaxed);
+  snapshotSeq.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release); // odd before any of the data
+  snapshotData = snapshot;
+  snapshotSeq.store(seq + 2, std::memory_order_release);
+}
+
+void telemetryReadSnapshot(TelemetrySnapshot *snapshot)
+{
+  uint32_t before, after;
+  do
+  {
+    before = snapshotSeq.load(std::memory_order_acquire);
+    *snapshot = snapshotData;
+    std::atomic_thread_fence(std::memory_order_acquire); // the data before the second read
+    after = snapshotSeq.load(std::memory_order_relaxed);
+  } while ((before & 1) || before != after);
+}
+
+void bleRequestProfileStats(bool reset)
+{
+  profileReportReset = reset;
+  profileReportStage = 0;
+}
+
+bool bleBroadcastProfileStats()
+{
+  uint8_t stage = profileReportStage;
+  if (stage >= PROFILE_STAGE_COUNT)
+  {
+    return false;
+  }
+  profileReportStage = stage + 1;
+
+  ProfileStats stats;
+  profileGetStats((ProfileStage)stage, &stats);
+  if (profileReportReset)
+  {
+    profileReset((ProfileStage)stage);
+  }
+
+  if (!halBleConnected())
+  {
+    return false;
+  }
+
+  uint8_t frame[PROFILE_FRAME_SIZE];
+  size_t length = encodeProfileFrame(frame, (ProfileStage)stage, stats);
+  notify(frame, length);
+
+  return true;
+}
+
+void bleRequestThrottleTable()
+{
+  throttleReportPoint = 0;
+}
+
+bool bleBroadcastThrottleTable()
+{
+  uint8_t point = throttleReportPoint;
+  if (point >= THROTTLE_TABLE_SIZE)
+  {
+    return false;
+  }
+  throttleReportPoint = point + 1;
+
+  if (!halBleConnected())
+  {
+    return false;
+  }
+
+  uint8_t frame[THROTTLE_FRAME_SIZE];
+  size_t length = encodeThrottleFrame(frame, throttleTable(), point);
+  notify(frame, length);
+
+  return true;
+}
+
+bool bleBroadcastMarkers()
+{
+  bool sent = false;
+  MarkerEvent event;
+  while (courseTakeEvent(&event))
+  {
+    if (halBleConnected())
+    {
+      uint8_t frame[MARKER_FRAME_SIZE];
+      size_t length = encodeMarkerFrame(frame, event);
+      notify(frame, length);
+      sent = true;
+    }
+  }
+  return sent;
+}
+
+void bleRequestRecording(uint8_t action, uint32_t offset)
+{
+  recordingRequestOffset.store(offset, std::memory_order_relaxed);
+  recordingRequest.store(action, std::memory_order_release);
+}
+
+// Apply the newest request from the BLE task, the reply always starts with an info frame
+static void takeRecordingRequest()
+{
+  uint8_t action = recordingRequest.exchange(RECORDING_REQUEST_NONE, std::memory_order_acquire);
+  switch (action)
+  {
+  case RECORDING_REQUEST_NONE:
+    return;
+  case RECORDING_ACTION_READ:
+    recordingReadOffset = recordingRequestOffset.load(std::memory_order_relaxed);
+    recordingReadActive = true;
+    break;
+  case RECORDING_ACTION_CANCEL:
+    recordingReadActive = false;
+    break;
+  default:
+    break;
+  }
+  recordingInfoPending = true;
+}
+
+bool bleBroadcastRecording()
+{
+  takeRecordingRequest();
+  if (!recordingInfoPending && !recordingReadActive)
+  {
+    return false;
+  }
+  if (!halBleConnected())
+  {
+    // The client resumes from the last offset it received once it reconnects
+    recordingInfoPending = false;
+    recordingReadActive = false;
+    return false;
+  }
+
+  RecorderInfo info;
+  recorderGetInfo(&info);
+
+  if (recordingInfoPending)
+  {
+    recordingInfoPending = false;
+    uint8_t frame[RECORDING_INFO_FRAME_SIZE];
+    size_t length = encodeRecordingInfoFrame(frame, info);
+    notify(frame, length);
+  }
+
+  // Only a finished file can be read, the info frame tells the client to retry later
+  if (!recordingReadActive || info.state != RECORDER_STATE_IDLE)
+  {
+    recordingReadActive = false;
+    return false;
+  }
+
+  // At least one byte per chunk, whatever the link reports
+  size_t chunkSize = max(min(halBleMaxNotifySize(), RECORDING_CHUNK_MAX_SIZE), RECORDING_CHUNK_HEADER_SIZE + 1);
+  size_t payload = chunkSize - RECORDING_CHUNK_HEADER_SIZE;
+  uint8_t frame[RECORDING_CHUNK_MAX_SIZE];
+  for (int i = 0; i < RECORDING_CHUNKS_PER_TICK && recordingReadActive; i++)
+  {
+    uint32_t offset = recordingReadOffset;
+    size_t length = recorderRead(offset, frame + RECORDING_CHUNK_HEADER_SIZE, payload);
+    // Nothing read before the end of the file is a storage error, it would not go away on a retry
+    bool failed = length == 0 && offset < info.size;
+    bool last = failed || offset + length >= info.size;
+    if (failed)
+    {
+      LOG_WARN(LOG_TAG_BLE, "Recording read failed at offset %u of %u", offset, info.size);
+    }
+
+    frame[0] = TELEMETRY_FRAME_RECORDING_CHUNK_V1;
+    frame[1] = (last ? RECORDING_CHUNK_FLAG_LAST : 0) | (failed ? RECORDING_CHUNK_FLAG_ERROR : 0);
+    putU32LE(frame + 2, offset);
+    notify(frame, RECORDING_CHUNK_HEADER_SIZE + length);
+
+    recordingReadOffset = offset + length;
+    if (last)
+    {
+      recordingReadActive = false;
+    }
+  }
+
+  return true;
+}
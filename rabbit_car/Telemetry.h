@@ -0,0 +1,249 @@
+// Telemetry.h
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <Arduino.h>
+#include "Hal.h"
+#include "Log.h"
+#include "Profile.h"
+#include "RunRecorder.h"
+#include "ThrottleCalibration.h"
+#include "Course.h"
+#include "PaceStrategy.h"
+
+// Binary telemetry frame sent on the data characteristic.
+// All fields are little-endian; the layout must match decodeTelemetryFrame() in web/public/javascripts/protocol.js
+//
+//  offset  size  field
+//  0       1     frame id (TELEMETRY_FRAME_DTPS_V1), bumped whenever the layout changes
+//  1       1     flags (TELEMETRY_FLAG_*)
+//  2       2     sequence number, wraps at 65535
+//  4       2     timestamp, low 16 bits of halMillis()
+//  6       4     elapsed run time in ms
+//  10      4     distance in mm
+//  14      2     average pace in mm/s
+//  16      2     current speed in mm/s
+//  18      2     steering angle in 1/100 degree
+const uint8_t TELEMETRY_FRAME_DTPS_V1 = 0x01;
+const size_t TELEMETRY_FRAME_SIZE = 20; // fits a single notification at the default 23 byte MTU
+
+const uint8_t TELEMETRY_FLAG_RUN_STOPPED = 0x01; // run has ended, replaces the old {"stopped": true} message
+const uint8_t TELEMETRY_FLAG_FORCED = 0x02;      // sent outside the regular broadcast interval
+
+// Log stats frame, sent every LOG_STATS_INTERVAL_MS
+//
+//  offset  size  field
+//  0       1     frame id (TELEMETRY_FRAME_LOG_STATS_V1)
+//  1       1     reserved
+//  2       4     log records written
+//  6       4     log records dropped because the buffer was full
+//  10      2     log records waiting to be printed
+const uint8_t TELEMETRY_FRAME_LOG_STATS_V1 = 0x02;
+const size_t LOG_STATS_FRAME_SIZE = 12;
+
+// Profile stats frame, one per ProfileStage in reply to CMD_STATS
+//
+//  offset  size  field
+//  0       1     frame id (TELEMETRY_FRAME_PROFILE_V1)
+//  1       1     stage (ProfileStage)
+//  2       4     samples since the last reset
+//  6       2     min in us, saturates at 65535
+//  8       2     p50 in us, saturates at 65535
+//  10      2     p99 in us, saturates at 65535
+//  12      4     max in us
+//  16      4     samples over the stage budget
+const uint8_t TELEMETRY_FRAME_PROFILE_V1 = 0x03;
+const size_t PROFILE_FRAME_SIZE = 20;
+
+// Recording chunk frame, streamed in reply to CMD_RECORDING (RECORDING_ACTION_READ)
+//
+//  offset  size  field
+//  0       1     frame id (TELEMETRY_FRAME_RECORDING_CHUNK_V1)
+//  1       1     flags (RECORDING_CHUNK_FLAG_*)
+//  2       4     file offset of the first data byte
+//  6       n     file data, as much as fits the negotiated MTU
+const uint8_t TELEMETRY_FRAME_RECORDING_CHUNK_V1 = 0x04;
+const size_t RECORDING_CHUNK_HEADER_SIZE = 6;
+const size_t RECORDING_CHUNK_MAX_SIZE = 244; // one link layer packet with data length extension
+
+const uint8_t RECORDING_CHUNK_FLAG_LAST = 0x01;  // the chunk ends at the end of the file
+const uint8_t RECORDING_CHUNK_FLAG_ERROR = 0x02; // the file could not be read at the offset, sent with LAST
+
+// Recording info frame, in reply to CMD_RECORDING and before the first chunk of a read
+//
+//  offset  size  field
+//  0       1     frame id (TELEMETRY_FRAME_RECORDING_INFO_V1)
+//  1       1     recorder state (RecorderState)
+//  2       4     file size in bytes
+//  6       4     bytes dropped while recording
+const uint8_t TELEMETRY_FRAME_RECORDING_INFO_V1 = 0x05;
+const size_t RECORDING_INFO_FRAME_SIZE = 10;
+
+// Throttle table frame, one per table point in reply to CMD_CALIBRATE and after a calibration
+//
+//  offset  size  field
+//  0       1     frame id (TELEMETRY_FRAME_THROTTLE_V1)
+//  1       1     point index
+//  2       1     number of points
+//  3       1     flags (THROTTLE_FLAG_*)
+//  4       2     ESC pulse width in us
+//  6       2     steady state speed in mm/s
+const uint8_t TELEMETRY_FRAME_THROTTLE_V1 = 0x06;
+const size_t THROTTLE_FRAME_SIZE = 8;
+
+const uint8_t THROTTLE_FLAG_CALIBRATED = 0x01; // measured, not the default motor model
+
+// Marker frame, one per track marker passed during a run (Course.h)
+//
+//  offset  size  field
+//  0       1     frame id (TELEMETRY_FRAME_MARKER_V1)
+//  1       1     marker type (MarkerType)
+//  2       1     matched course marker index, MARKER_UNMATCHED if none
+//  3       1     reserved
+//  4       4     run time at the leading edge in ms
+//  8       4     run distance at the leading edge in mm, before the correction
+//  12      2     correction in mm, signed, saturates
+//  14      2     odometry scale - 1 in 1/100000, signed
+const uint8_t TELEMETRY_FRAME_MARKER_V1 = 0x07;
+const size_t MARKER_FRAME_SIZE = 16;
+
+// Telemetry batch frame: the samples the control task took since the last batch (TELEMETRY_SAMPLE_HZ),
+// as many as the negotiated MTU carries. Sent instead of DTPS frames while a run streams, unless the
+// MTU is too small for one sample, then the DTPS frame carries the newest sample as before
+//
+//  offset  size  field
+//  0       1     frame id (TELEMETRY_FRAME_BATCH_V1)
+//  1       1     number of samples
+//  2       2     sequence number, shared with the DTPS frames
+//  4       4     halMillis() when the first sample was taken
+//  8       16    per sample:
+//                0   2  ms since the first sample
+//                2   4  elapsed run time in ms
+//                6   4  distance in mm
+//                10  2  average pace in mm/s
+//                12  2  current speed in mm/s
+//                14  2  steering angle in 1/100 degree
+const uint8_t TELEMETRY_FRAME_BATCH_V1 = 0x08;
+const size_t TELEMETRY_BATCH_HEADER_SIZE = 8;
+const size_t TELEMETRY_BATCH_SAMPLE_SIZE = 16;
+const uint8_t TELEMETRY_BATCH_MAX_SAMPLES = 14; // fills BLE_LOCAL_MTU
+
+// Link frame: the negotiated BLE link and the notification counters, at every change of the link and
+// every LOG_STATS_INTERVAL_MS; throughput is the change of the byte counter between two frames
+//
+//  offset  size  field
+//  0       1     frame id (TELEMETRY_FRAME_LINK_V1)
+//  1       1     transmit PHY (HalBlePhy)
+//  2       2     ATT MTU
+//  4       2     connection interval in 1.25 ms units
+//  6       2     peripheral latency in connection events
+//  8       2     supervision timeout in 10 ms units
+//  10      4     notifications sent since boot
+//  14      4     notification bytes sent since boot
+//  18      2     telemetry samples dropped since boot because the queue was full, saturates
+const uint8_t TELEMETRY_FRAME_LINK_V1 = 0x09;
+const size_t LINK_FRAME_SIZE = 20;
+
+// CMD_RECORDING actions
+const uint8_t RECORDING_ACTION_INFO = 0;
+const uint8_t RECORDING_ACTION_READ = 1; // stream the file from the given offset
+const uint8_t RECORDING_ACTION_CANCEL = 2;
+
+struct TelemetrySample
+{
+  float distance;      // meters
+  float time;          // seconds
+  float pace;          // meters per second
+  float speed;         // meters per second
+  float steeringAngle; // degrees
+};
+
+// Control task state that the telemetry task reports, published once per control period
+struct TelemetrySnapshot
+{
+  TelemetrySample sample; // time is the run time so far
+  RunResult lastRun;      // filled at every run end, for the final frame and the summary
+  uint32_t runsEnded;     // bumped at every run end, the stopped frame is sent once per change
+  uint8_t runState;       // RunState
+  float targetSpeed;      // m/s, the speed PID's last target while running, 0 otherwise
+};
+
+// A sample and the halMillis() it was taken at
+struct TimedSample
+{
+  uint32_t timestamp;
+  TelemetrySample sample;
+};
+
+// Notification counters for the link frame
+struct BleLinkStats
+{
+  uint32_t notifications;
+  uint32_t bytes;
+  uint32_t samplesDropped;
+};
+
+// Seqlock: the control task is the only writer and never waits, readers retry instead of tearing
+void telemetryPublish(const TelemetrySnapshot &snapshot);
+void telemetryReadSnapshot(TelemetrySnapshot *snapshot);
+
+/**
+ * Encode a sample into a DTPS frame
+ * @param buf Output buffer, at least TELEMETRY_FRAME_SIZE bytes
+ * @return Number of bytes written
+ */
+size_t encodeTelemetryFrame(uint8_t *buf, uint16_t seq, uint32_t timestampMs, const TelemetrySample &sample, uint8_t flags);
+
+size_t encodeLogStatsFrame(uint8_t *buf, const LogStats &stats);
+
+size_t encodeProfileFrame(uint8_t *buf, ProfileStage stage, const ProfileStats &stats);
+
+size_t encodeRecordingInfoFrame(uint8_t *buf, const RecorderInfo &info);
+
+size_t encodeThrottleFrame(uint8_t *buf, const ThrottleTable &table, uint8_t point);
+
+size_t encodeMarkerFrame(uint8_t *buf, const MarkerEvent &event);
+
+/**
+ * Encode samples into a batch frame
+ * @param buf Output buffer, at least TELEMETRY_BATCH_HEADER_SIZE + count * TELEMETRY_BATCH_SAMPLE_SIZE bytes
+ * @param count 1 to TELEMETRY_BATCH_MAX_SAMPLES samples, oldest first
+ * @return Number of bytes written
+ */
+size_t encodeTelemetryBatch(uint8_t *buf, uint16_t seq, const TimedSample *samples, uint8_t count);
+
+size_t encodeLinkFrame(uint8_t *buf, const HalBleLinkInfo &link, const BleLinkStats &stats);
+
+// Control task: queue a sample for the next batch; a full queue drops it and counts it
+void telemetryPushSample(const TelemetrySample &sample);
+
+// Notifications on the data characteristic, sent through halBleNotify()
+bool bleBroadcastDTPS(float distance, float time, float pace, float speed, float steeringAngle, bool forceBroadcast = 0);
+bool bleBroadcastRunStopped();
+// Send the queued samples once a batch is full or its oldest sample is TELEMETRY_BATCH_INTERVAL_MS old,
+// or right away with flush
+bool bleBroadcastSamples(bool flush = false);
+// Queue a link frame, sent by bleBroadcastLinkInfo(); the BLE callbacks call it when the link changes
+void bleRequestLinkInfo();
+bool bleBroadcastLinkInfo();
+bool bleBroadcastLogStats();
+// Queue one profile frame per stage, sent one per call of bleBroadcastProfileStats()
+void bleRequestProfileStats(bool reset);
+bool bleBroadcastProfileStats();
+// Queue one throttle frame per table point, sent one per call of bleBroadcastThrottleTable()
+void bleRequestThrottleTable();
+bool bleBroadcastThrottleTable();
+// Send the marker events of the control task, all that are waiting
+bool bleBroadcastMarkers();
+// Queue a recording info frame and optionally a download from offset, streamed by bleBroadcastRecording()
+void bleRequestRecording(uint8_t action, uint32_t offset);
+bool bleBroadcastRecording();
+
+// little-endian helpers shared by the binary frame encoders/decoders
+void putU16LE(uint8_t *buf, uint16_t value);
+void putU32LE(uint8_t *buf, uint32_t value);
+uint16_t getU16LE(const uint8_t *buf);
+uint32_t getU32LE(const uint8_t *buf);
+float getF32LE(const uint8_t *buf);
+
+#endif
@@ -0,0 +1,229 @@
+// ThrottleCalibration.cpp
+#include "ThrottleCalibration.h"
+#include "ESCHandler.h"
+#include "HSHandler.h"
+
+const uint8_t THROTTLE_TABLE_VERSION = 1;
+const char *const THROTTLE_SETTINGS_KEY = "throttle";
+
+// Sweep state, control task
+static uint8_t sweepPoint = 0;
+static bool sweepMeasuring = false;
+static unsigned long sweepPhaseStart = 0; // halMicros() when the settle or measure phase began
+static uint32_t sweepStartEdge = 0;       // hall edge count and time of the last edge when measuring began
+static uint32_t sweepStartEdgeTime = 0;
+static float sweepSpeeds[THROTTLE_TABLE_SIZE];
+
+static volatile bool savePending = false;
+
+static uint16_t sweepPwm(int point)
+{
+  return MOTOR_MODEL_DEADBAND_PWM + point * CALIBRATION_PWM_STEP;
+}
+
+// The linear motor model sampled at the sweep points
+static ThrottleTable defaultTable()
+{
+  ThrottleTable model;
+  model.version = THROTTLE_TABLE_VERSION;
+  model.calibrated = false;
+  for (int i = 0; i < THROTTLE_TABLE_SIZE; i++)
+  {
+    model.pwm[i] = sweepPwm(i);
+    model.speed[i] = (model.pwm[i] - MOTOR_MODEL_DEADBAND_PWM) * MOTOR_MODEL_GAIN;
+  }
+  return model;
+}
+
+static ThrottleTable table = defaultTable(); // usable before throttleSetup()
+
+// Isotonic regression (pool adjacent violators): the closest non-decreasing sequence in the least
+// squares sense, so one noisy point flattens its neighbours instead of being clipped
+static void makeMonotone(float *values, int count)
+{
+  float means[THROTTLE_TABLE_SIZE];
+  int sizes[THROTTLE_TABLE_SIZE];
+  int blocks = 0;
+  for (int i = 0; i < count; i++)
+  {
+    means[blocks] = values[i];
+    sizes[blocks] = 1;
+    blocks++;
+    while (blocks > 1 && means[blocks - 2] > means[blocks - 1])
+    {
+      int size = sizes[blocks - 2] + sizes[blocks - 1];
+      means[blocks - 2] = (means[blocks - 2] * sizes[blocks - 2] + means[blocks - 1] * sizes[blocks - 1]) / size;
+      sizes[blocks - 2] = size;
+      blocks--;
+    }
+  }
+
+  int i = 0;
+  for (int block = 0; block < blocks; block++)
+  {
+    for (int j = 0; j < sizes[block]; j++)
+    {
+      values[i++] = means[block];
+    }
+  }
+}
+
+void throttleSetup()
+{
+  ThrottleTable stored;
+  if (halSettingsRead(THROTTLE_SETTINGS_KEY, (uint8_t *)&stored, sizeof(stored)) &&
+      stored.version == THROTTLE_TABLE_VERSION && stored.calibrated)
+  {
+    table = stored;
+    LOG_INFO(LOG_TAG_ESC, "Throttle calibration loaded, %.2f m/s at %d us", table.speed[THROTTLE_TABLE_SIZE - 1], table.pwm[THROTTLE_TABLE_SIZE - 1]);
+  }
+  else
+  {
+    table = defaultTable();
+    LOG_INFO(LOG_TAG_ESC, "Throttle not calibrated, using the motor model");
+  }
+}
+
+bool throttleCalibrated()
+{
+  return table.calibrated;
+}
+
+const ThrottleTable &throttleTable()
+{
+  return table;
+}
+
+void throttleClearCalibration()
+{
+  table = defaultTable();
+  savePending = true; // erased from the telemetry task, flash writes stall the caller
+  LOG_INFO(LOG_TAG_ESC, "Throttle calibration cleared");
+}
+
+float throttleSpeedForPwm(int pulseWidth)
+{
+  if (pulseWidth < table.pwm[0])
+  {
+    return 0.0;
+  }
+
+  // Segment holding pulseWidth, the last one extrapolates
+  int i = 1;
+  while (i < THROTTLE_TABLE_SIZE - 1 && pulseWidth > table.pwm[i])
+  {
+    i++;
+  }
+  float slope = (table.speed[i] - table.speed[i - 1]) / (table.pwm[i] - table.pwm[i - 1]);
+  return table.speed[i - 1] + slope * (pulseWidth - table.pwm[i - 1]);
+}
+
+int throttlePwmForSpeed(float speed)
+{
+  if (speed <= table.speed[0])
+  {
+    return table.pwm[0];
+  }
+
+  // First point at or above speed; the one before is strictly below, so flat runs are skipped
+  int i = 1;
+  while (i < THROTTLE_TABLE_SIZE - 1 && table.speed[i] < speed)
+  {
+    i++;
+  }
+  float rise = table.speed[i] - table.speed[i - 1];
+  if (rise <= 0.0f)
+  {
+    return table.pwm[i]; // flat top of the table, nothing to extrapolate from
+  }
+  return lroundf(table.pwm[i - 1] + (speed - table.speed[i - 1]) * (table.pwm[i] - table.pwm[i - 1]) / rise);
+}
+
+void calibrationStart()
+{
+  sweepPoint = 0;
+  sweepMeasuring = false;
+  sweepPhaseStart = halMicros();
+  setMotorSpeed(sweepPwm(0));
+  LOG_INFO(LOG_TAG_ESC, "Throttle calibration started");
+}
+
+bool calibrationStep()
+{
+  unsigned long now = halMicros();
+
+  if (!sweepMeasuring)
+  {
+    if (now - sweepPhaseStart >= CALIBRATION_SETTLE_TIME)
+    {
+      sweepMeasuring = true;
+      sweepPhaseStart = now;
+      sweepStartEdge = hsEdgeCount();
+      sweepStartEdgeTime = hsEdgeTime(sweepStartEdge - 1);
+    }
+    return false;
+  }
+
+  if (now - sweepPhaseStart < CALIBRATION_MEASURE_TIME)
+  {
+    return false;
+  }
+
+  // Whole edge periods from the last edge before the window to the last edge in it, so the
+  // result does not depend on where the window cut the periods
+  uint32_t edges = hsEdgeCount();
+  float speed = 0.0;
+  if (edges != sweepStartEdge && sweepStartEdge > 0)
+  {
+    uint32_t span = hsEdgeTime(edges - 1) - sweepStartEdgeTime;
+    speed = (DISTANCE_PER_PULSE * (float)(edges - sweepStartEdge) / unitCast<Seconds>(Microseconds(span))).count();
+  }
+  sweepSpeeds[sweepPoint] = speed;
+  LOG_INFO(LOG_TAG_ESC, "Calibration point %d: %d us -> %.3f m/s", sweepPoint, sweepPwm(sweepPoint), speed);
+
+  sweepPoint++;
+  if (sweepPoint < THROTTLE_TABLE_SIZE)
+  {
+    sweepMeasuring = false;
+    sweepPhaseStart = now;
+    setMotorSpeed(sweepPwm(sweepPoint));
+    return false;
+  }
+
+  if (!(sweepSpeeds[THROTTLE_TABLE_SIZE - 1] > 0.0f))
+  {
+    LOG_WARN(LOG_TAG_ESC, "Throttle calibration failed, no hall edges at any PWM");
+    return true;
+  }
+
+  makeMonotone(sweepSpeeds, THROTTLE_TABLE_SIZE);
+  for (int i = 0; i < THROTTLE_TABLE_SIZE; i++)
+  {
+    table.pwm[i] = sweepPwm(i);
+    table.speed[i] = sweepSpeeds[i];
+  }
+  table.calibrated = true;
+  savePending = true;
+  LOG_INFO(LOG_TAG_ESC, "Throttle calibration done");
+  return true;
+}
+
+bool throttleSaveIfPending()
+{
+  if (!savePending)
+  {
+    return false;
+  }
+  savePending = false;
+
+  ThrottleTable copy = table;
+  if (!copy.calibrated)
+  {
+    halSettingsErase(THROTTLE_SETTINGS_KEY);
+  }
+  else if (!halSettingsWrite(THROTTLE_SETTINGS_KEY, (const uint8_t *)&copy, sizeof(copy)))
+  {
+    LOG_ERROR(LOG_TAG_ESC, "Throttle calibration could not be saved");
+  }
+  return true;
+}
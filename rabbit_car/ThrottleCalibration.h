@@ -0,0 +1,40 @@
+// ThrottleCalibration.h
+// Table of ESC pulse width -> steady state speed. A calibration sweep (RUN_STATE_CALIBRATING) holds each
+// table pulse width until the speed settles, measures the speed from hall edges, makes the result monotone
+// and stores it in settings. The speed PID uses the inverse as feedforward, the speed estimator's motor
+// model the forward direction. Until a car is calibrated the table is the linear MOTOR_MODEL_* model.
+#ifndef THROTTLE_CALIBRATION_H
+#define THROTTLE_CALIBRATION_H
+
+#include <Arduino.h>
+#include "Hal.h"
+#include "config.h"
+
+struct ThrottleTable
+{
+  uint8_t version;
+  bool calibrated; // false for the default table
+  uint16_t pwm[THROTTLE_TABLE_SIZE];  // us, increasing
+  float speed[THROTTLE_TABLE_SIZE];   // m/s, non-decreasing
+};
+
+// Load the stored calibration, or the default table
+void throttleSetup();
+bool throttleCalibrated();
+const ThrottleTable &throttleTable();
+// Control task: forget the calibration and go back to the default table
+void throttleClearCalibration();
+
+// Steady state speed for a pulse width, 0 below the first table point
+float throttleSpeedForPwm(int pulseWidth);
+// Pulse width whose steady state speed is speed, extrapolated above the table
+int throttlePwmForSpeed(float speed);
+
+// Calibration sweep, control task; calibrationStep() drives the ESC and returns true when the sweep is done
+void calibrationStart();
+bool calibrationStep();
+
+// Telemetry task: store a finished calibration or erase a cleared one; true once per change
+bool throttleSaveIfPending();
+
+#endif
@@ -0,0 +1,137 @@
+// Units.h
+// Compile-time units for distance, time and speed. A Quantity carries its dimension (powers of length
+// and time) and its unit as a std::ratio to the SI unit, so both live in the type and cost nothing at
+// run time. Arithmetic only works within one unit: meters plus millimeters, or seconds compared with
+// microseconds, does not compile until one side goes through unitCast<>(), which folds the conversion
+// factor into a single constant multiplication.
+//
+//   Meters perPulse = unitCast<Meters>(Millimeters(PI * 82)) / 8.0f;
+//   Seconds elapsed = unitCast<Seconds>(Microseconds(halMicros() - start)); // * 1e-6f, no division
+//   MetersPerSecond speed = perPulse / elapsed;
+#ifndef UNITS_H
+#define UNITS_H
+
+#include <ratio>
+#include <type_traits>
+
+template <int LengthPower, int TimePower>
+struct Dimension
+{
+  static constexpr int length = LengthPower;
+  static constexpr int time = TimePower;
+};
+
+typedef Dimension<1, 0> Length;
+typedef Dimension<0, 1> Duration;
+typedef Dimension<1, -1> Velocity;
+
+template <typename Dim, typename Ratio = std::ratio<1>, typename Rep = float>
+class Quantity
+{
+public:
+  typedef Dim dimension;
+  typedef Ratio ratio;
+  typedef Rep rep;
+
+  constexpr Quantity() : value(0) {}
+  constexpr explicit Quantity(Rep value) : value(value) {}
+
+  constexpr Rep count() const { return value; }
+
+  constexpr Quantity operator-() const { return Quantity(-value); }
+  constexpr Quantity operator+(Quantity other) const { return Quantity(value + other.value); }
+  constexpr Quantity operator-(Quantity other) const { return Quantity(value - other.value); }
+  constexpr Quantity operator*(Rep factor) const { return Quantity(value * factor); }
+  constexpr Quantity operator/(Rep divisor) const { return Quantity(value / divisor); }
+  Quantity &operator+=(Quantity other)
+  {
+    value += other.value;
+    return *this;
+  }
+  Quantity &operator-=(Quantity other)
+  {
+    value -= other.value;
+    return *this;
+  }
+
+  constexpr bool operator==(Quantity other) const { return value == other.value; }
+  constexpr bool operator!=(Quantity other) const { return value != other.value; }
+  constexpr bool operator<(Quantity other) const { return value < other.value; }
+  constexpr bool operator<=(Quantity other) const { return value <= other.value; }
+  constexpr bool operator>(Quantity other) const { return value > other.value; }
+  constexpr bool operator>=(Quantity other) const { return value >= other.value; }
+
+private:
+  Rep value;
+};
+
+template <typename Dim, typename Ratio, typename Rep>
+constexpr Quantity<Dim, Ratio, Rep> operator*(Rep factor, Quantity<Dim, Ratio, Rep> quantity)
+{
+  return quantity * factor;
+}
+
+// Products and quotients add and subtract the dimensions and multiply and divide the units,
+// so meters over seconds is meters per second and km/h times hours is km
+template <typename Dim1, typename Ratio1, typename Dim2, typename Ratio2, typename Rep>
+constexpr Quantity<Dimension<Dim1::length + Dim2::length, Dim1::time + Dim2::time>, std::ratio_multiply<Ratio1, Ratio2>, Rep>
+operator*(Quantity<Dim1, Ratio1, Rep> a, Quantity<Dim2, Ratio2, Rep> b)
+{
+  return Quantity<Dimension<Dim1::length + Dim2::length, Dim1::time + Dim2::time>, std::ratio_multiply<Ratio1, Ratio2>, Rep>(a.count() * b.count());
+}
+
+template <typename Dim1, typename Ratio1, typename Dim2, typename Ratio2, typename Rep>
+constexpr Quantity<Dimension<Dim1::length - Dim2::length, Dim1::time - Dim2::time>, std::ratio_divide<Ratio1, Ratio2>, Rep>
+operator/(Quantity<Dim1, Ratio1, Rep> a, Quantity<Dim2, Ratio2, Rep> b)
+{
+  return Quantity<Dimension<Dim1::length - Dim2::length, Dim1::time - Dim2::time>, std::ratio_divide<Ratio1, Ratio2>, Rep>(a.count() / b.count());
+}
+
+/**
+ * Convert a quantity to another unit of the same dimension, e.g. unitCast<Meters>(Millimeters(82))
+ * The factor is a compile-time constant; the conversion rounds towards zero when To counts in integers
+ * @return To The quantity in the new unit
+ */
+template <typename To, typename Dim, typename Ratio, typename Rep>
+constexpr To unitCast(Quantity<Dim, Ratio, Rep> from)
+{
+  static_assert(std::is_same<typename To::dimension, Dim>::value, "unitCast between different dimensions");
+  typedef std::ratio_divide<Ratio, typename To::ratio> factor;
+  return To((typename To::rep)(factor::den == 1 ? from.count() * (float)factor::num
+                                                : from.count() * ((float)factor::num / (float)factor::den)));
+}
+
+// Distance
+typedef Quantity<Length, std::milli> Millimeters;
+typedef Quantity<Length, std::centi> Centimeters;
+typedef Quantity<Length> Meters;
+typedef Quantity<Length, std::kilo> Kilometers;
+// Ratios are written in lowest terms: std::ratio arithmetic reduces its results, and a quotient only
+// names the typedef below when its ratio type is the same
+typedef Quantity<Length, std::ratio<127, 5000>> Inches;   // 0.0254 m
+typedef Quantity<Length, std::ratio<381, 1250>> Feet;     // 0.3048 m
+typedef Quantity<Length, std::ratio<201168, 125>> Miles;  // 1609.344 m
+
+// Time. Microseconds and Milliseconds count in halMicros() and halMillis() ticks, so a difference of two
+// timestamps is a duration without any float math, and a float interval compares against it after a
+// compile-time unitCast
+typedef Quantity<Duration, std::micro, unsigned long> Microseconds;
+typedef Quantity<Duration, std::milli, unsigned long> Milliseconds;
+typedef Quantity<Duration> Seconds;
+typedef Quantity<Duration, std::ratio<60>> Minutes;
+typedef Quantity<Duration, std::ratio<3600>> Hours;
+
+// Speed
+typedef Quantity<Velocity> MetersPerSecond;
+typedef Quantity<Velocity, std::ratio_divide<Kilometers::ratio, Hours::ratio>> KilometersPerHour;
+typedef Quantity<Velocity, std::ratio_divide<Miles::ratio, Hours::ratio>> MilesPerHour;
+
+// Quotients and products of the units above are the units themselves, e.g.
+// KilometersPerHour v = Kilometers(1.0f) / Hours(1.0f);
+static_assert(std::is_same<decltype(Meters() / Seconds()), MetersPerSecond>::value, "m / s is not MetersPerSecond");
+static_assert(std::is_same<decltype(Kilometers() / Hours()), KilometersPerHour>::value, "km / h is not KilometersPerHour");
+static_assert(std::is_same<decltype(Miles() / Hours()), MilesPerHour>::value, "mi / h is not MilesPerHour");
+static_assert(std::is_same<decltype(KilometersPerHour() * Hours()), Kilometers>::value, "km/h * h is not Kilometers");
+static_assert(std::is_same<decltype(MilesPerHour() * Hours()), Miles>::value, "mph * h is not Miles");
+
+#endif
@@ -3,7 +3,7 @@
 #define CONFIG_H
 
 #include "Conversions.h"
-#include <ArduinoJson.h>
+#include "Log.h"
 
 // BLE UUIDs - MUST match the ones in the web app
 #define SERVICE_UUID "4fafc201-1fb5-459e-8fcc-c5c9c331914b"
@@ -26,9 +26,95 @@
 #define IR2_SCL_PIN 22
 #define IR_KEY_PIN 18
 
-const int WHEEL_DIAMETER = 82; // wheel diameter in mm
+// Task scheduling
+const uint32_t CONTROL_LOOP_HZ = 500;    // steering/speed control rate, driven by a hardware timer
+const int CONTROL_TASK_CORE = 1;
+const int CONTROL_TASK_PRIORITY = 5;
+const uint32_t CONTROL_TASK_STACK_SIZE = 8192;
+
+const uint32_t TELEMETRY_TASK_HZ = 50; // telemetry, lights and logging rate
+const int TELEMETRY_TASK_CORE = 0;
+const int TELEMETRY_TASK_PRIORITY = 2;
+const uint32_t TELEMETRY_TASK_STACK_SIZE = 8192;
+
+// Line sensor acquisition (HalESP32.cpp): both I2C buses are read at once in the background and the
+// control loop takes the newest frame
+const uint32_t IR_I2C_CLOCK_HZ = 400000;         // fast mode
+const uint32_t IR_ACQUISITION_PERIOD_MS = 1;     // one frame per FreeRTOS tick, several per control period
+const uint32_t IR_I2C_TIMEOUT_MS = 2;            // a read not done by then counts as unanswered
+const unsigned long IR_FRAME_STALE_TIME = 5000;  // us, a newest frame older than this counts as unanswered
+const int IR_ACQUISITION_CORE = 0;
+const int IR_ACQUISITION_PRIORITY = 4;           // above telemetry, below the control task
+const uint32_t IR_ACQUISITION_STACK_SIZE = 2048;
+
+const unsigned long TELEMETRY_INTERVAL_MS = 50; // minimum time between DTPS telemetry notifications
+
+// Telemetry samples (Telemetry.h): taken by the control task, several sent per notification
+const uint32_t TELEMETRY_SAMPLE_HZ = 100;              // divides CONTROL_LOOP_HZ
+const uint32_t TELEMETRY_SAMPLE_QUEUE_SIZE = 32;       // a power of two
+const unsigned long TELEMETRY_BATCH_INTERVAL_MS = 50;  // the oldest sample in a batch waits at most this long
+
+// BLE link profile (BLEHandler.cpp), requested from every central; each part only applies if it agrees
+const uint16_t BLE_LOCAL_MTU = 247;           // ATT MTU offered, 247 fills one link layer packet with data length extension
+const uint16_t BLE_DATA_LENGTH = 251;         // link layer payload, the maximum with data length extension
+const uint16_t BLE_CONN_INTERVAL_MIN = 6;     // 1.25 ms units, 7.5 ms
+const uint16_t BLE_CONN_INTERVAL_MAX = 12;    // 15 ms
+const uint16_t BLE_CONN_LATENCY = 0;          // connection events the car may skip
+const uint16_t BLE_SUPERVISION_TIMEOUT = 400; // 10 ms units, 4 s
+const bool BLE_PREFER_2M_PHY = true;          // BLE 5 chips only, the original ESP32 stays on the 1M PHY
+
+const uint32_t COMMAND_MAILBOX_SIZE = 16; // commands queued from the BLE task to the control task, a power of two
+
+// Logging (see Log.h for levels and tags)
+const int LOG_DRAIN_PER_TICK = 16;                // max log records printed per telemetry tick
+const unsigned long LOG_STATS_INTERVAL_MS = 1000; // time between log stats frames
+const size_t LOG_SERIAL_TX_BUFFER_SIZE = 2048;
+
+constexpr Millimeters WHEEL_DIAMETER(82);
 const int MAGNETS_COUNT = 8;   // the number of magnets spaced evenly on a wheel
 
+// Speed estimation and control
+const int HS_SPEED_AVERAGE_EDGES = 4;                // number of hall edge periods averaged per speed estimate
+const unsigned long HS_STANDSTILL_TIMEOUT = 250000;  // us without a hall edge before the speed reads 0
+constexpr Seconds SPEED_PID_INTERVAL(0.25);          // between speed PID updates
+
+// Speed estimator (SpeedEstimator.h); the motor model only needs to be roughly right,
+// hall measurements pull the estimate back whenever they arrive
+const int MOTOR_MODEL_DEADBAND_PWM = 1540;       // ESC pulse width in us at and below which the car stays put
+const float MOTOR_MODEL_GAIN = 0.02;             // steady state m/s per us above the deadband
+const float MOTOR_MODEL_TIME_CONSTANT = 0.3;     // s, first order response of speed to the throttle
+const float SPEED_EST_PROCESS_NOISE = 4.0;       // (m/s)^2 per s of motor model error
+const float SPEED_EST_MEASUREMENT_NOISE = 0.04;  // (m/s)^2 of a speed from a single hall period
+const float SPEED_EST_ACCEL_SMOOTHING = 0.96;    // weight of the previous acceleration per control period, ~50 ms
+
+// Throttle calibration (ThrottleCalibration.h); the sweep holds each PWM for SETTLE + MEASURE,
+// about 15 s and 20 m of line at the defaults, and starts at the motor model deadband
+const int THROTTLE_TABLE_SIZE = 10;
+const int CALIBRATION_PWM_STEP = 15;                   // us between table points
+const unsigned long CALIBRATION_SETTLE_TIME = 1000000; // us for the speed to settle at a new PWM (~3 motor time constants)
+const unsigned long CALIBRATION_MEASURE_TIME = 500000; // us of hall edges averaged per point
+
+// Track markers and course corrections (Course.h)
+const int MARKER_MIN_SENSORS = 9;          // active sensors of a marker, wider than any line (IR_MAX_LINE_WIDTH)
+const int MARKER_CROSS_SENSORS = 14;       // a marker this wide at some point is a cross line, otherwise a triangle
+const float MARKER_MIN_GAP = 0.2;          // m of line after a marker before the next one can start
+const float COURSE_MATCH_WINDOW = 1.0;     // m, a marker matches a course marker this close,
+const float COURSE_MATCH_FRACTION = 0.05;  // or within this fraction of the distance run if that is more
+const float COURSE_SCALE_BASELINE = 5.0;   // min m between matched markers for an odometry scale measurement
+const float COURSE_SCALE_GAIN = 0.5;       // weight of a new scale measurement
+const float COURSE_SCALE_LIMIT = 0.1;      // max deviation of the odometry scale from 1
+const uint32_t MARKER_EVENT_QUEUE_SIZE = 8;
+
+// End of run (see RunState in RunControl.h)
+const unsigned long BRAKE_DURATION = 2000000;     // us the brake pulse is held after a stop command
+const unsigned long COAST_HOLD_DURATION = 3000000; // max us of line holding while coasting down after a run
+
+// Run recorder (RunRecorder.h)
+const uint32_t RECORDER_BUFFER_SIZE = 32768;    // bytes of RAM between the control task and the file, ~2.3 s of a run
+const uint32_t RECORDER_FLUSH_PER_TICK = 2048;  // max bytes written to the file per telemetry tick
+const char *const RECORDER_FILE_PATH = "/run.bin";
+const int RECORDING_CHUNKS_PER_TICK = 4;        // recording download notifications per telemetry tick
+
 // external variables
 extern float MOTOR_SPEED;
 extern float SERVO_ANGLE;
@@ -37,7 +123,6 @@ extern bool RUNNING;
 extern bool startRunTimer;
 extern bool IS_WHITE_LINE; // determines whenther the logic follows a white or black line
 
-extern String MODE;
 extern bool BRAKE;
 extern float targetTime;     // user entered run time in seconds
 extern float targetDistance; // user entered target distance in meters
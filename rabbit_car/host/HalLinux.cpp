@@ -0,0 +1,296 @@
+// HalLinux.cpp
+// Hal.h for the Linux host build, everything is simulated in memory
+#include "HalLinux.h"
+#include "config.h"
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <chrono>
+#include <map>
+#include <vector>
+
+const uint16_t SIM_MAX_LEDS_PER_STRIP = 64;
+
+static unsigned long simMicros = 0;
+
+static uint8_t simLineModule1 = 0;
+static uint8_t simLineModule2 = 0;
+static bool simLineSensorsPresent = true;
+static uint32_t simLineFrames = 0;
+
+static int simPwm[HAL_PWM_COUNT];
+
+static void (*simHallIsr)() = nullptr;
+
+struct SimLedStrip
+{
+  uint16_t count;
+  uint32_t pending[SIM_MAX_LEDS_PER_STRIP]; // halLedSetPixel() target
+  uint32_t shown[SIM_MAX_LEDS_PER_STRIP];   // copied on halLedShow()
+  uint32_t showCount;
+};
+static SimLedStrip simLeds[HAL_LED_STRIP_COUNT];
+
+static bool simBleConnected = false;
+static void (*simBleNotifyHandler)(const uint8_t *data, size_t length) = nullptr;
+static uint32_t simBleNotifyCount = 0;
+static uint16_t simBleMtu = 23; // BLE default
+
+const int SIM_MAX_OPEN_FILES = 2;
+static FILE *simFiles[SIM_MAX_OPEN_FILES];
+static std::string simStorageRoot = ".";
+
+static std::map<std::string, std::vector<uint8_t>> simSettings; // lost when the program exits
+
+unsigned long halMicros()
+{
+  return simMicros;
+}
+
+unsigned long halMillis()
+{
+  return simMicros / 1000;
+}
+
+void halDelay(unsigned long ms)
+{
+  simMicros += ms * 1000;
+}
+
+// Profiling measures real time, not the virtual clock: one "cycle" per nanosecond
+uint32_t halCycleCount()
+{
+  return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+uint32_t halCyclesPerMicro()
+{
+  return 1000;
+}
+
+void halLineSensorsBegin()
+{
+}
+
+// No acquisition in the background: every call is a new frame of the simulated bytes, captured now
+bool halLineSensorsLatest(HalLineFrame *frame)
+{
+  frame->module1 = simLineSensorsPresent ? simLineModule1 : 0;
+  frame->module2 = simLineSensorsPresent ? simLineModule2 : 0;
+  frame->ok = simLineSensorsPresent;
+  frame->captureTime = simMicros;
+  frame->sequence = ++simLineFrames;
+  return true;
+}
+
+void halPwmAttach(HalPwmChannel channel, int pin, int minPulseWidth, int maxPulseWidth)
+{
+}
+
+void halPwmWriteMicros(HalPwmChannel channel, int pulseWidth)
+{
+  if (channel < HAL_PWM_COUNT)
+  {
+    simPwm[channel] = pulseWidth;
+  }
+}
+
+void halHallAttach(int pin, void (*isr)())
+{
+  simHallIsr = isr;
+}
+
+void halLedBegin(HalLedStrip strip, int pin, uint16_t count, uint8_t brightness)
+{
+  if (strip < HAL_LED_STRIP_COUNT)
+  {
+    memset(&simLeds[strip], 0, sizeof(simLeds[strip]));
+    simLeds[strip].count = count < SIM_MAX_LEDS_PER_STRIP ? count : SIM_MAX_LEDS_PER_STRIP;
+  }
+}
+
+void halLedSetPixel(HalLedStrip strip, uint16_t index, uint32_t color)
+{
+  if (strip < HAL_LED_STRIP_COUNT && index < simLeds[strip].count)
+  {
+    simLeds[strip].pending[index] = color;
+  }
+}
+
+void halLedShow(HalLedStrip strip)
+{
+  if (strip < HAL_LED_STRIP_COUNT)
+  {
+    memcpy(simLeds[strip].shown, simLeds[strip].pending, sizeof(simLeds[strip].shown));
+    simLeds[strip].showCount++;
+  }
+}
+
+bool halBleConnected()
+{
+  return simBleConnected;
+}
+
+void halBleNotify(const uint8_t *data, size_t length)
+{
+  simBleNotifyCount++;
+  if (simBleNotifyHandler)
+  {
+    simBleNotifyHandler(data, length);
+  }
+}
+
+size_t halBleMaxNotifySize()
+{
+  return simBleMtu - 3;
+}
+
+void halBleLinkInfo(HalBleLinkInfo *info)
+{
+  info->mtu = simBleMtu;
+  info->phy = HAL_BLE_PHY_1M;
+  info->interval = BLE_CONN_INTERVAL_MAX;
+  info->latency = BLE_CONN_LATENCY;
+  info->supervisionTimeout = BLE_SUPERVISION_TIMEOUT;
+}
+
+bool halStorageBegin()
+{
+  return true;
+}
+
+int halFileOpen(const char *path, HalFileMode mode)
+{
+  for (int i = 0; i < SIM_MAX_OPEN_FILES; i++)
+  {
+    if (!simFiles[i])
+    {
+      std::string fullPath = simStorageRoot + (path[0] == '/' ? "" : "/") + path;
+      simFiles[i] = fopen(fullPath.c_str(), mode == HAL_FILE_WRITE ? "wb" : "rb");
+      return simFiles[i] ? i : -1;
+    }
+  }
+  return -1;
+}
+
+size_t halFileWrite(int file, const uint8_t *data, size_t length)
+{
+  return fwrite(data, 1, length, simFiles[file]);
+}
+
+size_t halFileRead(int file, uint32_t offset, uint8_t *data, size_t length)
+{
+  if (fseek(simFiles[file], offset, SEEK_SET) != 0)
+  {
+    return 0;
+  }
+  return fread(data, 1, length, simFiles[file]);
+}
+
+uint32_t halFileSize(int file)
+{
+  long position = ftell(simFiles[file]);
+  fseek(simFiles[file], 0, SEEK_END);
+  long size = ftell(simFiles[file]);
+  fseek(simFiles[file], position, SEEK_SET);
+  return size;
+}
+
+void halFileClose(int file)
+{
+  fclose(simFiles[file]);
+  simFiles[file] = nullptr;
+}
+
+bool halSettingsRead(const char *key, uint8_t *data, size_t length)
+{
+  auto it = simSettings.find(key);
+  if (it == simSettings.end() || it->second.size() != length)
+  {
+    return false;
+  }
+  memcpy(data, it->second.data(), length);
+  return true;
+}
+
+bool halSettingsWrite(const char *key, const uint8_t *data, size_t length)
+{
+  simSettings[key].assign(data, data + length);
+  return true;
+}
+
+void halSettingsErase(const char *key)
+{
+  simSettings.erase(key);
+}
+
+void halSimSetMicros(unsigned long us)
+{
+  simMicros = us;
+}
+
+void halSimAdvanceMicros(unsigned long us)
+{
+  simMicros += us;
+}
+
+void halSimSetLineSensors(uint8_t module1, uint8_t module2, bool present)
+{
+  simLineModule1 = module1;
+  simLineModule2 = module2;
+  simLineSensorsPresent = present;
+}
+
+void halSimHallEdge()
+{
+  if (simHallIsr)
+  {
+    simHallIsr();
+  }
+}
+
+int halSimPwmMicros(HalPwmChannel channel)
+{
+  return channel < HAL_PWM_COUNT ? simPwm[channel] : 0;
+}
+
+uint32_t halSimLedPixel(HalLedStrip strip, uint16_t index)
+{
+  if (strip >= HAL_LED_STRIP_COUNT || index >= simLeds[strip].count)
+  {
+    return 0;
+  }
+  return simLeds[strip].shown[index];
+}
+
+uint32_t halSimLedShowCount(HalLedStrip strip)
+{
+  return strip < HAL_LED_STRIP_COUNT ? simLeds[strip].showCount : 0;
+}
+
+void halSimSetBleConnected(bool connected)
+{
+  simBleConnected = connected;
+}
+
+void halSimSetBleNotifyHandler(void (*handler)(const uint8_t *data, size_t length))
+{
+  simBleNotifyHandler = handler;
+}
+
+uint32_t halSimBleNotifyCount()
+{
+  return simBleNotifyCount;
+}
+
+void halSimSetBleMtu(uint16_t mtu)
+{
+  simBleMtu = mtu;
+}
+
+void halSimSetStorageRoot(const char *path)
+{
+  simStorageRoot = path;
+}
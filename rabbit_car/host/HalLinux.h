@@ -0,0 +1,35 @@
+// HalLinux.h
+// Simulation side of the Linux HAL: a virtual clock and the car's inputs/outputs, so a host program
+// can drive controlStep()/telemetryStep() and inspect what the control core did
+#ifndef HAL_LINUX_H
+#define HAL_LINUX_H
+
+#include "Hal.h"
+
+// Virtual clock; halDelay() advances it instead of sleeping
+void halSimSetMicros(unsigned long us);
+void halSimAdvanceMicros(unsigned long us);
+
+// Raw line sensor bytes returned by the next halLineSensorsLatest() calls
+void halSimSetLineSensors(uint8_t module1, uint8_t module2, bool present = true);
+
+// Run the hall ISR as if a magnet passed the sensor at the current virtual time
+void halSimHallEdge();
+
+// Last pulse width written to a PWM output, 0 until the first write
+int halSimPwmMicros(HalPwmChannel channel);
+
+// Pixel color as of the last halLedShow() on the strip
+uint32_t halSimLedPixel(HalLedStrip strip, uint16_t index);
+uint32_t halSimLedShowCount(HalLedStrip strip); // halLedShow() calls since halLedBegin()
+
+// BLE link state and notification capture
+void halSimSetBleConnected(bool connected);
+void halSimSetBleNotifyHandler(void (*handler)(const uint8_t *data, size_t length));
+uint32_t halSimBleNotifyCount();
+void halSimSetBleMtu(uint16_t mtu);
+
+// Files are plain files under this directory, the current directory by default
+void halSimSetStorageRoot(const char *path);
+
+#endif
@@ -0,0 +1,96 @@
+// Arduino.cpp
+#include "Arduino.h"
+#include <ctype.h>
+#include <stdarg.h>
+
+HostSerial Serial;
+
+long map(long x, long in_min, long in_max, long out_min, long out_max)
+{
+  return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+
+int String::indexOf(char c, unsigned int from) const
+{
+  size_t index = value_.find(c, from);
+  return index == std::string::npos ? -1 : (int)index;
+}
+
+String String::substring(unsigned int from) const
+{
+  return from < value_.length() ? String(value_.substr(from)) : String();
+}
+
+String String::substring(unsigned int from, unsigned int to) const
+{
+  if (from > to)
+  {
+    std::swap(from, to);
+  }
+  return from < value_.length() ? String(value_.substr(from, to - from)) : String();
+}
+
+bool String::equalsIgnoreCase(const String &other) const
+{
+  if (value_.length() != other.value_.length())
+  {
+    return false;
+  }
+  for (size_t i = 0; i < value_.length(); i++)
+  {
+    if (tolower((unsigned char)value_[i]) != tolower((unsigned char)other.value_[i]))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+size_t HostSerial::write(const uint8_t *data, size_t length)
+{
+  return fwrite(data, 1, length, stdout);
+}
+
+size_t HostSerial::print(const char *value)
+{
+  return fputs(value, stdout) >= 0 ? strlen(value) : 0;
+}
+
+size_t HostSerial::print(int value)
+{
+  return printf("%d", value);
+}
+
+size_t HostSerial::print(unsigned int value)
+{
+  return printf("%u", value);
+}
+
+size_t HostSerial::print(long value)
+{
+  return printf("%ld", value);
+}
+
+size_t HostSerial::print(unsigned long value)
+{
+  return printf("%lu", value);
+}
+
+size_t HostSerial::print(double value, int digits)
+{
+  return printf("%.*f", digits, value);
+}
+
+size_t HostSerial::println()
+{
+  return print("\r\n");
+}
+
+size_t HostSerial::printf(const char *format, ...)
+{
+  va_list args;
+  va_start(args, format);
+  int length = vprintf(format, args);
+  va_end(args);
+  return length > 0 ? length : 0;
+}
@@ -0,0 +1,94 @@
+// Arduino.h
+// Minimal Arduino core for the host build: only what the control core uses (String, Serial,
+// constrain/map and friends). Time, I/O and peripherals go through Hal.h instead.
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <string>
+
+#define IRAM_ATTR
+#define PI 3.1415926535897932384626433832795
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+typedef uint8_t byte;
+
+using std::abs;
+using std::max;
+using std::min;
+
+long map(long x, long in_min, long in_max, long out_min, long out_max);
+
+// Arduino String backed by std::string
+class String
+{
+public:
+  String(const char *value = "") : value_(value ? value : "") {}
+  String(const std::string &value) : value_(value) {}
+  explicit String(int value) : value_(std::to_string(value)) {}
+
+  const char *c_str() const { return value_.c_str(); }
+  unsigned int length() const { return value_.length(); }
+  bool isEmpty() const { return value_.empty(); }
+  char charAt(unsigned int index) const { return index < value_.length() ? value_[index] : 0; }
+
+  int indexOf(char c, unsigned int from = 0) const;
+  String substring(unsigned int from) const;
+  String substring(unsigned int from, unsigned int to) const;
+  long toInt() const { return atol(value_.c_str()); }
+  float toFloat() const { return atof(value_.c_str()); }
+  bool equalsIgnoreCase(const String &other) const;
+
+  bool operator==(const String &other) const { return value_ == other.value_; }
+  bool operator==(const char *other) const { return value_ == other; }
+  bool operator!=(const String &other) const { return value_ != other.value_; }
+  String &operator+=(const String &other)
+  {
+    value_ += other.value_;
+    return *this;
+  }
+  friend String operator+(const String &a, const String &b) { return String(a.value_ + b.value_); }
+  friend String operator+(const String &a, const char *b) { return String(a.value_ + b); }
+
+private:
+  std::string value_;
+};
+
+// Serial port on stdout
+class HostSerial
+{
+public:
+  void begin(unsigned long) {}
+  void setTxBufferSize(size_t) {}
+  int availableForWrite() { return 4096; } // stdout never blocks the logger
+
+  size_t write(const uint8_t *data, size_t length);
+  size_t print(const char *value);
+  size_t print(const String &value) { return print(value.c_str()); }
+  size_t print(int value);
+  size_t print(unsigned int value);
+  size_t print(long value);
+  size_t print(unsigned long value);
+  size_t print(double value, int digits = 2);
+  size_t println();
+
+  template <typename T>
+  size_t println(T value)
+  {
+    size_t length = print(value);
+    return length + println();
+  }
+
+  size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+extern HostSerial Serial;
+
+#endif
@@ -0,0 +1,272 @@
+// firmware_bench.cpp
+// Host benchmarks of the per-tick firmware hot paths, built against the Linux HAL (see Hal.h).
+// Every benchmark cycles through fixed inputs, so results only move when the code does.
+//
+// Built by host/CMakeLists.txt when Google Benchmark is installed; `cmake --build build --target bench`
+// runs it and writes build/firmware_bench.json, or run it by hand:
+//   ./firmware_bench --benchmark_out=firmware_bench.json --benchmark_out_format=json
+
+#include <benchmark/benchmark.h>
+#include <vector>
+
+#include "HalLinux.h"
+#include "RunControl.h"
+#include "Commands.h"
+#include "Telemetry.h"
+#include "IRHandler.h"
+#include "ServoHandler.h"
+#include "ESCHandler.h"
+#include "HSHandler.h"
+
+const unsigned long CONTROL_PERIOD_US = 1000000 / CONTROL_LOOP_HZ;
+
+// Line sensor readings: a 2-3 sensor wide line at every position, then noisy patterns that
+// isValidLinePattern() rejects (two lines, a gap, everything lit, nothing lit)
+struct LineInput
+{
+  uint8_t module1, module2;
+};
+
+static std::vector<LineInput> makeLineInputs()
+{
+  std::vector<LineInput> inputs;
+  for (int first = 0; first < IR_SENSOR_COUNT - 2; first++)
+  {
+    uint16_t mask = (first % 2 ? 0xE000 : 0xC000) >> first;
+    // Black line: a sensor on the line reads 0
+    inputs.push_back({(uint8_t)~(mask >> 8), (uint8_t)~mask});
+  }
+  const uint16_t noisy[] = {0x8001, 0x0C30, 0xFFFF, 0x0000, 0x1818, 0xA000};
+  for (uint16_t mask : noisy)
+  {
+    inputs.push_back({(uint8_t)~(mask >> 8), (uint8_t)~mask});
+  }
+  return inputs;
+}
+
+static const std::vector<LineInput> LINE_INPUTS = makeLineInputs();
+
+static void setLine(size_t i)
+{
+  const LineInput &input = LINE_INPUTS[i % LINE_INPUTS.size()];
+  halSimSetLineSensors(input.module1, input.module2);
+}
+
+// Speed PID inputs in m/s, accelerating, cruising, overshooting and braking
+static const float SPEEDS[] = {0.0, 0.4, 1.1, 1.9, 2.4, 2.6, 2.5, 2.2, 1.5, 0.8};
+static const size_t SPEED_COUNT = sizeof(SPEEDS) / sizeof(SPEEDS[0]);
+
+static const char *const TIME_STRINGS[] = {"12.5", "3:45.25", "1:02:03.5", "0:59", "90"};
+static const size_t TIME_STRING_COUNT = sizeof(TIME_STRINGS) / sizeof(TIME_STRINGS[0]);
+
+// ---- Line sensors ----
+// The decoders read the mask of the last readIRSensors(), so they are timed together with the
+// read; subtract BM_ReadIRSensors for the decode alone (pausing the timer costs more than it)
+
+static void BM_ReadIRSensors(benchmark::State &state)
+{
+  size_t i = 0;
+  for (auto _ : state)
+  {
+    setLine(i++);
+    readIRSensors();
+    benchmark::DoNotOptimize(getSensorMask());
+  }
+}
+BENCHMARK(BM_ReadIRSensors);
+
+static void BM_GetPosition(benchmark::State &state)
+{
+  size_t i = 0;
+  for (auto _ : state)
+  {
+    setLine(i++);
+    readIRSensors();
+    benchmark::DoNotOptimize(getPosition());
+  }
+}
+BENCHMARK(BM_GetPosition);
+
+static void BM_IsValidLinePattern(benchmark::State &state)
+{
+  size_t i = 0;
+  for (auto _ : state)
+  {
+    setLine(i++);
+    readIRSensors();
+    benchmark::DoNotOptimize(isValidLinePattern());
+  }
+}
+BENCHMARK(BM_IsValidLinePattern);
+
+// ---- Control ----
+
+// Sensor read, position and PID math, servo write
+static void BM_SteerServoByPID(benchmark::State &state)
+{
+  resetSteeringPID();
+  size_t i = 0;
+  for (auto _ : state)
+  {
+    setLine(i++);
+    halSimAdvanceMicros(CONTROL_PERIOD_US);
+    steerServoByPID();
+  }
+}
+BENCHMARK(BM_SteerServoByPID);
+
+static void BM_AdjustMotorSpeedPID(benchmark::State &state)
+{
+  resetPID();
+  size_t i = 0;
+  for (auto _ : state)
+  {
+    halSimAdvanceMicros(unitCast<Microseconds>(SPEED_PID_INTERVAL).count());
+    adjustMotorSpeedPID(SPEEDS[i++ % SPEED_COUNT], 2.0);
+  }
+}
+BENCHMARK(BM_AdjustMotorSpeedPID);
+
+// A whole control period of a TEMPO run, hall edges every 5th period (~1.6 m/s)
+static void BM_ControlStep(benchmark::State &state)
+{
+  halSimSetBleConnected(false);
+  uint8_t start[CMD_RUNNING_SIZE] = {CMD_RUNNING, RUN_FLAG_RUNNING | RUN_FLAG_HAS_PACE | RUN_FLAG_HAS_TIME, RUN_MODE_TEMPO};
+  putU32LE(start + 7, 0x49742400);  // 1e6 s, the run never ends
+  putU32LE(start + 11, 0x40000000); // 2.0 m/s
+  handleCommand(start, sizeof(start));
+
+  size_t i = 0;
+  for (auto _ : state)
+  {
+    setLine(i);
+    if (i % 5 == 0)
+    {
+      halSimHallEdge();
+    }
+    i++;
+    halSimAdvanceMicros(CONTROL_PERIOD_US);
+    controlStep();
+  }
+
+  uint8_t stop[CMD_RUNNING_SIZE] = {CMD_RUNNING, 0, RUN_MODE_UNCHANGED};
+  handleCommand(stop, sizeof(stop));
+  controlStep();
+}
+BENCHMARK(BM_ControlStep);
+
+// ---- Conversions ----
+
+static void BM_MicrosToS(benchmark::State &state)
+{
+  unsigned long us = 0;
+  for (auto _ : state)
+  {
+    benchmark::DoNotOptimize(micros_to_s(us));
+    us += CONTROL_PERIOD_US;
+  }
+}
+BENCHMARK(BM_MicrosToS);
+
+static void BM_SpeedConversions(benchmark::State &state)
+{
+  size_t i = 0;
+  for (auto _ : state)
+  {
+    float speed = SPEEDS[i++ % SPEED_COUNT];
+    benchmark::DoNotOptimize(mps_to_kmh(speed));
+    benchmark::DoNotOptimize(mps_to_miph(speed));
+  }
+}
+BENCHMARK(BM_SpeedConversions);
+
+static void BM_TimeStrToS(benchmark::State &state)
+{
+  std::vector<String> inputs(TIME_STRINGS, TIME_STRINGS + TIME_STRING_COUNT);
+  size_t i = 0;
+  for (auto _ : state)
+  {
+    benchmark::DoNotOptimize(time_str_to_s(inputs[i++ % TIME_STRING_COUNT]));
+  }
+}
+BENCHMARK(BM_TimeStrToS);
+
+// ---- Telemetry and commands ----
+
+static void BM_EncodeTelemetryFrame(benchmark::State &state)
+{
+  TelemetrySample sample = {123.456, 61.5, 2.01, 2.05, 91.25};
+  uint8_t frame[TELEMETRY_FRAME_SIZE];
+  uint16_t seq = 0;
+  for (auto _ : state)
+  {
+    benchmark::DoNotOptimize(encodeTelemetryFrame(frame, seq++, 1234, sample, 0));
+    benchmark::ClobberMemory();
+  }
+}
+BENCHMARK(BM_EncodeTelemetryFrame);
+
+// A full batch, what one notification carries at BLE_LOCAL_MTU
+static void BM_EncodeTelemetryBatch(benchmark::State &state)
+{
+  TimedSample samples[TELEMETRY_BATCH_MAX_SAMPLES];
+  for (uint8_t i = 0; i < TELEMETRY_BATCH_MAX_SAMPLES; i++)
+  {
+    samples[i] = {1234 + i * 10u, {123.456f + i * 0.01f, 61.5f, 2.01f, 2.05f, 91.25f}};
+  }
+  uint8_t frame[TELEMETRY_BATCH_HEADER_SIZE + TELEMETRY_BATCH_MAX_SAMPLES * TELEMETRY_BATCH_SAMPLE_SIZE];
+  uint16_t seq = 0;
+  for (auto _ : state)
+  {
+    benchmark::DoNotOptimize(encodeTelemetryBatch(frame, seq++, samples, TELEMETRY_BATCH_MAX_SAMPLES));
+    benchmark::ClobberMemory();
+  }
+}
+BENCHMARK(BM_EncodeTelemetryBatch);
+
+// Rate limit bypassed, so every call encodes and notifies
+static void BM_BroadcastDTPS(benchmark::State &state)
+{
+  halSimSetBleConnected(true);
+  for (auto _ : state)
+  {
+    bleBroadcastDTPS(123.456, 61.5, 2.01, 2.05, 91.25, true);
+  }
+  halSimSetBleConnected(false);
+}
+BENCHMARK(BM_BroadcastDTPS);
+
+// Decode, queue and apply: the BLE task's and the control task's share of a command.
+// Movement takes the latest-wins slot, with a sequence number like the web app sends
+static void BM_HandleMovementCommand(benchmark::State &state)
+{
+  uint8_t command[CMD_MOVEMENT_SEQ_SIZE] = {CMD_MOVEMENT};
+  size_t i = 0;
+  for (auto _ : state)
+  {
+    putU16LE(command + 1, 9000 + (i % 16) * 100);
+    putU16LE(command + 3, 1500 + (i % 16) * 10);
+    putU16LE(command + 5, (uint16_t)(i + 1));
+    i++;
+    handleCommand(command, sizeof(command));
+    applyPendingCommands();
+  }
+}
+BENCHMARK(BM_HandleMovementCommand);
+
+static void BM_HandleRunningCommand(benchmark::State &state)
+{
+  uint8_t command[CMD_RUNNING_SIZE + CMD_RUNNING_GAINS_SIZE] = {CMD_RUNNING, RUN_FLAG_HAS_GAINS | RUN_FLAG_HAS_PACE, RUN_MODE_TEMPO};
+  for (size_t i = 0; i < 9; i++)
+  {
+    putU32LE(command + CMD_RUNNING_SIZE + i * 4, 0x3F800000); // 1.0
+  }
+  for (auto _ : state)
+  {
+    handleCommand(command, sizeof(command));
+    applyPendingCommands();
+  }
+}
+BENCHMARK(BM_HandleRunningCommand);
+
+BENCHMARK_MAIN();
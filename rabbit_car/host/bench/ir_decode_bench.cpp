@@ -0,0 +1,159 @@
+// ir_decode_bench.cpp
+// Host micro-benchmark: table driven line decoding (IRDecode.h) vs the original per-sensor scan
+//
+// Build and run from this directory:
+//   g++ -O2 -std=c++17 -I../.. ir_decode_bench.cpp -o ir_decode_bench && ./ir_decode_bench
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "IRDecode.h"
+
+// ---- Original scan implementation (IRHandler.cpp before the lookup tables) ----
+
+static int sensorValues[IR_SENSOR_COUNT];
+static int scanLinePosition = 0;
+
+static void scanUnpack(uint8_t data1, uint8_t data2, bool isWhiteLine)
+{
+  for (int i = 0; i < 8; i++)
+  {
+    sensorValues[i] = ((data1 >> (7 - i)) & 0x01) ^ (!isWhiteLine);
+  }
+  for (int i = 0; i < 8; i++)
+  {
+    sensorValues[i + 8] = ((data2 >> (7 - i)) & 0x01) ^ (!isWhiteLine);
+  }
+}
+
+static int scanGetPosition()
+{
+  int sum = 0;
+  int weightedSum = 0;
+  for (int i = 0; i < IR_SENSOR_COUNT; i++)
+  {
+    if (sensorValues[i] == 1)
+    {
+      weightedSum += i * 1000;
+      sum += 1;
+    }
+  }
+  if (sum > 0)
+  {
+    scanLinePosition = weightedSum / sum;
+  }
+  return scanLinePosition;
+}
+
+static bool scanIsValidLinePattern()
+{
+  int activeSensors = 0;
+  int firstActive = -1, lastActive = -1;
+  for (int i = 0; i < IR_SENSOR_COUNT; i++)
+  {
+    if (sensorValues[i] == 1)
+    {
+      activeSensors++;
+      if (firstActive == -1)
+        firstActive = i;
+      lastActive = i;
+    }
+  }
+  int lineWidth = lastActive - firstActive + 1;
+  bool normalWidth = (activeSensors >= 2 && activeSensors <= 8);
+  bool normalSpan = (lineWidth >= 2 && lineWidth <= 8);
+  return normalWidth && normalSpan;
+}
+
+static bool scanIsOnLine()
+{
+  for (int i = 0; i < IR_SENSOR_COUNT; i++)
+  {
+    if (sensorValues[i] == 1)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+// ---- Benchmark ----
+
+// Keeps the optimizer from discarding results
+static volatile int sink;
+
+template <typename F>
+static double nsPerFrame(const std::vector<uint16_t> &frames, int repeats, F decode)
+{
+  auto start = std::chrono::steady_clock::now();
+  int acc = 0;
+  for (int r = 0; r < repeats; r++)
+  {
+    for (uint16_t frame : frames)
+    {
+      acc += decode(frame);
+    }
+  }
+  auto end = std::chrono::steady_clock::now();
+  sink = acc;
+  double ns = std::chrono::duration<double, std::nano>(end - start).count();
+  return ns / ((double)frames.size() * repeats);
+}
+
+int main()
+{
+  // Check both implementations agree on every possible frame and line colour
+  int lastPosition = 0;
+  for (int whiteLine = 0; whiteLine < 2; whiteLine++)
+  {
+    for (int raw = 0; raw < 0x10000; raw++)
+    {
+      scanUnpack(raw >> 8, raw & 0xFF, whiteLine);
+      uint16_t mask = irMaskFromModules(raw >> 8, raw & 0xFF, whiteLine);
+      lastPosition = irPosition(mask, lastPosition);
+      if (scanGetPosition() != lastPosition || scanIsValidLinePattern() != irIsValidLinePattern(mask) ||
+          scanIsOnLine() != (mask != 0))
+      {
+        std::printf("MISMATCH raw=0x%04x whiteLine=%d\n", raw, whiteLine);
+        return 1;
+      }
+    }
+  }
+  std::printf("Table decode matches scan decode for all 65536 frames\n");
+
+  // Fixed pseudo-random mix of realistic line frames (2-5 adjacent sensors) and arbitrary noise frames
+  std::vector<uint16_t> frames;
+  srand(12345);
+  for (int i = 0; i < 4096; i++)
+  {
+    if (i % 4 == 3)
+    {
+      frames.push_back(rand() & 0xFFFF);
+    }
+    else
+    {
+      int width = 2 + rand() % 4;
+      int start = rand() % (IR_SENSOR_COUNT - width + 1);
+      frames.push_back(((1u << width) - 1) << start);
+    }
+  }
+
+  const int repeats = 2000;
+  double scan = nsPerFrame(frames, repeats, [](uint16_t frame) {
+    scanUnpack(frame >> 8, frame & 0xFF, true);
+    return scanGetPosition() + scanIsValidLinePattern() + scanIsOnLine();
+  });
+  int position = 0;
+  double table = nsPerFrame(frames, repeats, [&position](uint16_t frame) {
+    uint16_t mask = irMaskFromModules(frame >> 8, frame & 0xFF, true);
+    position = irPosition(mask, position);
+    return position + irIsValidLinePattern(mask) + (mask != 0);
+  });
+
+  std::printf("unpack + getPosition + isValidLinePattern + isOnLine, %zu frames x %d\n", frames.size(), repeats);
+  std::printf("  scan:  %7.2f ns/frame\n", scan);
+  std::printf("  table: %7.2f ns/frame (%.1fx)\n", table, scan / table);
+  return 0;
+}
@@ -0,0 +1,400 @@
+// rabbit_replay.cpp
+// Replays a recorded trace of line sensor bytes, hall edges and BLE commands through the unchanged
+// control core on the Linux HAL's virtual clock, with the firmware's task timing: controlStep() every
+// control period, telemetryStep() every telemetry period. The actuator outputs depend only on the
+// trace, so two replays of one trace match bit for bit and a saved output works as a golden file.
+//
+//   rabbit_replay trace.txt                  print the outputs
+//   rabbit_replay trace.txt -o golden.txt    save them
+//   rabbit_replay trace.txt --golden golden.txt
+//                                            compare with a saved run, exit status 1 on the first difference
+//
+// Trace format: one event per line, "#" starts a comment, times are us since the start of the trace
+// and never decrease. Events at a time are applied before the control period that starts at it.
+//
+//   <t> ir <module1> <module2>   raw line sensor bytes (hex), held until the next ir event
+//   <t> hall                     a hall sensor edge
+//   <t> cmd <byte> <byte> ...    a write to the control characteristic (hex), see Commands.h
+//   <t> ble connect|disconnect   BLE link state, starts disconnected
+//   <t> end                      stop the replay at t, otherwise it runs 5 s past the last event
+//
+// Output: the time and outputs of every control period whose outputs differ from the previous one
+//
+//   <t> <ESC pulse width us> <servo pulse width us> <run state>
+//
+// Firmware log output goes to stderr, so stdout only holds the outputs.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "HalLinux.h"
+#include "RunControl.h"
+#include "Commands.h"
+#include "ESCHandler.h"
+#include "ServoHandler.h"
+#include "IRHandler.h"
+#include "HSHandler.h"
+#include "Lights.h"
+#include "ThrottleCalibration.h"
+
+const unsigned long CONTROL_PERIOD_US = 1000000 / CONTROL_LOOP_HZ;
+const unsigned long TELEMETRY_PERIOD_US = 1000000 / TELEMETRY_TASK_HZ;
+const unsigned long DEFAULT_TAIL_US = 5000000; // replayed after the last event when there is no end event
+
+enum EventType
+{
+  EVENT_IR,
+  EVENT_HALL,
+  EVENT_CMD,
+  EVENT_BLE,
+  EVENT_END,
+};
+
+struct Event
+{
+  unsigned long time;
+  EventType type;
+  std::vector<uint8_t> data; // ir: the two module bytes, cmd: the write, ble: 1 = connected
+};
+
+static bool parseHexBytes(char *tokens, std::vector<uint8_t> *bytes)
+{
+  for (char *token = strtok(tokens, " \t"); token; token = strtok(NULL, " \t"))
+  {
+    char *end;
+    unsigned long value = strtoul(token, &end, 16);
+    if (*end != '\0' || value > 0xFF)
+    {
+      return false;
+    }
+    bytes->push_back((uint8_t)value);
+  }
+  return true;
+}
+
+static bool parseEvent(char *line, Event *event)
+{
+  char *hash = strchr(line, '#');
+  if (hash)
+  {
+    *hash = '\0';
+  }
+  line[strcspn(line, "\r\n")] = '\0';
+
+  char *timeToken = strtok(line, " \t");
+  char *typeToken = strtok(NULL, " \t");
+  if (!timeToken || !typeToken)
+  {
+    return false;
+  }
+  char *end;
+  event->time = strtoul(timeToken, &end, 10);
+  if (*end != '\0')
+  {
+    return false;
+  }
+
+  char *rest = strtok(NULL, "");
+  char empty[] = "";
+  rest = rest ? rest : empty;
+
+  if (strcmp(typeToken, "ir") == 0)
+  {
+    event->type = EVENT_IR;
+    return parseHexBytes(rest, &event->data) && event->data.size() == 2;
+  }
+  if (strcmp(typeToken, "hall") == 0)
+  {
+    event->type = EVENT_HALL;
+    return true;
+  }
+  if (strcmp(typeToken, "cmd") == 0)
+  {
+    event->type = EVENT_CMD;
+    return parseHexBytes(rest, &event->data) && !event->data.empty();
+  }
+  if (strcmp(typeToken, "ble") == 0)
+  {
+    event->type = EVENT_BLE;
+    char *state = strtok(rest, " \t");
+    if (!state || (strcmp(state, "connect") != 0 && strcmp(state, "disconnect") != 0))
+    {
+      return false;
+    }
+    event->data.push_back(strcmp(state, "connect") == 0);
+    return true;
+  }
+  if (strcmp(typeToken, "end") == 0)
+  {
+    event->type = EVENT_END;
+    return true;
+  }
+  return false;
+}
+
+static bool loadTrace(const char *path, std::vector<Event> *events)
+{
+  FILE *file = fopen(path, "r");
+  if (!file)
+  {
+    fprintf(stderr, "%s: cannot open\n", path);
+    return false;
+  }
+
+  char line[4096];
+  int lineNumber = 0;
+  unsigned long lastTime = 0;
+  while (fgets(line, sizeof(line), file))
+  {
+    lineNumber++;
+    if (line[strspn(line, " \t\r\n")] == '\0' || line[strspn(line, " \t")] == '#')
+    {
+      continue;
+    }
+
+    Event event;
+    if (!parseEvent(line, &event))
+    {
+      fprintf(stderr, "%s:%d: bad event\n", path, lineNumber);
+      fclose(file);
+      return false;
+    }
+    if (event.time < lastTime)
+    {
+      fprintf(stderr, "%s:%d: time goes backwards\n", path, lineNumber);
+      fclose(file);
+      return false;
+    }
+    lastTime = event.time;
+    events->push_back(event);
+  }
+  fclose(file);
+  return true;
+}
+
+// Replay state
+static unsigned long clockBase = 0; // halMicros() at trace time 0, after the firmware setup delays
+static unsigned long nextControlTime = CONTROL_PERIOD_US;
+static unsigned long nextTelemetryTime = TELEMETRY_PERIOD_US;
+static int lastEsc = -1, lastServo = -1, lastState = -1;
+static std::vector<std::string> outputs;
+
+static void setTraceTime(unsigned long time)
+{
+  halSimSetMicros(clockBase + time);
+}
+
+static void controlPeriod()
+{
+  setTraceTime(nextControlTime);
+  controlStep();
+  if (nextControlTime >= nextTelemetryTime)
+  {
+    telemetryStep();
+    nextTelemetryTime += TELEMETRY_PERIOD_US;
+  }
+
+  int esc = halSimPwmMicros(HAL_PWM_ESC);
+  int servo = halSimPwmMicros(HAL_PWM_SERVO);
+  int state = runState;
+  if (esc != lastEsc || servo != lastServo || state != lastState)
+  {
+    char line[64];
+    snprintf(line, sizeof(line), "%lu %d %d %s", nextControlTime, esc, servo, RUN_STATE_NAMES[state]);
+    outputs.push_back(line);
+    lastEsc = esc;
+    lastServo = servo;
+    lastState = state;
+  }
+  nextControlTime += CONTROL_PERIOD_US;
+}
+
+static void applyEvent(const Event &event)
+{
+  setTraceTime(event.time);
+  switch (event.type)
+  {
+  case EVENT_IR:
+    halSimSetLineSensors(event.data[0], event.data[1]);
+    break;
+  case EVENT_HALL:
+    halSimHallEdge();
+    break;
+  case EVENT_CMD:
+    if (!handleCommand(event.data.data(), event.data.size()))
+    {
+      fprintf(stderr, "%lu: command 0x%02X rejected\n", event.time, event.data[0]);
+    }
+    break;
+  case EVENT_BLE:
+    halSimSetBleConnected(event.data[0]);
+    if (!event.data[0])
+    {
+      postDisconnect();
+    }
+    break;
+  case EVENT_END:
+    break;
+  }
+}
+
+static unsigned long replay(const std::vector<Event> &events)
+{
+  // The car's setup() order, minus the BLE stack and storage
+  setupESC();
+  throttleSetup();
+  setupServo();
+  setupHS();
+  irSetup();
+  setupLights();
+  clockBase = halMicros();
+
+  unsigned long endTime = events.empty() ? DEFAULT_TAIL_US : events.back().time + DEFAULT_TAIL_US;
+  for (const Event &event : events)
+  {
+    if (event.type == EVENT_END)
+    {
+      endTime = event.time;
+      break;
+    }
+    while (nextControlTime < event.time)
+    {
+      controlPeriod();
+    }
+    applyEvent(event);
+  }
+  while (nextControlTime <= endTime)
+  {
+    controlPeriod();
+  }
+  return endTime;
+}
+
+// First difference with the golden file, 0 if they match
+static int compareGolden(const char *path)
+{
+  FILE *file = fopen(path, "r");
+  if (!file)
+  {
+    fprintf(stderr, "%s: cannot open\n", path);
+    return 2;
+  }
+
+  char line[256];
+  size_t index = 0;
+  int result = 0;
+  while (fgets(line, sizeof(line), file))
+  {
+    line[strcspn(line, "\r\n")] = '\0';
+    if (index >= outputs.size())
+    {
+      fprintf(stderr, "%s:%zu: golden has more output: %s\n", path, index + 1, line);
+      result = 1;
+      break;
+    }
+    if (outputs[index] != line)
+    {
+      fprintf(stderr, "%s:%zu: expected \"%s\", replay gave \"%s\"\n", path, index + 1, line, outputs[index].c_str());
+      result = 1;
+      break;
+    }
+    index++;
+  }
+  if (result == 0 && index < outputs.size())
+  {
+    fprintf(stderr, "%s:%zu: replay has more output: %s\n", path, index + 1, outputs[index].c_str());
+    result = 1;
+  }
+  fclose(file);
+  return result;
+}
+
+int main(int argc, char **argv)
+{
+  const char *tracePath = NULL;
+  const char *outputPath = NULL;
+  const char *goldenPath = NULL;
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+    {
+      outputPath = argv[++i];
+    }
+    else if (strcmp(argv[i], "--golden") == 0 && i + 1 < argc)
+    {
+      goldenPath = argv[++i];
+    }
+    else if (!tracePath && argv[i][0] != '-')
+    {
+      tracePath = argv[i];
+    }
+    else
+    {
+      tracePath = NULL;
+      break;
+    }
+  }
+  if (!tracePath)
+  {
+    fprintf(stderr, "usage: %s trace.txt [-o output.txt] [--golden golden.txt]\n", argv[0]);
+    return 2;
+  }
+
+  std::vector<Event> events;
+  if (!loadTrace(tracePath, &events))
+  {
+    return 2;
+  }
+
+  // Serial (the firmware's log output) writes to stdout, send it to stderr instead
+  fflush(stdout);
+  FILE *out = fdopen(dup(STDOUT_FILENO), "w");
+  dup2(STDERR_FILENO, STDOUT_FILENO);
+
+  auto wallStart = std::chrono::steady_clock::now();
+  unsigned long endTime = replay(events);
+  double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+  fflush(stdout);
+  fprintf(stderr, "Replayed %.2f s of trace in %.3f s (%.0fx real time), %zu output changes\n",
+          micros_to_s(endTime), wallSeconds, micros_to_s(endTime) / wallSeconds, outputs.size());
+
+  if (outputPath)
+  {
+    FILE *file = fopen(outputPath, "w");
+    if (!file)
+    {
+      fprintf(stderr, "%s: cannot open\n", outputPath);
+      return 2;
+    }
+    for (const std::string &line : outputs)
+    {
+      fprintf(file, "%s\n", line.c_str());
+    }
+    fclose(file);
+  }
+
+  if (goldenPath)
+  {
+    int result = compareGolden(goldenPath);
+    if (result == 0)
+    {
+      fprintf(stderr, "Outputs match %s\n", goldenPath);
+    }
+    return result;
+  }
+
+  if (!outputPath)
+  {
+    for (const std::string &line : outputs)
+    {
+      fprintf(out, "%s\n", line.c_str());
+    }
+  }
+  fclose(out);
+  return 0;
+}
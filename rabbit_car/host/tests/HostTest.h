@@ -0,0 +1,57 @@
+// HostTest.h
+// Checks for the host tests: every test is a program that ctest runs (see host/CMakeLists.txt), a
+// failed check prints where it failed and the program exits with 1 from hostTestResult()
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+#include <cmath>
+#include <cstdio>
+
+static int hostTestFailures = 0;
+
+#define CHECK(condition)                                                      \
+  do                                                                          \
+  {                                                                           \
+    if (!(condition))                                                         \
+    {                                                                         \
+      std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+      hostTestFailures++;                                                     \
+    }                                                                         \
+  } while (0)
+
+#define CHECK_EQ(actual, expected)                                                            \
+  do                                                                                          \
+  {                                                                                           \
+    long long actualValue = (long long)(actual), expectedValue = (long long)(expected);       \
+    if (actualValue != expectedValue)                                                         \
+    {                                                                                         \
+      std::printf("%s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__, #actual, actualValue, \
+                  expectedValue);                                                             \
+      hostTestFailures++;                                                                     \
+    }                                                                                         \
+  } while (0)
+
+#define CHECK_NEAR(actual, expected, tolerance)                                                    \
+  do                                                                                               \
+  {                                                                                                \
+    double actualValue = (actual), expectedValue = (expected);                                     \
+    if (!(std::fabs(actualValue - expectedValue) <= (tolerance)))                                  \
+    {                                                                                              \
+      std::printf("%s:%d: %s is %g, expected %g +- %g\n", __FILE__, __LINE__, #actual, actualValue, \
+                  expectedValue, (double)(tolerance));                                             \
+      hostTestFailures++;                                                                          \
+    }                                                                                              \
+  } while (0)
+
+// Return value of main()
+inline int hostTestResult()
+{
+  if (hostTestFailures > 0)
+  {
+    std::printf("%d checks failed\n", hostTestFailures);
+    return 1;
+  }
+  return 0;
+}
+
+#endif
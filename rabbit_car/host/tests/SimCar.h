@@ -0,0 +1,86 @@
+// SimCar.h
+// Simulated car for the closed loop host tests: the wheel speed follows the ESC pulse width with a first
+// order response whose steady state and time constant differ from the firmware's motor model, and hall
+// edges fire at the true distance. The firmware runs with its own task timing on the virtual clock
+#ifndef SIM_CAR_H
+#define SIM_CAR_H
+
+#include "HalLinux.h"
+#include "RunControl.h"
+#include "ESCHandler.h"
+#include "ServoHandler.h"
+#include "HSHandler.h"
+#include "IRHandler.h"
+#include "config.h"
+
+const unsigned long SIM_STEP_US = 100; // plant integration step
+const unsigned long SIM_CONTROL_PERIOD_US = 1000000 / CONTROL_LOOP_HZ;
+const int SIM_TELEMETRY_DIVIDER = CONTROL_LOOP_HZ / TELEMETRY_TASK_HZ;
+
+struct SimCar
+{
+  double (*steadySpeed)(int pulseWidth); // m/s the car settles at for an ESC pulse width
+  double timeConstant;                   // s
+  double distancePerPulse;               // m of true travel per hall edge
+  double speed;                          // m/s, true
+  double distance;                       // m, true
+  long pulses;
+  long periods;
+  void (*beforeControl)(const SimCar *car); // optional, e.g. sets the line sensors for the true distance
+};
+
+// Linear with a deadband, faster and slower than the default motor model at the two ends of the range
+inline double simLinearSpeed(int pulseWidth)
+{
+  return pulseWidth > 1530 ? (pulseWidth - 1530) * 0.025 : 0.0;
+}
+
+inline SimCar simCarCreate(double (*steadySpeed)(int), double timeConstant)
+{
+  SimCar car = {};
+  car.steadySpeed = steadySpeed;
+  car.timeConstant = timeConstant;
+  car.distancePerPulse = DISTANCE_PER_PULSE.count();
+  return car;
+}
+
+// The firmware's setup() for the control core, with the car on a centered line
+inline void simFirmwareSetup()
+{
+  logSetup();
+  logSetLevelAll(LOG_LEVEL_ERROR);
+  setupESC();
+  setupServo();
+  setupHS();
+  irSetup();
+  halSimSetLineSensors(0x01, 0x80);
+}
+
+// One control period: the plant under the last ESC output, then controlStep(), and telemetryStep() at
+// the telemetry task's rate
+inline void simCarPeriod(SimCar *car)
+{
+  for (unsigned long t = 0; t < SIM_CONTROL_PERIOD_US; t += SIM_STEP_US)
+  {
+    halSimAdvanceMicros(SIM_STEP_US);
+    double dt = SIM_STEP_US * 1e-6;
+    car->speed += (car->steadySpeed(halSimPwmMicros(HAL_PWM_ESC)) - car->speed) * dt / car->timeConstant;
+    car->distance += car->speed * dt;
+    while (car->distance >= (car->pulses + 1) * car->distancePerPulse)
+    {
+      halSimHallEdge();
+      car->pulses++;
+    }
+  }
+  if (car->beforeControl)
+  {
+    car->beforeControl(car);
+  }
+  controlStep();
+  if (car->periods++ % SIM_TELEMETRY_DIVIDER == 0)
+  {
+    telemetryStep();
+  }
+}
+
+#endif
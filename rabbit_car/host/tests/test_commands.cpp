@@ -0,0 +1,252 @@
+// test_commands.cpp
+// Binary command parsing (Commands.h): malformed writes are rejected, decoded commands only change
+// the control state in applyPendingCommands(), a full mailbox refuses commands until drained, a
+// disconnect is applied in order with the commands around it, and numbered moves older than the newest
+// are dropped without using the mailbox
+
+#include "HostTest.h"
+#include "HalLinux.h"
+#include "Commands.h"
+#include "Telemetry.h"
+#include "PacePlan.h"
+#include "ESCHandler.h"
+#include "ServoHandler.h"
+#include <cstring>
+
+static void putF32LE(uint8_t *buf, float value)
+{
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  putU32LE(buf, bits);
+}
+
+static bool sendMovement(uint16_t angle, uint16_t motorSpeed)
+{
+  uint8_t command[CMD_MOVEMENT_SIZE] = {CMD_MOVEMENT};
+  putU16LE(command + 1, angle);
+  putU16LE(command + 3, motorSpeed);
+  return handleCommand(command, sizeof(command));
+}
+
+static bool sendMovementSeq(uint16_t angle, uint16_t motorSpeed, uint16_t seq)
+{
+  uint8_t command[CMD_MOVEMENT_SEQ_SIZE] = {CMD_MOVEMENT};
+  putU16LE(command + 1, angle);
+  putU16LE(command + 3, motorSpeed);
+  putU16LE(command + 5, seq);
+  return handleCommand(command, sizeof(command));
+}
+
+static bool sendManualControl(bool enabled)
+{
+  uint8_t command[2] = {CMD_MANUAL_CONTROL, enabled};
+  return handleCommand(command, sizeof(command));
+}
+
+static void testMalformed()
+{
+  uint8_t command[CMD_RUNNING_SIZE + CMD_RUNNING_GAINS_SIZE] = {};
+
+  CHECK(!handleCommand(command, 0));
+  command[0] = 0x7F;
+  CHECK(!handleCommand(command, 2));
+
+  command[0] = CMD_MOVEMENT;
+  CHECK(!handleCommand(command, CMD_MOVEMENT_SIZE - 1));
+  command[0] = CMD_MANUAL_CONTROL;
+  CHECK(!handleCommand(command, 1));
+  command[0] = CMD_RUNNING;
+  CHECK(!handleCommand(command, CMD_RUNNING_SIZE - 1));
+  command[1] = RUN_FLAG_HAS_GAINS;
+  CHECK(!handleCommand(command, CMD_RUNNING_SIZE + CMD_RUNNING_GAINS_SIZE - 1));
+  command[0] = CMD_RECORDING;
+  command[1] = RECORDING_ACTION_READ;
+  CHECK(!handleCommand(command, 2));
+
+  // A plan shorter than its count, then a segment with a negative length
+  command[0] = CMD_PLAN;
+  command[1] = 2;
+  CHECK(!handleCommand(command, 2 + PLAN_SEGMENT_SIZE));
+  command[1] = 1;
+  putF32LE(command + 3, -1.0f);
+  CHECK(!handleCommand(command, 2 + PLAN_SEGMENT_SIZE));
+
+  // The JSON fallback is gone, a document is an unknown opcode
+  const char json[] = "{\"type\":\"manualControl\",\"enabled\":true}";
+  CHECK(!handleCommand((const uint8_t *)json, sizeof(json) - 1));
+
+  applyPendingCommands();
+  CHECK(!manualControl);
+  CHECK(!RUNNING);
+}
+
+static void testMovement()
+{
+  CHECK(sendManualControl(true));
+  CHECK(sendMovement(11250, 1620));
+  CHECK(!manualControl); // nothing applied before the control period
+  applyPendingCommands();
+  CHECK(manualControl);
+  CHECK_NEAR(SERVO_ANGLE, 112.5, 1e-4);
+  CHECK_NEAR(MOTOR_SPEED, 1620, 1e-4);
+
+  // Ignored outside manual control
+  CHECK(sendManualControl(false));
+  CHECK(sendMovement(6000, 1700));
+  applyPendingCommands();
+  CHECK_NEAR(SERVO_ANGLE, 112.5, 1e-4);
+  CHECK_NEAR(MOTOR_SPEED, 1620, 1e-4);
+}
+
+static void testRunConfig()
+{
+  uint8_t command[CMD_RUNNING_SIZE + CMD_RUNNING_GAINS_SIZE] = {CMD_RUNNING};
+  command[1] = RUN_FLAG_RUNNING | RUN_FLAG_HAS_DISTANCE | RUN_FLAG_HAS_TIME | RUN_FLAG_HAS_PACE | RUN_FLAG_HAS_WHITE_LINE |
+               RUN_FLAG_WHITE_LINE | RUN_FLAG_HAS_GAINS;
+  command[2] = RUN_MODE_TEMPO;
+  putF32LE(command + 3, 400.0f);
+  putF32LE(command + 7, 90.5f);
+  putF32LE(command + 11, 4.25f);
+  for (int i = 0; i < 9; i++)
+  {
+    putF32LE(command + CMD_RUNNING_SIZE + 4 * i, 0.5f + i);
+  }
+  IS_WHITE_LINE = false;
+
+  CHECK(handleCommand(command, sizeof(command)));
+  applyPendingCommands();
+  CHECK(RUNNING);
+  CHECK(startRunTimer);
+  CHECK_EQ(MODE, RUN_MODE_TEMPO);
+  CHECK_NEAR(targetDistance, 400.0, 1e-4);
+  CHECK_NEAR(targetTime, 90.5, 1e-4);
+  CHECK_NEAR(targetSpeed, 4.25, 1e-4);
+  CHECK(IS_WHITE_LINE);
+  CHECK_NEAR(speedKP, 0.5, 1e-6);
+  CHECK_NEAR(speedKI, 1.5, 1e-6);
+  CHECK_NEAR(speedKD, 2.5, 1e-6);
+  CHECK_NEAR(SPEED_MAX_INTEGRAL, 3.5, 1e-6);
+  CHECK_NEAR(SPEED_MAX_ACCELERATION, 4.5, 1e-6);
+  CHECK_NEAR(steerKP, 5.5, 1e-6);
+  CHECK_NEAR(steerKI, 6.5, 1e-6);
+  CHECK_NEAR(steerKD, 7.5, 1e-6);
+  CHECK_NEAR(STEER_MAX_INTEGRAL, 8.5, 1e-6);
+
+  // A stop that keeps the mode, the targets and the gains
+  uint8_t stop[CMD_RUNNING_SIZE] = {CMD_RUNNING, 0, RUN_MODE_UNCHANGED};
+  BRAKE = false;
+  CHECK(handleCommand(stop, sizeof(stop)));
+  applyPendingCommands();
+  CHECK(!RUNNING);
+  CHECK(BRAKE);
+  CHECK_EQ(MODE, RUN_MODE_TEMPO);
+  CHECK_NEAR(targetDistance, 400.0, 1e-4);
+  CHECK_NEAR(speedKP, 0.5, 1e-6);
+}
+
+static void testMailboxFull()
+{
+  for (uint32_t i = 0; i < COMMAND_MAILBOX_SIZE; i++)
+  {
+    CHECK(sendManualControl(i % 2 == 0));
+  }
+  CHECK(!sendManualControl(true));
+  CHECK(sendMovement(9000, 1500)); // the movement slot is not part of the mailbox
+
+  applyPendingCommands();
+  CHECK(!manualControl); // the last queued command, the refused one was dropped
+  CHECK(sendManualControl(true));
+  applyPendingCommands();
+  CHECK(manualControl);
+}
+
+// A disconnect lands between the commands posted before and after it, within one control period
+static void testDisconnectOrder()
+{
+  uint8_t start[CMD_RUNNING_SIZE] = {CMD_RUNNING, RUN_FLAG_RUNNING, RUN_MODE_UNCHANGED};
+
+  // A run started just before the link dropped does not outlive it
+  CHECK(handleCommand(start, sizeof(start)));
+  postDisconnect();
+  applyPendingCommands();
+  CHECK(!RUNNING);
+  CHECK(!manualControl);
+
+  // The next client takes manual control in the same period the disconnect is applied
+  CHECK(sendManualControl(true));
+  CHECK(sendMovement(7000, 1600)); // from the lost link
+  postDisconnect();
+  CHECK(sendManualControl(true));
+  applyPendingCommands();
+  CHECK(manualControl);
+  CHECK_NEAR(MOTOR_SPEED, 1500, 1e-4);
+
+  CHECK(sendMovement(8000, 1550));
+  applyPendingCommands();
+  CHECK_NEAR(SERVO_ANGLE, 80.0, 1e-4);
+  CHECK_NEAR(MOTOR_SPEED, 1550, 1e-4);
+
+  // With nothing queued after it, the disconnect is the last word
+  CHECK(sendManualControl(true));
+  postDisconnect();
+  applyPendingCommands();
+  CHECK(!manualControl);
+}
+
+static void testMovementSequence()
+{
+  CHECK(sendManualControl(true));
+  applyPendingCommands();
+
+  // The count wraps
+  CHECK(sendMovementSeq(9000, 1500, 65534));
+  CHECK(sendMovementSeq(10000, 1600, 65535));
+  CHECK(sendMovementSeq(11000, 1600, 0));
+  applyPendingCommands();
+  CHECK_NEAR(SERVO_ANGLE, 110.0, 1e-4);
+  CHECK_NEAR(MOTOR_SPEED, 1600, 1e-4);
+
+  // A write overtaken by a newer one is acknowledged and dropped
+  CHECK(sendMovementSeq(5000, 1500, 65535));
+  applyPendingCommands();
+  CHECK_NEAR(SERVO_ANGLE, 110.0, 1e-4);
+
+  // Older clients send no number
+  CHECK(sendMovement(6000, 1500));
+  applyPendingCommands();
+  CHECK_NEAR(SERVO_ANGLE, 60.0, 1e-4);
+
+  // The next client starts its own count, 40000 would be stale against 0
+  postDisconnect();
+  applyPendingCommands();
+  CHECK(sendManualControl(true));
+  CHECK(sendMovementSeq(7000, 1500, 40000));
+  applyPendingCommands();
+  CHECK(manualControl);
+  CHECK_NEAR(SERVO_ANGLE, 70.0, 1e-4);
+
+  // Moves take the latest slot, not the mailbox: the newest of many is applied and commands still fit
+  for (int i = 0; i < 100; i++)
+  {
+    CHECK(sendMovementSeq(8000 + i, 1500, 40001 + i));
+  }
+  CHECK(sendManualControl(true));
+  applyPendingCommands();
+  CHECK_NEAR(SERVO_ANGLE, 80.99, 1e-4);
+}
+
+int main()
+{
+  logSetup();
+  logSetLevelAll(LOG_LEVEL_ERROR);
+  setupESC();
+  setupServo();
+
+  testMalformed();
+  testMovement();
+  testRunConfig();
+  testMailboxFull();
+  testDisconnectOrder();
+  testMovementSequence();
+  return hostTestResult();
+}
@@ -0,0 +1,137 @@
+// test_course_sim.cpp
+// Closed loop 60 m race past six track markers on a simulated car whose wheel is off by a scale:
+// with the course loaded every marker is matched, the odometry scale converges on the true one and the
+// car stops at the finish; without it the markers are reported unmatched and the distance drifts.
+// Usage: test_course_sim <true wheel scale> <1 to load the course, 0 not to>
+
+#include "HostTest.h"
+#include "SimCar.h"
+#include "Commands.h"
+#include "Course.h"
+#include "IRDecode.h"
+#include "Telemetry.h"
+#include <cstring>
+#include <cstdlib>
+
+const int MARKER_COUNT = 6;
+const double MARKER_POSITIONS[MARKER_COUNT] = {5, 15, 25, 35, 45, 55}; // m
+const MarkerType MARKER_TYPES[MARKER_COUNT] = {MARKER_CROSS, MARKER_TRIANGLE, MARKER_CROSS,
+                                               MARKER_TRIANGLE, MARKER_CROSS, MARKER_TRIANGLE};
+const double MARKER_LENGTH = 0.02; // m along the track
+
+struct ReportedMarker
+{
+  uint8_t type;
+  uint8_t courseIndex;
+  double correction; // m
+  double scale;
+};
+
+static ReportedMarker reported[COURSE_MAX_MARKERS];
+static int reportedCount = 0;
+
+static void onNotify(const uint8_t *data, size_t length)
+{
+  if (length != MARKER_FRAME_SIZE || data[0] != TELEMETRY_FRAME_MARKER_V1 || reportedCount == COURSE_MAX_MARKERS)
+  {
+    return;
+  }
+  ReportedMarker &marker = reported[reportedCount++];
+  marker.type = data[1];
+  marker.courseIndex = data[2];
+  marker.correction = (int16_t)(data[12] | data[13] << 8) / 1000.0;
+  marker.scale = 1.0 + (int16_t)(data[14] | data[15] << 8) / 100000.0;
+}
+
+// Sensors under the true distance: the base line, or a marker pattern across the array
+static void setLineSensors(const SimCar *car)
+{
+  uint16_t mask = 0x0180;
+  for (int i = 0; i < MARKER_COUNT; i++)
+  {
+    if (car->distance >= MARKER_POSITIONS[i] && car->distance < MARKER_POSITIONS[i] + MARKER_LENGTH)
+    {
+      mask = MARKER_TYPES[i] == MARKER_CROSS ? 0xFFFF : 0x07FF;
+    }
+  }
+  // The modules read the line color, not "lit"
+  if (irMaskFromModules(0xFF, 0xFF, IS_WHITE_LINE) != 0xFFFF)
+  {
+    mask = ~mask;
+  }
+  halSimSetLineSensors(mask >> 8, mask & 0xFF);
+}
+
+static void loadCourse()
+{
+  uint8_t command[2 + MARKER_COUNT * COURSE_MARKER_SIZE] = {CMD_COURSE, MARKER_COUNT};
+  for (int i = 0; i < MARKER_COUNT; i++)
+  {
+    uint8_t *marker = command + 2 + i * COURSE_MARKER_SIZE;
+    float position = MARKER_POSITIONS[i];
+    marker[0] = MARKER_TYPES[i];
+    memcpy(marker + 1, &position, 4);
+  }
+  CHECK(handleCommand(command, sizeof(command)));
+}
+
+int main(int argc, char **argv)
+{
+  if (argc != 3)
+  {
+    std::printf("usage: %s <true wheel scale> <course 0|1>\n", argv[0]);
+    return 2;
+  }
+  double trueScale = atof(argv[1]);
+  bool useCourse = atoi(argv[2]) != 0;
+
+  simFirmwareSetup();
+  halSimSetBleConnected(true);
+  halSimSetBleNotifyHandler(onNotify);
+  SimCar car = simCarCreate(simLinearSpeed, 0.4);
+  car.distancePerPulse *= trueScale;
+  car.beforeControl = setLineSensors;
+
+  if (useCourse)
+  {
+    loadCourse();
+  }
+  uint8_t start[CMD_RUNNING_SIZE] = {CMD_RUNNING, RUN_FLAG_RUNNING | RUN_FLAG_HAS_DISTANCE | RUN_FLAG_HAS_TIME, RUN_MODE_RACE};
+  float distance = 60.0f, time = 30.0f;
+  memcpy(start + 3, &distance, 4);
+  memcpy(start + 7, &time, 4);
+  CHECK(handleCommand(start, sizeof(start)));
+
+  double finishDistance = -1.0;
+  for (int period = 0; period < 40 * (int)CONTROL_LOOP_HZ; period++)
+  {
+    simCarPeriod(&car);
+    if (finishDistance < 0 && period > 0 && runState != RUN_STATE_RUNNING)
+    {
+      finishDistance = car.distance;
+    }
+  }
+
+  CHECK_EQ(reportedCount, MARKER_COUNT);
+  for (int i = 0; i < reportedCount && i < MARKER_COUNT; i++)
+  {
+    CHECK_EQ(reported[i].type, MARKER_TYPES[i]);
+    CHECK_EQ(reported[i].courseIndex, useCourse ? i : MARKER_UNMATCHED);
+    if (useCourse && trueScale == 1.0)
+    {
+      CHECK(fabs(reported[i].correction) < 0.02);
+    }
+  }
+  if (useCourse)
+  {
+    // 1 to 2 cm past the finish, the scale within about 0.1% of the true one
+    CHECK_NEAR(finishDistance, distance, 0.03);
+    CHECK(reportedCount > 0 && fabs(reported[reportedCount - 1].scale / trueScale - 1.0) < 0.005);
+  }
+  else
+  {
+    // The wheel error adds up over the whole run
+    CHECK_NEAR(finishDistance, distance * trueScale, 0.1);
+  }
+  return hostTestResult();
+}
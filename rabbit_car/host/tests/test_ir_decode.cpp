@@ -0,0 +1,91 @@
+// test_ir_decode.cpp
+// Table driven line decoding (IRDecode.h) against the original per-sensor scan, on every frame
+
+#include "HostTest.h"
+#include "IRDecode.h"
+
+// ---- Original scan implementation (IRHandler.cpp before the lookup tables) ----
+
+static int sensorValues[IR_SENSOR_COUNT];
+static int scanLinePosition = 0;
+
+static void scanUnpack(uint8_t data1, uint8_t data2, bool isWhiteLine)
+{
+  for (int i = 0; i < 8; i++)
+  {
+    sensorValues[i] = ((data1 >> (7 - i)) & 0x01) ^ (!isWhiteLine);
+    sensorValues[i + 8] = ((data2 >> (7 - i)) & 0x01) ^ (!isWhiteLine);
+  }
+}
+
+static int scanGetPosition()
+{
+  int sum = 0;
+  int weightedSum = 0;
+  for (int i = 0; i < IR_SENSOR_COUNT; i++)
+  {
+    if (sensorValues[i] == 1)
+    {
+      weightedSum += i * 1000;
+      sum += 1;
+    }
+  }
+  if (sum > 0)
+  {
+    scanLinePosition = weightedSum / sum;
+  }
+  return scanLinePosition;
+}
+
+static bool scanIsValidLinePattern()
+{
+  int activeSensors = 0;
+  int firstActive = -1, lastActive = -1;
+  for (int i = 0; i < IR_SENSOR_COUNT; i++)
+  {
+    if (sensorValues[i] == 1)
+    {
+      activeSensors++;
+      if (firstActive == -1)
+        firstActive = i;
+      lastActive = i;
+    }
+  }
+  int lineWidth = lastActive - firstActive + 1;
+  return activeSensors >= 2 && activeSensors <= 8 && lineWidth >= 2 && lineWidth <= 8;
+}
+
+int main()
+{
+  int lastPosition = 0;
+  for (int whiteLine = 0; whiteLine < 2; whiteLine++)
+  {
+    for (int raw = 0; raw < 0x10000; raw++)
+    {
+      scanUnpack(raw >> 8, raw & 0xFF, whiteLine);
+      uint16_t mask = irMaskFromModules(raw >> 8, raw & 0xFF, whiteLine);
+
+      int activeSensors = 0;
+      for (int i = 0; i < IR_SENSOR_COUNT; i++)
+      {
+        CHECK(irSensorActive(mask, i) == (sensorValues[i] == 1));
+        activeSensors += sensorValues[i];
+      }
+      CHECK_EQ(irActiveCount(mask), activeSensors);
+
+      lastPosition = irPosition(mask, lastPosition);
+      CHECK_EQ(lastPosition, scanGetPosition());
+      CHECK(irIsValidLinePattern(mask) == scanIsValidLinePattern());
+      if (hostTestFailures > 0)
+      {
+        std::printf("first mismatch at raw=0x%04x whiteLine=%d\n", raw, whiteLine);
+        return hostTestResult();
+      }
+    }
+  }
+
+  CHECK_EQ(irSpan(0), 0);
+  CHECK_EQ(irSpan(0x0180), 2);
+  CHECK_EQ(irSpan(0x8001), 16);
+  return hostTestResult();
+}
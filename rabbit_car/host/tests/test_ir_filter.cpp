@@ -0,0 +1,114 @@
+// test_ir_filter.cpp
+// Bit sliced temporal mask filter (irFilterMask in IRDecode.h) against a per-sensor reference, on
+// random frames mixing a moving line, glare spots and marker-like runs
+
+#include "HostTest.h"
+#include "IRDecode.h"
+#include <stdlib.h>
+#include <algorithm>
+
+// ---- Reference: one counter and one test per sensor ----
+
+static int frameCounts[IR_SENSOR_COUNT];
+static uint16_t referenceFiltered = 0;
+
+static bool bitSet(uint16_t mask, int sensor)
+{
+  return (mask >> sensor) & 1;
+}
+
+static uint16_t referenceFilter(uint16_t mask)
+{
+  for (int i = 0; i < IR_SENSOR_COUNT; i++)
+  {
+    frameCounts[i] = bitSet(mask, i) ? std::min(frameCounts[i] + 1, IR_FILTER_CONFIRM_FRAMES) : 0;
+  }
+  if (referenceFiltered == 0)
+  {
+    referenceFiltered = mask;
+    return mask;
+  }
+
+  // Lit sensors within reach of the last filtered line
+  uint16_t accepted = 0;
+  for (int i = 0; i < IR_SENSOR_COUNT; i++)
+  {
+    for (int j = 0; j < IR_SENSOR_COUNT; j++)
+    {
+      if (bitSet(mask, i) && bitSet(referenceFiltered, j) && abs(i - j) <= IR_FILTER_REACH)
+      {
+        accepted |= 1 << i;
+      }
+    }
+  }
+  // Grown one sensor at a time through unbroken runs of lit sensors
+  for (bool grown = true; grown;)
+  {
+    grown = false;
+    for (int i = 0; i < IR_SENSOR_COUNT; i++)
+    {
+      bool besideAccepted = (i > 0 && bitSet(accepted, i - 1)) || (i < IR_SENSOR_COUNT - 1 && bitSet(accepted, i + 1));
+      if (bitSet(mask, i) && !bitSet(accepted, i) && besideAccepted)
+      {
+        accepted |= 1 << i;
+        grown = true;
+      }
+    }
+  }
+  // Anything lit long enough
+  for (int i = 0; i < IR_SENSOR_COUNT; i++)
+  {
+    if (bitSet(mask, i) && frameCounts[i] >= IR_FILTER_CONFIRM_FRAMES)
+    {
+      accepted |= 1 << i;
+    }
+  }
+  referenceFiltered = accepted;
+  return accepted;
+}
+
+static uint16_t randomFrame()
+{
+  if (rand() % 4 == 0)
+  {
+    return rand() & 0xFFFF; // noise
+  }
+  uint16_t mask = (uint16_t)(0xC000 >> (rand() % 14)); // a two sensor line anywhere
+  if (rand() % 6 == 0)
+  {
+    mask |= 1 << (rand() % 16); // glare
+  }
+  if (rand() % 10 == 0)
+  {
+    mask |= (uint16_t)((0xFFFF >> (rand() % 16)) << (rand() % 4)); // a wide marker
+  }
+  return mask;
+}
+
+int main()
+{
+  IRMaskFilter filter = {};
+  srand(1);
+  for (int frame = 0; frame < 2000000; frame++)
+  {
+    uint16_t mask = randomFrame();
+    uint16_t expected = referenceFilter(mask);
+    uint16_t filtered = irFilterMask(&filter, mask);
+    if (filtered != expected)
+    {
+      std::printf("frame %d: mask 0x%04x filtered to 0x%04x, reference 0x%04x\n", frame, mask, filtered, expected);
+      hostTestFailures++;
+      break;
+    }
+  }
+
+  // A glare spot far from the line waits for IR_FILTER_CONFIRM_FRAMES frames
+  IRMaskFilter glare = {};
+  irFilterMask(&glare, 0x0180);
+  for (int frame = 1; frame < IR_FILTER_CONFIRM_FRAMES; frame++)
+  {
+    CHECK_EQ(irFilterMask(&glare, 0x8180), 0x0180);
+  }
+  CHECK_EQ(irFilterMask(&glare, 0x8180), 0x8180);
+  return hostTestResult();
+}
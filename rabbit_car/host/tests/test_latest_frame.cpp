@@ -0,0 +1,66 @@
+// test_latest_frame.cpp
+// Line sensor frame handoff (LatestFrame.h) under a free running writer thread: every frame a reader
+// copies is whole, and the sequence never goes back
+
+#include "HostTest.h"
+#include "Hal.h"
+#include "LatestFrame.h"
+#include <thread>
+
+static LatestFrame<HalLineFrame> frames;
+static std::atomic<bool> stopWriter(false);
+
+// Every field derived from the sequence, so a frame mixing two writes shows
+static void writer()
+{
+  while (!stopWriter.load(std::memory_order_relaxed))
+  {
+    uint32_t sequence;
+    HalLineFrame &frame = latestFrameBegin(&frames, &sequence);
+    frame.module1 = (uint8_t)sequence;
+    frame.module2 = (uint8_t)(sequence * 7);
+    frame.ok = sequence & 1;
+    frame.captureTime = sequence * 3;
+    frame.sequence = sequence;
+    latestFramePublish(&frames, sequence);
+  }
+}
+
+int main()
+{
+  HalLineFrame frame;
+  CHECK(!latestFrameRead(frames, &frame));
+
+  std::thread thread(writer);
+  long reads = 0, torn = 0, backwards = 0;
+  uint32_t lastSequence = 0;
+  // Until the writer has published many frames meanwhile, also on a single core where the two only
+  // interleave by preemption
+  for (long i = 0; i < 5000000 || lastSequence < 100000; i++)
+  {
+    if (!latestFrameRead(frames, &frame))
+    {
+      std::this_thread::yield();
+      continue;
+    }
+    reads++;
+    uint32_t sequence = frame.sequence;
+    if (frame.module1 != (uint8_t)sequence || frame.module2 != (uint8_t)(sequence * 7) || frame.ok != (bool)(sequence & 1) ||
+        frame.captureTime != sequence * 3)
+    {
+      torn++;
+    }
+    if (sequence < lastSequence)
+    {
+      backwards++;
+    }
+    lastSequence = sequence;
+  }
+  stopWriter.store(true);
+  thread.join();
+
+  CHECK(reads > 0);
+  CHECK_EQ(torn, 0);
+  CHECK_EQ(backwards, 0);
+  return hostTestResult();
+}
@@ -0,0 +1,121 @@
+// test_lights.cpp
+// Light effects (Lights.h) on the simulated strips: the startup cycle runs from lightsStep() instead of
+// blocking setupLights(), a strip is only written when its color changes, and the pace, turn signal and
+// calibration effects show over the base colors
+
+#include "HostTest.h"
+#include "HalLinux.h"
+#include "Lights.h"
+#include "RunControl.h"
+
+const unsigned long STEP_US = 20000; // telemetry period
+
+static const uint32_t OFF = halLedColor(0, 0, 0);
+static const uint32_t WHITE = halLedColor(255, 255, 255);
+static const uint32_t RED = halLedColor(255, 0, 0);
+static const uint32_t GREEN = halLedColor(0, 255, 0);
+static const uint32_t BLUE = halLedColor(0, 0, 255);
+static const uint32_t YELLOW = halLedColor(255, 255, 0);
+static const uint32_t AMBER = halLedColor(255, 120, 0);
+
+static uint32_t showCount()
+{
+  uint32_t count = 0;
+  for (int i = 0; i < HAL_LED_STRIP_COUNT; i++)
+  {
+    count += halSimLedShowCount((HalLedStrip)i);
+  }
+  return count;
+}
+
+static bool blinkOn()
+{
+  return halMillis() % 500 < 250;
+}
+
+static void step(const TelemetrySnapshot &snapshot, int periods)
+{
+  for (int i = 0; i < periods; i++)
+  {
+    lightsStep(snapshot);
+    halSimAdvanceMicros(STEP_US);
+  }
+}
+
+int main()
+{
+  unsigned long start = halMicros();
+  setupLights();
+  CHECK_EQ(halMicros() - start, 0);
+
+  TelemetrySnapshot snapshot = {};
+  snapshot.sample.steeringAngle = 90;
+  snapshot.runState = RUN_STATE_IDLE;
+
+  // The palette cycles for 1.4 s, then the strips take their base color, off
+  step(snapshot, 5);
+  CHECK_EQ(halSimLedPixel(HAL_LED_HEAD, 0), WHITE);
+  CHECK_EQ(halSimLedPixel(HAL_LED_RIGHT, 0), WHITE);
+  step(snapshot, 10);
+  CHECK_EQ(halSimLedPixel(HAL_LED_LEFT, 0), RED);
+  step(snapshot, 60);
+  CHECK_EQ(halSimLedPixel(HAL_LED_HEAD, 0), OFF);
+  CHECK_EQ(halSimLedPixel(HAL_LED_LEFT, 0), OFF);
+
+  // Nothing changes, nothing is written
+  uint32_t shows = showCount();
+  step(snapshot, 500);
+  CHECK_EQ(showCount() - shows, 0);
+
+  // Head light pace status
+  lightsOn();
+  snapshot.runState = RUN_STATE_RUNNING;
+  snapshot.targetSpeed = 2.0f;
+  snapshot.sample.speed = 1.5f;
+  lightsStep(snapshot);
+  CHECK_EQ(halSimLedPixel(HAL_LED_HEAD, 0), RED);
+  CHECK_EQ(halSimLedPixel(HAL_LED_LEFT, 0), WHITE);
+  snapshot.sample.speed = 2.05f;
+  lightsStep(snapshot);
+  CHECK_EQ(halSimLedPixel(HAL_LED_HEAD, 0), GREEN);
+  snapshot.sample.speed = 2.3f;
+  lightsStep(snapshot);
+  CHECK_EQ(halSimLedPixel(HAL_LED_HEAD, 0), BLUE);
+
+  // Steering left blinks the left strip, on and off twice a second
+  snapshot.sample.steeringAngle = 75;
+  shows = showCount();
+  for (int i = 0; i < 50; i++)
+  {
+    lightsStep(snapshot);
+    CHECK_EQ(halSimLedPixel(HAL_LED_LEFT, 0), blinkOn() ? AMBER : OFF);
+    CHECK_EQ(halSimLedPixel(HAL_LED_RIGHT, 0), WHITE);
+    halSimAdvanceMicros(STEP_US);
+  }
+  CHECK_EQ(showCount() - shows, 4);
+
+  // Between the thresholds a signal holds on its own side only, 11 degrees starts the other one
+  snapshot.sample.steeringAngle = 83;
+  lightsStep(snapshot);
+  CHECK_EQ(halSimLedPixel(HAL_LED_LEFT, 0), blinkOn() ? AMBER : OFF);
+  snapshot.sample.steeringAngle = 98;
+  lightsStep(snapshot);
+  CHECK_EQ(halSimLedPixel(HAL_LED_LEFT, 0), WHITE);
+  CHECK_EQ(halSimLedPixel(HAL_LED_RIGHT, 0), WHITE);
+  snapshot.sample.steeringAngle = 101;
+  lightsStep(snapshot);
+  CHECK_EQ(halSimLedPixel(HAL_LED_RIGHT, 0), blinkOn() ? AMBER : OFF);
+
+  // Calibrating blinks every strip yellow
+  snapshot.runState = RUN_STATE_CALIBRATING;
+  for (int i = 0; i < 25; i++)
+  {
+    lightsStep(snapshot);
+    for (int strip = 0; strip < HAL_LED_STRIP_COUNT; strip++)
+    {
+      CHECK_EQ(halSimLedPixel((HalLedStrip)strip, 0), blinkOn() ? YELLOW : OFF);
+    }
+    halSimAdvanceMicros(STEP_US);
+  }
+  return hostTestResult();
+}
@@ -0,0 +1,159 @@
+// test_pace_plan.cpp
+// Pace plan target speeds (PacePlan.h): constant and ramped segments, distance and time boundaries,
+// rejected uploads that keep the previous plan, and starts interleaved with uploads from another thread
+
+#include "HostTest.h"
+#include "PacePlan.h"
+#include "Telemetry.h"
+#include <cstring>
+#include <atomic>
+#include <thread>
+
+static void putSegment(uint8_t *field, bool byTime, float length, float startSpeed, float endSpeed)
+{
+  float values[3] = {length, startSpeed, endSpeed};
+  field[0] = byTime ? PLAN_SEGMENT_TIME : 0;
+  for (int i = 0; i < 3; i++)
+  {
+    uint32_t bits;
+    memcpy(&bits, &values[i], sizeof(bits));
+    putU32LE(field + 1 + 4 * i, bits);
+  }
+}
+
+// Position of the run as the control task would have it
+static float targetAt(float distance, float time)
+{
+  totalDistance = distance;
+  currentRunDuration = (unsigned long)(time * 1e6f);
+  return pacePlanTargetSpeed();
+}
+
+static void testSegments()
+{
+  uint8_t plan[3 * PLAN_SEGMENT_SIZE];
+  putSegment(plan, false, 5.0f, 2.0f, 2.0f);                       // 5 m at 2 m/s
+  putSegment(plan + PLAN_SEGMENT_SIZE, false, 4.0f, 2.0f, 3.0f);   // 4 m ramping to 3 m/s
+  putSegment(plan + 2 * PLAN_SEGMENT_SIZE, true, 2.0f, 3.0f, 1.0f); // 2 s slowing to 1 m/s
+  CHECK(pacePlanLoad(plan, 3));
+
+  pacePlanStart();
+  CHECK_NEAR(targetAt(0.0f, 0.0f), 2.0, 1e-5);
+  CHECK_NEAR(targetAt(4.9f, 2.4f), 2.0, 1e-5);
+  CHECK_NEAR(targetAt(7.0f, 3.4f), 2.5, 1e-5);
+  CHECK_NEAR(targetAt(8.0f, 3.8f), 2.75, 1e-5);
+  CHECK(!pacePlanEnded());
+
+  // The time segment starts in the period the distance segment ended
+  CHECK_NEAR(targetAt(9.5f, 4.0f), 3.0, 1e-5);
+  CHECK_NEAR(targetAt(10.5f, 4.5f), 2.5, 1e-5);
+  CHECK_NEAR(targetAt(11.5f, 5.0f), 2.0, 1e-5);
+  CHECK(!pacePlanEnded());
+  CHECK_NEAR(targetAt(13.5f, 6.0f), 0.0, 1e-5);
+  CHECK(pacePlanEnded());
+
+  // A restart goes back to the first segment
+  pacePlanStart();
+  CHECK_NEAR(targetAt(6.0f, 3.0f), 2.25, 1e-5);
+}
+
+static void testBoundaries()
+{
+  uint8_t plan[2 * PLAN_SEGMENT_SIZE];
+  putSegment(plan, true, 1.0f, 1.0f, 1.0f);
+  putSegment(plan + PLAN_SEGMENT_SIZE, false, 2.0f, 1.0f, 2.0f);
+  CHECK(pacePlanLoad(plan, 2));
+
+  // A time boundary lands where the segment ended, a distance segment measures from the distance there
+  pacePlanStart();
+  CHECK_NEAR(targetAt(0.8f, 1.5f), 1.0, 1e-5);
+  CHECK_NEAR(targetAt(1.8f, 2.0f), 1.5, 1e-5);
+  CHECK_NEAR(targetAt(2.7f, 2.5f), 1.95, 1e-5);
+  CHECK(!pacePlanEnded());
+
+  // Several segments can end in one period
+  putSegment(plan, false, 1.0f, 1.0f, 1.0f);
+  putSegment(plan + PLAN_SEGMENT_SIZE, false, 1.0f, 2.0f, 2.0f);
+  CHECK(pacePlanLoad(plan, 2));
+  pacePlanStart();
+  CHECK_NEAR(targetAt(2.5f, 1.0f), 0.0, 1e-5);
+  CHECK(pacePlanEnded());
+}
+
+static void testRejected()
+{
+  uint8_t plan[2 * PLAN_SEGMENT_SIZE];
+  putSegment(plan, false, 10.0f, 4.0f, 4.0f);
+  CHECK(pacePlanLoad(plan, 1));
+
+  putSegment(plan + PLAN_SEGMENT_SIZE, false, 0.0f, 1.0f, 1.0f);
+  CHECK(!pacePlanLoad(plan, 2)); // zero length
+  putSegment(plan + PLAN_SEGMENT_SIZE, false, 1.0f, 1.0f, 16.0f);
+  CHECK(!pacePlanLoad(plan, 2)); // too fast
+  putSegment(plan + PLAN_SEGMENT_SIZE, false, 1.0f, NAN, 1.0f);
+  CHECK(!pacePlanLoad(plan, 2));
+  CHECK(!pacePlanLoad(plan, 0));
+  CHECK(!pacePlanLoad(plan, PACE_PLAN_MAX_SEGMENTS + 1));
+
+  pacePlanStart();
+  CHECK_NEAR(targetAt(9.0f, 2.0f), 4.0, 1e-5);
+  CHECK_NEAR(targetAt(10.0f, 2.5f), 0.0, 1e-5);
+}
+
+// Two plans of one second segments, every segment of a plan at the same speed: a start that copied
+// half of each shows as a last segment at the other plan's speed
+static void testUploadDuringStart()
+{
+  static uint8_t shortPlan[2 * PLAN_SEGMENT_SIZE], longPlan[PACE_PLAN_MAX_SEGMENTS * PLAN_SEGMENT_SIZE];
+  for (int i = 0; i < 2; i++)
+  {
+    putSegment(shortPlan + i * PLAN_SEGMENT_SIZE, true, 1.0f, 1.0f, 1.0f);
+  }
+  for (int i = 0; i < PACE_PLAN_MAX_SEGMENTS; i++)
+  {
+    putSegment(longPlan + i * PLAN_SEGMENT_SIZE, true, 1.0f, 2.0f, 2.0f);
+  }
+  CHECK(pacePlanLoad(shortPlan, 2));
+
+  std::atomic<bool> stop(false);
+  std::atomic<long> uploads(0);
+  std::thread uploader([&]()
+  {
+    while (!stop.load(std::memory_order_relaxed))
+    {
+      pacePlanLoad(shortPlan, 2);
+      pacePlanLoad(longPlan, PACE_PLAN_MAX_SEGMENTS);
+      uploads.fetch_add(2, std::memory_order_relaxed);
+    }
+  });
+
+  // Until many uploads have landed meanwhile, also on a single core where the two only interleave by
+  // preemption
+  long starts = 0, torn = 0;
+  for (; starts < 1000000 || uploads.load() < 1000000; starts++)
+  {
+    pacePlanStart();
+    uint8_t completed, count;
+    pacePlanProgress(&completed, &count);
+    float lastSpeed = targetAt(0.0f, count - 0.5f);
+    float expected = count == 2 ? 1.0f : count == PACE_PLAN_MAX_SEGMENTS ? 2.0f : -1.0f;
+    if (lastSpeed != expected)
+    {
+      torn++;
+    }
+  }
+  stop.store(true);
+  uploader.join();
+  CHECK_EQ(torn, 0);
+}
+
+int main()
+{
+  logSetup();
+  logSetLevelAll(LOG_LEVEL_ERROR);
+  testSegments();
+  testBoundaries();
+  testRejected();
+  testUploadDuringStart();
+  return hostTestResult();
+}
@@ -0,0 +1,58 @@
+// test_race_sim.cpp
+// Closed loop 10 m race on a simulated car whose throttle response differs from the motor model:
+// the fused speed estimate keeps the run distance within millimeters of the true distance, so the
+// car stops close to the finish, and the run end is published for the summary
+
+#include "HostTest.h"
+#include "SimCar.h"
+#include "Commands.h"
+#include "Telemetry.h"
+#include <cstring>
+
+int main()
+{
+  simFirmwareSetup();
+  SimCar car = simCarCreate(simLinearSpeed, 0.4);
+
+  uint8_t start[CMD_RUNNING_SIZE] = {CMD_RUNNING, RUN_FLAG_RUNNING | RUN_FLAG_HAS_DISTANCE | RUN_FLAG_HAS_TIME, RUN_MODE_RACE};
+  float distance = 10.0f, time = 8.0f;
+  memcpy(start + 3, &distance, 4);
+  memcpy(start + 7, &time, 4);
+  CHECK(handleCommand(start, sizeof(start)));
+
+  double errorSum = 0.0;
+  int errorCount = 0;
+  double finishDistance = -1.0;
+  float reportedDistance = 0.0f;
+  for (int period = 0; period < 15 * (int)CONTROL_LOOP_HZ; period++)
+  {
+    simCarPeriod(&car);
+    if (runState == RUN_STATE_RUNNING && period > (int)CONTROL_LOOP_HZ / 2)
+    {
+      errorSum += fabs(totalDistance - car.distance);
+      errorCount++;
+    }
+    if (finishDistance < 0 && period > 0 && runState != RUN_STATE_RUNNING)
+    {
+      finishDistance = car.distance;
+      reportedDistance = totalDistance;
+    }
+  }
+
+  // Before the estimator: 13 mm mean error and a 4.3 cm overshoot at 200 Hz, now about 1 mm and 3.5 mm
+  CHECK(errorCount > 0);
+  CHECK(errorSum / errorCount < 0.004);
+  CHECK_NEAR(finishDistance, distance, 0.025);
+  CHECK_NEAR(reportedDistance, finishDistance, 0.01);
+
+  // The summary comes from the run end, not from whatever the targets are by the time it is printed
+  targetDistance = 0.0;
+  TelemetrySnapshot snapshot;
+  telemetryReadSnapshot(&snapshot);
+  CHECK_EQ(snapshot.runsEnded, 1);
+  CHECK_EQ(snapshot.lastRun.mode, RUN_MODE_RACE);
+  CHECK_NEAR(snapshot.lastRun.distance, reportedDistance, 1e-6);
+  CHECK_NEAR(snapshot.lastRun.targetDistance, distance, 1e-6);
+  CHECK_NEAR(snapshot.lastRun.targetTime, time, 1e-6);
+  return hostTestResult();
+}
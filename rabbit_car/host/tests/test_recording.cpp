@@ -0,0 +1,122 @@
+// test_recording.cpp
+// Recording download (bleBroadcastRecording): the chunks rebuild the file, and a file that can no
+// longer be read ends the stream with an error instead of sending empty chunks forever; a link too small
+// for a chunk header still sends one byte per chunk, and a cancel stops the stream at the next tick
+
+#include "HostTest.h"
+#include "HalLinux.h"
+#include "RunRecorder.h"
+#include "Telemetry.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+static std::vector<uint8_t> received;
+static uint32_t chunkCount = 0;
+static bool streamEnded = false;
+static bool streamFailed = false;
+static uint32_t errorOffset = 0;
+static size_t largestChunk = 0;
+
+static void onNotify(const uint8_t *data, size_t length)
+{
+  if (data[0] != TELEMETRY_FRAME_RECORDING_CHUNK_V1)
+  {
+    return;
+  }
+  chunkCount++;
+  largestChunk = std::max(largestChunk, length);
+  uint32_t offset = getU32LE(data + 2);
+  CHECK_EQ(offset, received.size());
+  received.insert(received.end(), data + RECORDING_CHUNK_HEADER_SIZE, data + length);
+  if (data[1] & RECORDING_CHUNK_FLAG_LAST)
+  {
+    CHECK(!streamEnded); // nothing after the last chunk
+    streamEnded = true;
+    streamFailed = data[1] & RECORDING_CHUNK_FLAG_ERROR;
+    errorOffset = offset;
+  }
+}
+
+static void download()
+{
+  received.clear();
+  chunkCount = 0;
+  streamEnded = false;
+  streamFailed = false;
+  bleRequestRecording(RECORDING_ACTION_READ, 0);
+  for (int i = 0; i < 1000; i++)
+  {
+    bleBroadcastRecording();
+  }
+}
+
+int main()
+{
+  char root[] = "/tmp/rabbit_test_recording_XXXXXX";
+  CHECK(mkdtemp(root) != NULL);
+  halSimSetStorageRoot(root);
+  halSimSetBleConnected(true);
+  halSimSetBleMtu(185);
+  halSimSetBleNotifyHandler(onNotify);
+  logSetup();
+  logSetLevelAll(LOG_LEVEL_ERROR);
+  recorderSetup();
+
+  // Record a short run and let the telemetry task write it out
+  recorderStart(0);
+  for (int i = 0; i < 500; i++)
+  {
+    halSimAdvanceMicros(5000);
+    recorderRecordTick(1);
+  }
+  recorderStop();
+  RecorderInfo info;
+  for (int i = 0; i < 100; i++)
+  {
+    recorderFlush();
+  }
+  recorderGetInfo(&info);
+  CHECK_EQ(info.state, RECORDER_STATE_IDLE);
+  CHECK(info.size > 10000);
+
+  download();
+  CHECK(streamEnded);
+  CHECK(!streamFailed);
+  CHECK_EQ(received.size(), info.size);
+
+  // A notification size below the chunk header
+  halSimSetBleMtu(3);
+  received.clear();
+  chunkCount = 0;
+  largestChunk = 0;
+  bleRequestRecording(RECORDING_ACTION_READ, 0);
+  bleBroadcastRecording();
+  CHECK_EQ(chunkCount, (uint32_t)RECORDING_CHUNKS_PER_TICK);
+  CHECK_EQ(largestChunk, RECORDING_CHUNK_HEADER_SIZE + 1);
+  CHECK_EQ(received.size(), (size_t)RECORDING_CHUNKS_PER_TICK);
+
+  // A cancel posted mid-stream, the stream stops before the next chunk
+  bleRequestRecording(RECORDING_ACTION_CANCEL, 0);
+  bleBroadcastRecording();
+  bleBroadcastRecording();
+  CHECK_EQ(chunkCount, (uint32_t)RECORDING_CHUNKS_PER_TICK);
+  halSimSetBleMtu(185);
+
+  // The file shrinks behind the recorder's back, reads past the new end fail
+  std::string path = std::string(root) + RECORDER_FILE_PATH;
+  uint32_t readable = info.size / 2;
+  CHECK(truncate(path.c_str(), readable) == 0);
+  download();
+  CHECK(streamEnded);
+  CHECK(streamFailed);
+  CHECK_EQ(errorOffset, readable);
+  CHECK_EQ(received.size(), readable);
+  CHECK(chunkCount < 1000);
+
+  unlink(path.c_str());
+  rmdir(root);
+  return hostTestResult();
+}
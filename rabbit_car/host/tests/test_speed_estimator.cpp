@@ -0,0 +1,126 @@
+// test_speed_estimator.cpp
+// One Kalman step of SpeedEstimator against the closed form predict and update equations, and hsUpdate()
+// predicting a restart from a standstill instead of holding the estimate at 0
+
+#include "HostTest.h"
+#include "SpeedEstimator.h"
+#include "ThrottleCalibration.h"
+#include "HalLinux.h"
+#include "HSHandler.h"
+
+static void testPredict()
+{
+  const int pulseWidth = 1640;
+  const float dt = 0.005f;
+  float target = motorModelSpeed(pulseWidth);
+  CHECK(target > 0.5f);
+  CHECK_NEAR(motorModelSpeed(1500), 0.0, 1e-6); // neutral stays put
+
+  SpeedEstimator est;
+  speedEstimatorReset(&est, 0.0f);
+  CHECK_NEAR(est.variance, SPEED_EST_MEASUREMENT_NOISE, 1e-9);
+
+  float decay = expf(-dt / MOTOR_MODEL_TIME_CONSTANT);
+  float variance = est.variance;
+  speedEstimatorPredict(&est, dt, pulseWidth);
+  CHECK_NEAR(est.speed, target * (1.0f - decay), 1e-6);
+  CHECK_NEAR(est.variance, variance * decay * decay + SPEED_EST_PROCESS_NOISE * dt, 1e-7);
+  CHECK_NEAR(est.acceleration, 0.0, 1e-9); // no complete period yet
+
+  // The second predict sees the first period's change
+  float firstSpeed = est.speed;
+  speedEstimatorPredict(&est, dt, pulseWidth);
+  CHECK_NEAR(est.acceleration, (1.0f - SPEED_EST_ACCEL_SMOOTHING) * firstSpeed / dt, 1e-4);
+
+  // Settles on the model's steady state speed
+  for (int i = 0; i < 2000; i++)
+  {
+    speedEstimatorPredict(&est, dt, pulseWidth);
+  }
+  CHECK_NEAR(est.speed, target, 1e-4);
+
+  // A zero or negative interval changes nothing
+  SpeedEstimator before = est;
+  speedEstimatorPredict(&est, 0.0f, 2000);
+  CHECK_NEAR(est.speed, before.speed, 0.0);
+  CHECK_NEAR(est.variance, before.variance, 0.0);
+}
+
+static void testObserve()
+{
+  SpeedEstimator est;
+  speedEstimatorReset(&est, 2.0f);
+  est.variance = 0.09f;
+
+  float measurementVariance = 0.01f;
+  float gain = 0.09f / (0.09f + measurementVariance);
+  speedEstimatorObserve(&est, 3.0f, measurementVariance);
+  CHECK_NEAR(est.speed, 2.0f + gain * 1.0f, 1e-6);
+  CHECK_NEAR(est.variance, 0.09f * (1.0f - gain), 1e-7);
+
+  // An exact measurement replaces the estimate, a useless one leaves it
+  speedEstimatorObserve(&est, 1.25f, 0.0f);
+  CHECK_NEAR(est.speed, 1.25, 1e-6);
+  CHECK_NEAR(est.variance, 0.0, 1e-9);
+  est.variance = 0.04f;
+  speedEstimatorObserve(&est, 9.0f, 1e12f);
+  CHECK_NEAR(est.speed, 1.25, 1e-6);
+
+  // The hall sensor cannot tell direction, so the estimate never goes negative
+  est.variance = 1.0f;
+  speedEstimatorObserve(&est, -4.0f, 0.01f);
+  CHECK_NEAR(est.speed, 0.0, 0.0);
+}
+
+static void testStandstill()
+{
+  const unsigned long period = 5000; // us
+  float speed, average, distance;
+  setupESC();
+  setupHS();
+  hsStart();
+
+  // Rolling at about 1 m/s, then coasting to a stop on neutral
+  setMotorSpeed(1500);
+  for (int i = 0; i < 40; i++)
+  {
+    halSimAdvanceMicros(period);
+    if (i % 6 == 0)
+    {
+      halSimHallEdge();
+    }
+    hsUpdate(&speed, &average, &distance);
+  }
+  for (unsigned long waited = 0; waited < 2 * HS_STANDSTILL_TIMEOUT; waited += period)
+  {
+    halSimAdvanceMicros(period);
+    hsUpdate(&speed, &average, &distance);
+  }
+  CHECK_NEAR(speed, 0.0, 0.0);
+  float stoppedDistance = distance;
+
+  // The throttle opens before the first edge: the motor model's rise, starting at the reset
+  const int pulseWidth = 1640;
+  setMotorSpeed(pulseWidth);
+  const int steps = 20;
+  for (int i = 0; i < steps; i++)
+  {
+    halSimAdvanceMicros(period);
+    hsUpdate(&speed, &average, &distance);
+  }
+  float expected = motorModelSpeed(pulseWidth) * (1.0f - expf(-micros_to_s(steps * period) / MOTOR_MODEL_TIME_CONSTANT));
+  CHECK_NEAR(speed, expected, 0.02);
+  CHECK(distance >= stoppedDistance);
+  CHECK(distance <= stoppedDistance + DISTANCE_PER_PULSE.count()); // capped at the next edge
+}
+
+int main()
+{
+  logSetup();
+  logSetLevelAll(LOG_LEVEL_ERROR);
+  throttleClearCalibration();
+  testPredict();
+  testObserve();
+  testStandstill();
+  return hostTestResult();
+}
@@ -0,0 +1,163 @@
+// test_telemetry.cpp
+// Telemetry frame layouts (Telemetry.h, decoded by web/public/javascripts/protocol.js) and the control
+// task snapshot seqlock under a concurrent writer
+
+#include "HostTest.h"
+#include "Telemetry.h"
+#include <atomic>
+#include <thread>
+
+static void testDtpsFrame()
+{
+  uint8_t frame[TELEMETRY_FRAME_SIZE];
+  TelemetrySample sample = {123.4567f, 61.25f, 2.0156f, 3.3333f, 97.125f};
+
+  CHECK_EQ(encodeTelemetryFrame(frame, 0xBEEF, 0x12345678, sample, TELEMETRY_FLAG_RUN_STOPPED), TELEMETRY_FRAME_SIZE);
+  CHECK_EQ(frame[0], TELEMETRY_FRAME_DTPS_V1);
+  CHECK_EQ(frame[1], TELEMETRY_FLAG_RUN_STOPPED);
+  CHECK_EQ(getU16LE(frame + 2), 0xBEEF);
+  CHECK_EQ(getU16LE(frame + 4), 0x5678); // low 16 bits
+  CHECK_EQ(getU32LE(frame + 6), 61250);
+  CHECK_EQ(getU32LE(frame + 10), 123457); // rounded to the mm
+  CHECK_EQ(getU16LE(frame + 14), 2016);
+  CHECK_EQ(getU16LE(frame + 16), 3333);
+  CHECK_EQ(getU16LE(frame + 18), 9713);
+
+  // Saturates instead of wrapping, negative and NaN read as 0
+  sample = {-1.0f, NAN, 70.0f, 1e9f, -5.0f};
+  encodeTelemetryFrame(frame, 0, 0, sample, 0);
+  CHECK_EQ(getU32LE(frame + 6), 0);
+  CHECK_EQ(getU32LE(frame + 10), 0);
+  CHECK_EQ(getU16LE(frame + 14), UINT16_MAX);
+  CHECK_EQ(getU16LE(frame + 16), UINT16_MAX);
+  CHECK_EQ(getU16LE(frame + 18), 0);
+}
+
+static void testBatchFrame()
+{
+  TimedSample samples[TELEMETRY_BATCH_MAX_SAMPLES];
+  for (int i = 0; i < TELEMETRY_BATCH_MAX_SAMPLES; i++)
+  {
+    samples[i].timestamp = 0xFFFFFFF0u + 10 * i; // crosses the 32-bit wrap
+    samples[i].sample = {1.0f * i, 0.01f * i, 0.5f, 1.5f + i, 90.0f};
+  }
+  samples[TELEMETRY_BATCH_MAX_SAMPLES - 1].timestamp = samples[0].timestamp + 70000; // offset saturates
+
+  uint8_t frame[TELEMETRY_BATCH_HEADER_SIZE + TELEMETRY_BATCH_MAX_SAMPLES * TELEMETRY_BATCH_SAMPLE_SIZE];
+  CHECK_EQ(encodeTelemetryBatch(frame, 7, samples, TELEMETRY_BATCH_MAX_SAMPLES), sizeof(frame));
+  CHECK_EQ(frame[0], TELEMETRY_FRAME_BATCH_V1);
+  CHECK_EQ(frame[1], TELEMETRY_BATCH_MAX_SAMPLES);
+  CHECK_EQ(getU16LE(frame + 2), 7);
+  CHECK_EQ(getU32LE(frame + 4), 0xFFFFFFF0u);
+  for (int i = 0; i < TELEMETRY_BATCH_MAX_SAMPLES - 1; i++)
+  {
+    const uint8_t *field = frame + TELEMETRY_BATCH_HEADER_SIZE + i * TELEMETRY_BATCH_SAMPLE_SIZE;
+    CHECK_EQ(getU16LE(field), 10 * i);
+    CHECK_EQ(getU32LE(field + 2), 10 * i);
+    CHECK_EQ(getU32LE(field + 6), 1000 * i);
+    CHECK_EQ(getU16LE(field + 10), 500);
+    CHECK_EQ(getU16LE(field + 12), 1500 + 1000 * i);
+    CHECK_EQ(getU16LE(field + 14), 9000);
+  }
+  const uint8_t *last = frame + sizeof(frame) - TELEMETRY_BATCH_SAMPLE_SIZE;
+  CHECK_EQ(getU16LE(last), UINT16_MAX);
+
+  CHECK_EQ(encodeTelemetryBatch(frame, 8, samples, 1), TELEMETRY_BATCH_HEADER_SIZE + TELEMETRY_BATCH_SAMPLE_SIZE);
+  CHECK_EQ(frame[1], 1);
+}
+
+static void testLinkFrame()
+{
+  HalBleLinkInfo link = {247, HAL_BLE_PHY_2M, 12, 0, 400};
+  BleLinkStats stats = {100000, 0x01020304, 70000};
+  uint8_t frame[LINK_FRAME_SIZE];
+
+  CHECK_EQ(encodeLinkFrame(frame, link, stats), LINK_FRAME_SIZE);
+  CHECK_EQ(frame[0], TELEMETRY_FRAME_LINK_V1);
+  CHECK_EQ(frame[1], HAL_BLE_PHY_2M);
+  CHECK_EQ(getU16LE(frame + 2), 247);
+  CHECK_EQ(getU16LE(frame + 4), 12);
+  CHECK_EQ(getU16LE(frame + 6), 0);
+  CHECK_EQ(getU16LE(frame + 8), 400);
+  CHECK_EQ(getU32LE(frame + 10), 100000);
+  CHECK_EQ(getU32LE(frame + 14), 0x01020304);
+  CHECK_EQ(getU16LE(frame + 18), UINT16_MAX);
+}
+
+static void testMarkerFrame()
+{
+  MarkerEvent event = {MARKER_TRIANGLE, 3, 45678, 25.4321f, -0.0126f, 1.03921f};
+  uint8_t frame[MARKER_FRAME_SIZE];
+
+  CHECK_EQ(encodeMarkerFrame(frame, event), MARKER_FRAME_SIZE);
+  CHECK_EQ(frame[0], TELEMETRY_FRAME_MARKER_V1);
+  CHECK_EQ(frame[1], MARKER_TRIANGLE);
+  CHECK_EQ(frame[2], 3);
+  CHECK_EQ(getU32LE(frame + 4), 45678);
+  CHECK_EQ(getU32LE(frame + 8), 25432);
+  CHECK_EQ((int16_t)getU16LE(frame + 12), -13);
+  CHECK_EQ((int16_t)getU16LE(frame + 14), 3921);
+}
+
+// Every field of a published snapshot carries the same value, so a torn read shows as a mismatch
+static void testSnapshotSeqlock()
+{
+  const uint32_t writes = 2000000;
+  std::atomic<bool> done(false);
+  std::thread writer([&]()
+  {
+    for (uint32_t i = 1; i <= writes; i++)
+    {
+      TelemetrySnapshot snapshot;
+      float value = (float)i;
+      snapshot.sample = {value, value, value, value, value};
+      snapshot.lastRun.distance = value;
+      snapshot.lastRun.time = value;
+      snapshot.runsEnded = i;
+      snapshot.runState = i & 0xFF;
+      snapshot.targetSpeed = value;
+      telemetryPublish(snapshot);
+    }
+    done.store(true);
+  });
+
+  long reads = 0, torn = 0, backwards = 0;
+  uint32_t lastSeen = 0;
+  while (!done.load())
+  {
+    TelemetrySnapshot snapshot;
+    telemetryReadSnapshot(&snapshot);
+    float value = (float)snapshot.runsEnded;
+    if (snapshot.sample.distance != value || snapshot.sample.time != value || snapshot.sample.pace != value ||
+        snapshot.sample.speed != value || snapshot.sample.steeringAngle != value ||
+        snapshot.lastRun.distance != value || snapshot.lastRun.time != value || snapshot.targetSpeed != value ||
+        snapshot.runState != (snapshot.runsEnded & 0xFF))
+    {
+      torn++;
+    }
+    if (snapshot.runsEnded < lastSeen)
+    {
+      backwards++;
+    }
+    lastSeen = snapshot.runsEnded;
+    reads++;
+  }
+  writer.join();
+
+  TelemetrySnapshot snapshot;
+  telemetryReadSnapshot(&snapshot);
+  CHECK_EQ(snapshot.runsEnded, writes);
+  CHECK_EQ(torn, 0);
+  CHECK_EQ(backwards, 0);
+  CHECK(reads > 0);
+}
+
+int main()
+{
+  testDtpsFrame();
+  testBatchFrame();
+  testLinkFrame();
+  testMarkerFrame();
+  testSnapshotSeqlock();
+  return hostTestResult();
+}
@@ -5,44 +5,27 @@
 #include "IRHandler.h"
 #include "HSHandler.h"
 #include "Lights.h"
+#include "RunControl.h"
+#include "RunRecorder.h"
+#include "ThrottleCalibration.h"
 #include "config.h"
-#include "conversions.h"
 
-// Define direction variables
-float MOTOR_SPEED = 1500;
-float SERVO_ANGLE = 90;
-bool RUNNING = false;
-bool startRunTimer = true;
-bool manualControl = false;
-bool IS_WHITE_LINE = false; // determines whether the logic follows a white or black line
-
-volatile unsigned long startTime = 0;          // start of pacing
-volatile unsigned long currentRunDuration = 0; // current total time of the run
-volatile unsigned long endTime = 0;            // final end time
-
-// Mode variables
-String MODE = "RACE"; // Current mode: "RACE", "TEMPO", "DISTANCE_PACE"
-bool BRAKE = false;
-
-// Universal parameters (set based on mode)
-float targetDistance = 0.0; // user entered target distance in meters
-float targetTime = 0.0;     // user entered run time in seconds
-float targetSpeed = 0.0;    // user entered target speed in m/s (for TEMPO and DISTANCE_PACE)
-
-// Runtime tracking
-float averageSpeed = 0.0;  // average speed for the current run
-float currentSpeed = 0.0;  // Current speed in m/s
-float totalDistance = 0.0; // Total distance in m
-unsigned long currentTime = micros();
-unsigned long lastSpeedUpdateTime = micros();
+// Control scheduling
+TaskHandle_t controlTaskHandle = NULL;
+TaskHandle_t telemetryTaskHandle = NULL;
+hw_timer_t *controlTimer = NULL;
 
 void setup()
 {
+  Serial.setTxBufferSize(LOG_SERIAL_TX_BUFFER_SIZE); // lets logDrain() queue whole lines without blocking
   Serial.begin(115200);
+  logSetup();
+  profileSetup();
   Serial.println("Starting Rabbit...");
 
-  // Initialize ESC
+  // Initialize ESC and load its throttle calibration
   setupESC();
+  throttleSetup();
   // Initialize Servo
   setupServo();
   // Initialize HS
@@ -53,212 +36,50 @@ void setup()
   setupBLE();
   // Initialize Lights
   setupLights();
-}
-
-void loop()
-{
-  if (BRAKE)
-  {
-    brakeESC();
-  }
-  if (startRunTimer)
-  {
-    resetPID();
-    resetSteeringPID();
-    hsStart();
-    startTime = micros();
-    startRunTimer = false;
-  }
-
-  currentTime = micros();
-  currentRunDuration = currentTime - startTime;
-
-  if (manualControl)
-  {
-    setMotorSpeed(MOTOR_SPEED);
-    setSteering(SERVO_ANGLE);
-    hsUpdate(&currentSpeed, &averageSpeed, &totalDistance);
-    bleBroadcastDTPS(totalDistance, micros_to_s(currentRunDuration), averageSpeed, currentSpeed, SERVO_ANGLE);
-  }
-  else // pace mode
-  {
-    if (RUNNING) // follow the line
-    {
-      bool shouldEnd = false;
-      float currentTargetSpeed = 0.0;
-
-      // Mode-specific logic
-      if (MODE == "RACE")
-      {
-        // RACE mode: Time + Distance → vary speed to hit exact finish time
-        shouldEnd = checkRaceEndCondition();
-        currentTargetSpeed = calculateRacePace();
-      }
-      else if (MODE == "TEMPO")
-      {
-        // TEMPO mode: Speed + Time → maintain constant speed
-        shouldEnd = checkTempoEndCondition();
-        currentTargetSpeed = targetSpeed;
-      }
-      else if (MODE == "DISTANCE_PACE")
-      {
-        // DISTANCE_PACE mode: Speed + Distance → maintain constant speed until distance complete
-        shouldEnd = checkDistancePaceEndCondition();
-        currentTargetSpeed = targetSpeed;
-      }
-
-      steerServoByPID();
-      hsUpdate(&currentSpeed, &averageSpeed, &totalDistance);
-      bleBroadcastDTPS(totalDistance, micros_to_s(currentRunDuration), averageSpeed, currentSpeed, SERVO_ANGLE, shouldEnd);
-
-      if (shouldEnd)
-      {
-        stopESC();
-        // centerSteering();
-        RUNNING = false;
-        startRunTimer = false;
-        endTime = currentTime;
-        printRunSummary();
-
-        DynamicJsonDocument doc(32);
-        doc["stopped"] = true;
-        bleBroadcastRunStopped(doc);
-
-        for (int i = 0; i < 600; i++)
-        {
-          steerServoByPID();
-          delay(5);
-        }
-      }
-      else
-      {
-        // Use PID control for speed adjustment - run every 0.25 seconds for smoother transitions
-        if (currentTime - lastSpeedUpdateTime >= s_to_micros(0.25))
-        {
-          adjustMotorSpeedPID(currentSpeed, currentTargetSpeed);
-          lastSpeedUpdateTime = currentTime;
-        }
-      }
-    }
-    else
-    {
-      stopESC();
-      // centerSteering();
-      steerServoByPID();
-    }
-  }
-
-  delay(5);
-}
-
-// RACE mode: Adjust pace dynamically to finish distance in target time
-bool checkRaceEndCondition()
-{
-  // End when we've reached the target distance
-  return (totalDistance >= targetDistance);
-}
-
-float calculateRacePace()
-{
-  float elapsedTime = micros_to_s(currentRunDuration);
-  float remainingDistance = targetDistance - totalDistance;
-  float remainingTime = targetTime - elapsedTime;
-
-  // Prevent division by zero and negative time
-  if (remainingTime <= 0.1) // 0.1 second buffer
-  {
-    return 0.0; // Stop if we're out of time
-  }
+  // Mount storage for the run recorder
+  recorderSetup();
 
-  // Calculate required pace to finish on time
-  float requiredPace = remainingDistance / remainingTime;
+  // Start the control and telemetry tasks, the control task is released by the timer
+  xTaskCreatePinnedToCore(controlTask, "control", CONTROL_TASK_STACK_SIZE, NULL, CONTROL_TASK_PRIORITY, &controlTaskHandle, CONTROL_TASK_CORE);
+  xTaskCreatePinnedToCore(telemetryTask, "telemetry", TELEMETRY_TASK_STACK_SIZE, NULL, TELEMETRY_TASK_PRIORITY, &telemetryTaskHandle, TELEMETRY_TASK_CORE);
 
-  // Clamp to reasonable limits (adjust these based on your car's capabilities)
-  requiredPace = constrain(requiredPace, 0.5, 15.0);
-
-  Serial.printf("Race Mode - Remaining: %.2fm in %.2fs, Required pace: %.2fm/s\n",
-                remainingDistance, remainingTime, requiredPace);
-
-  return requiredPace;
+  controlTimer = timerBegin(1000000); // 1 MHz, alarm values are in microseconds
+  timerAttachInterrupt(controlTimer, &onControlTimer);
+  timerAlarm(controlTimer, 1000000 / CONTROL_LOOP_HZ, true, 0);
 }
 
-// TEMPO mode: Maintain constant speed for set time
-bool checkTempoEndCondition()
+void loop()
 {
-  float elapsedTime = micros_to_s(currentRunDuration);
-  return elapsedTime >= targetTime;
+  // Everything runs in controlTask and telemetryTask
+  vTaskDelete(NULL);
 }
 
-// DISTANCE_PACE mode: Maintain constant speed until distance is reached
-bool checkDistancePaceEndCondition()
+// Hardware timer ISR, releases the control task once per control period
+void IRAM_ATTR onControlTimer()
 {
-  return totalDistance >= targetDistance;
+  BaseType_t higherPriorityTaskWoken = pdFALSE;
+  vTaskNotifyGiveFromISR(controlTaskHandle, &higherPriorityTaskWoken);
+  portYIELD_FROM_ISR(higherPriorityTaskWoken);
 }
 
-void printRunSummary()
+// Steering and speed control at CONTROL_LOOP_HZ, pinned to CONTROL_TASK_CORE
+void controlTask(void *parameter)
 {
-  float finalTime = micros_to_s(endTime - startTime);
-
-  Serial.println("=== RUN SUMMARY ===");
-  Serial.printf("Mode: %s\n", MODE.c_str());
-  Serial.printf("Total Distance: %.2f m\n", totalDistance);
-  Serial.printf("Total Time: %.2f s\n", finalTime);
-  Serial.printf("Average Speed: %.2f m/s\n", averageSpeed);
-
-  if (MODE == "RACE")
-  {
-    Serial.printf("Target: %.2fm in %.2fs\n", targetDistance, targetTime);
-    Serial.printf("Distance Error: %.2fm\n", targetDistance - totalDistance);
-    Serial.printf("Time Error: %.2fs\n", targetTime - finalTime);
-  }
-  else if (MODE == "TEMPO")
-  {
-    Serial.printf("Target: %.2fm/s for %.2fs\n", targetSpeed, targetTime);
-    Serial.printf("Speed Error: %.2fm/s\n", targetSpeed - averageSpeed);
-  }
-  else if (MODE == "DISTANCE_PACE")
+  for (;;)
   {
-    Serial.printf("Target: %.2fm at %.2fm/s\n", targetDistance, targetSpeed);
-    Serial.printf("Distance Error: %.2fm\n", targetDistance - totalDistance);
-    Serial.printf("Speed Error: %.2fm/s\n", targetSpeed - averageSpeed);
+    // Clears any ticks that were missed while the previous step overran
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    controlStep();
   }
-
-  Serial.println("==================");
 }
 
-// Function to be called when BLE receives new parameters
-void updateModeParameters(String mode, float param1, float param2)
+// Telemetry, lights and logging at TELEMETRY_TASK_HZ, pinned to TELEMETRY_TASK_CORE
+void telemetryTask(void *parameter)
 {
-  MODE = mode;
-
-  if (MODE == "RACE")
-  {
-    // RACE: param1 = distance, param2 = time
-    targetDistance = param1;
-    targetTime = param2;
-    Serial.printf("RACE Mode: %.2fm in %.2fs\n", targetDistance, targetTime);
-  }
-  else if (MODE == "TEMPO")
+  TickType_t lastWakeTime = xTaskGetTickCount();
+  for (;;)
   {
-    // TEMPO: param1 = speed, param2 = time
-    targetSpeed = param1;
-    targetTime = param2;
-    Serial.printf("TEMPO Mode: %.2fm/s for %.2fs\n", targetSpeed, targetTime);
+    telemetryStep();
+    vTaskDelayUntil(&lastWakeTime, pdMS_TO_TICKS(1000 / TELEMETRY_TASK_HZ));
   }
-  else if (MODE == "DISTANCE_PACE")
-  {
-    // DISTANCE_PACE: param1 = speed, param2 = distance
-    targetSpeed = param1;
-    targetDistance = param2;
-    Serial.printf("DISTANCE_PACE Mode: %.2fm/s for %.2fm\n", targetSpeed, targetDistance);
-  }
-
-  // Reset run state for new parameters
-  if (!manualControl)
-  {
-    RUNNING = false;
-    startRunTimer = true;
-    totalDistance = 0.0;
-    averageSpeed = 0.0;
-  }
-}
\ No newline at end of file
+}
@@ -3,9 +3,31 @@ import {
     connect,
     disconnect,
     sendCommand,
-    requestMovementUpdate as bleRequestMovementUpdate,
-    isConnected
+    setMovement,
+    isConnected,
+    requestTelemetryView,
+    clearTelemetry,
 } from './bluetooth.js';
+import {
+    encodeManualControl,
+    encodeIsWhiteLine,
+    encodeRunConfig,
+    encodeStatsRequest,
+    encodeRecordingRequest,
+    encodePacePlan,
+    encodeCalibrate,
+    encodeCourse,
+    PACE_PLAN_MAX_SEGMENTS,
+    COURSE_MAX_MARKERS,
+    MARKER_TYPE_NAMES,
+    CALIBRATE_ACTION_REPORT,
+    CALIBRATE_ACTION_START,
+    CALIBRATE_ACTION_CLEAR,
+    decodeRecording,
+    recordingToCsv,
+    RECORDING_ACTION_READ,
+    RECORDER_STATE_IDLE,
+} from './protocol.js';
 
 // Element references
 const connectBtn = document.getElementById('connectBtn');
@@ -28,8 +50,32 @@ const averagePaceDisplay = document.getElementById('average-pace');
 const timeDisplay = document.getElementById('time');
 const speedReadingsDisplay = document.getElementById('speedReadingsDisplay');
 const steerReadingsDisplay = document.getElementById('steerReadingsDisplay');
-let speedReadings = [];
-let steerReadings = [];
+const logStatsDisplay = document.getElementById('logStats');
+const linkInfoDisplay = document.getElementById('linkInfo');
+const statsBtn = document.getElementById('statsBtn');
+const statsResetBtn = document.getElementById('statsResetBtn');
+const profileStatsBody = document.getElementById('profileStatsBody');
+const downloadRecordingBtn = document.getElementById('downloadRecordingBtn');
+const recordingStatus = document.getElementById('recordingStatus');
+const planBody = document.getElementById('planBody');
+const addSegmentBtn = document.getElementById('addSegmentBtn');
+const uploadPlanBtn = document.getElementById('uploadPlanBtn');
+const planSummary = document.getElementById('planSummary');
+const calibrateBtn = document.getElementById('calibrateBtn');
+const showThrottleBtn = document.getElementById('showThrottleBtn');
+const clearCalibrationBtn = document.getElementById('clearCalibrationBtn');
+const throttleStatus = document.getElementById('throttleStatus');
+const throttleTableBody = document.getElementById('throttleTableBody');
+const courseBody = document.getElementById('courseBody');
+const addMarkerBtn = document.getElementById('addMarkerBtn');
+const uploadCourseBtn = document.getElementById('uploadCourseBtn');
+const clearCourseBtn = document.getElementById('clearCourseBtn');
+const markerEventBody = document.getElementById('markerEventBody');
+
+// Run recording download in progress, kept across reconnects so it can resume
+// { size, offset, bytes: Uint8Array, retryTimer }
+let recordingDownload = null;
+const RECORDING_RETRY_MS = 1000; // re-request from the last good offset when no chunk arrives for this long
 
 const speedKP = 2.5;
 const speedKI = 0.55;
@@ -59,22 +105,25 @@ const ctxSpeed = document.getElementById('speedChart').getContext('2d');
 let speedChart = new Chart(ctxSpeed, {
     type: 'line',
     data: {
-        labels: [],
         datasets: [{
             label: 'Speed',
             data: [],
             borderColor: 'blue',
             fill: false,
-            tension: 0.1,
             pointRadius: 0
         }]
     },
     options: {
+        // Points arrive as { x, y } already decimated to the chart width, see telemetryWorker.js
+        animation: false,
+        parsing: false,
+        normalized: true,
         scales: {
             x: {
+                type: 'linear',
                 title: {
                     display: true,
-                    text: 'Time (arbitrary units)'
+                    text: 'Time (s)'
                 }
             },
             y: {
@@ -91,22 +140,25 @@ const ctxSteer = document.getElementById('steerChart').getContext('2d');
 let steerChart = new Chart(ctxSteer, {
     type: 'line',
     data: {
-        labels: [],
         datasets: [{
             label: 'Steer',
             data: [],
             borderColor: 'blue',
             fill: false,
-            tension: 0.1,
             pointRadius: 0
         }]
     },
     options: {
+        // Points arrive as { x, y } already decimated to the chart width, see telemetryWorker.js
+        animation: false,
+        parsing: false,
+        normalized: true,
         scales: {
             x: {
+                type: 'linear',
                 title: {
                     display: true,
-                    text: 'Time (arbitrary units)'
+                    text: 'Time (s)'
                 }
             },
             y: {
@@ -139,16 +191,61 @@ let isWhiteLine = false;
 let lastUpdated = ["distance", "time"];
 let currentX = 90;
 let currentY = 1500;
-let lastSentX = null;
-let lastSentY = null;
-let movementRequested = false;
+
+// Event log, virtualized: the lines live in an array and only the rows in view exist in the DOM,
+// redrawn at most once per animation frame. It follows new lines while scrolled to the bottom.
+const LOG_MAX_LINES = 10000;  // older lines are dropped
+const LOG_LINE_HEIGHT = 18;   // px, matches .log-line in app.css
+const logLines = [];
+const logSpacer = document.createElement('div');
+const logRows = document.createElement('div');
+logRows.className = 'log-rows';
+logContent.append(logSpacer, logRows);
+let logFollow = true;
+let logRenderRequested = false;
+
+function renderLog() {
+    logRenderRequested = false;
+    logSpacer.style.height = `${logLines.length * LOG_LINE_HEIGHT}px`;
+    if (logFollow) {
+        logContent.scrollTop = logContent.scrollHeight;
+    }
+
+    const first = Math.floor(logContent.scrollTop / LOG_LINE_HEIGHT);
+    const count = Math.min(Math.ceil(logContent.clientHeight / LOG_LINE_HEIGHT) + 1, logLines.length - first);
+    while (logRows.children.length < count) {
+        const row = document.createElement('p');
+        row.className = 'log-line';
+        logRows.appendChild(row);
+    }
+    while (logRows.children.length > Math.max(count, 0)) {
+        logRows.lastChild.remove();
+    }
+    for (let i = 0; i < count; i++) {
+        logRows.children[i].textContent = logLines[first + i];
+    }
+    logRows.style.transform = `translateY(${first * LOG_LINE_HEIGHT}px)`;
+}
+
+function requestLogRender() {
+    if (!logRenderRequested) {
+        logRenderRequested = true;
+        requestAnimationFrame(renderLog);
+    }
+}
+
+logContent.addEventListener('scroll', () => {
+    logFollow = logContent.scrollTop + logContent.clientHeight >= logContent.scrollHeight - LOG_LINE_HEIGHT;
+    requestLogRender();
+});
 
 // Log function
 export function log(message) {
-    const p = document.createElement('p');
-    p.textContent = `${new Date().toLocaleTimeString()}: ${message}`;
-    logContent.appendChild(p);
-    logContent.scrollTop = logContent.scrollHeight;
+    logLines.push(`${new Date().toLocaleTimeString()}: ${message}`);
+    if (logLines.length > LOG_MAX_LINES + 1000) {
+        logLines.splice(0, logLines.length - LOG_MAX_LINES); // in steps, not a shift per line
+    }
+    requestLogRender();
 }
 
 // Connect handler
@@ -159,6 +256,10 @@ async function handleConnect() {
         statusText.className = 'status connected';
         connectBtn.disabled = true;
         disconnectBtn.disabled = false;
+        if (recordingDownload) {
+            log(`Resuming recording download at byte ${recordingDownload.offset}`);
+            requestRecordingChunks();
+        }
     }
 }
 
@@ -181,18 +282,46 @@ export function handleRunStopped(data) {
     startToggleButton.innerText = "GO";
 }
 
+// Telemetry rendering: the worker says when samples arrived, the next animation frame asks it for the
+// charts' series, and the answer is drawn in one go
+let telemetryViewRequested = false;
+
+function chartColumns(chart) {
+    return chart.chartArea ? chart.chartArea.width : chart.width;
+}
+
+export function telemetryChanged() {
+    if (!telemetryViewRequested) {
+        telemetryViewRequested = true;
+        requestAnimationFrame(() => requestTelemetryView([chartColumns(speedChart), chartColumns(steerChart)]));
+    }
+}
+
+function setChartSeries(chart, series) {
+    const points = new Array(series.x.length);
+    for (let i = 0; i < points.length; i++) {
+        points[i] = { x: series.x[i], y: series.y[i] };
+    }
+    chart.data.datasets[0].data = points;
+    chart.update('none');
+}
+
+export function updateTelemetryView(view) {
+    telemetryViewRequested = false;
+    setChartSeries(speedChart, view.series[0]);
+    setChartSeries(steerChart, view.series[1]);
+    speedReadingsDisplay.textContent = Array.from(view.recentSpeed, value => value.toFixed(3)).join(', ');
+    steerReadingsDisplay.textContent = Array.from(view.recentSteer, value => value.toFixed(2)).join(', ');
+    if (view.latest) {
+        updateDataState(view.latest);
+    }
+}
+
 // Update BLE-received data state
-export function updateDataState(newData) {
+function updateDataState(newData) {
     if (newData.currentSpeed && typeof newData.currentSpeed.value === 'number' && newData.currentSpeed.value >= 0) {
         currentSpeed.value = convertToMperS(newData.currentSpeed.value, newData.currentSpeed.unit || "m/s");
         currentSpeed.unit = "m/s";
-        speedReadings.push(currentSpeed.value)
-        speedReadingsDisplay.innerHTML = [...speedReadings].reverse();
-
-        // Update the chart
-        speedChart.data.labels = speedReadings.map((_, index) => index);
-        speedChart.data.datasets[0].data = speedReadings;
-        speedChart.update();
     }
     if (newData.distance && typeof newData.distance.value === 'number' && newData.distance.value >= 0) {
         receivedDistance.value = convertToMeters(newData.distance.value, newData.distance.unit || "meters");
@@ -206,17 +335,319 @@ export function updateDataState(newData) {
         elapsedTime.value = convertToSeconds(newData.time.value, newData.time.unit || "seconds");
         elapsedTime.unit = "seconds";
     }
-    if (newData.steeringAngle && typeof newData.steeringAngle === 'number') {
-        steerReadings.push(newData.steeringAngle)
-        steerReadingsDisplay.innerHTML = [...steerReadings].reverse();
-        // Update the chart
-        steerChart.data.labels = steerReadings.map((_, index) => index);
-        steerChart.data.datasets[0].data = steerReadings;
-        steerChart.update();
-    }
     updateDataDisplay();
 }
 
+// Firmware log buffer counters
+export function updateLogStats(stats) {
+    logStatsDisplay.textContent =
+        `Car log: ${stats.written} written, ${stats.dropped} dropped, ${stats.pending} pending`;
+    logStatsDisplay.style.color = stats.dropped > 0 ? "red" : "";
+}
+
+// Negotiated BLE link. Throughput is measured between link frames at least half a second apart (the
+// car also sends one on every link change), so it shows from the second periodic frame
+let linkReference = null;
+let linkThroughput = "";
+export function updateLinkInfo(link) {
+    const now = performance.now();
+    if (!linkReference || link.bytes < linkReference.bytes) {
+        linkReference = { ...link, receivedAt: now }; // first frame, or the car rebooted
+    } else if (now - linkReference.receivedAt >= 500) {
+        const seconds = (now - linkReference.receivedAt) / 1000;
+        const kBps = (link.bytes - linkReference.bytes) / 1000 / seconds;
+        const perSecond = (link.notifications - linkReference.notifications) / seconds;
+        linkThroughput = `, ${kBps.toFixed(2)} kB/s in ${perSecond.toFixed(0)} notifications/s`;
+        linkReference = { ...link, receivedAt: now };
+    }
+
+    linkInfoDisplay.textContent =
+        `BLE link: MTU ${link.mtu}, ${link.phy} PHY, interval ${link.interval.toFixed(2)} ms, ` +
+        `latency ${link.latency}, timeout ${link.timeout} ms${linkThroughput}, ${link.samplesDropped} samples dropped`;
+    linkInfoDisplay.style.color = link.samplesDropped > 0 ? "red" : "";
+}
+
+// One row per profiled stage, filled in as the profile frames arrive
+export function updateProfileStats(stats) {
+    let row = document.getElementById(`profile-${stats.stage}`);
+    if (!row) {
+        row = document.createElement('tr');
+        row.id = `profile-${stats.stage}`;
+        // keep rows in stage order regardless of arrival order
+        const next = Array.from(profileStatsBody.children).find(r => Number(r.id.split('-')[1]) > stats.stage);
+        profileStatsBody.insertBefore(row, next || null);
+    }
+    const cells = [stats.name, stats.count, stats.min, stats.p50, stats.p99, stats.max, stats.overruns];
+    row.innerHTML = cells.map(cell => `<td>${cell}</td>`).join('');
+    row.style.color = stats.overruns > 0 ? "red" : "";
+}
+
+function requestProfileStats(reset) {
+    if (!isConnected()) {
+        log("Not connected");
+        return;
+    }
+    profileStatsBody.innerHTML = '';
+    sendCommand(encodeStatsRequest(reset), log);
+}
+
+function downloadRecording() {
+    if (!isConnected()) {
+        log("Not connected");
+        return;
+    }
+    recordingDownload = { size: null, offset: 0, bytes: null, retryTimer: null };
+    recordingStatus.textContent = "Requesting recording...";
+    requestRecordingChunks();
+}
+
+// Ask the car to stream the recording from the first byte not received yet
+function requestRecordingChunks() {
+    armRecordingRetry();
+    sendCommand(encodeRecordingRequest(RECORDING_ACTION_READ, recordingDownload.offset), log);
+}
+
+export function updateRecordingInfo(info) {
+    recordingStatus.textContent = `Car recorder: ${info.stateName}, ${info.size} bytes` +
+        (info.dropped > 0 ? `, ${info.dropped} dropped` : "");
+    if (!recordingDownload) {
+        return;
+    }
+    if (info.state !== RECORDER_STATE_IDLE) {
+        log(`Recording not ready (${info.stateName}), try again after the run`);
+        clearTimeout(recordingDownload.retryTimer);
+        recordingDownload = null;
+        return;
+    }
+    if (recordingDownload.size !== info.size) {
+        // First reply, or a new run replaced the file while we were away
+        recordingDownload.size = info.size;
+        recordingDownload.bytes = new Uint8Array(info.size);
+        if (recordingDownload.offset !== 0) {
+            recordingDownload.offset = 0;
+            requestRecordingChunks();
+        }
+    }
+}
+
+export function handleRecordingChunk(chunk) {
+    if (!recordingDownload || !recordingDownload.bytes) {
+        return;
+    }
+    if (chunk.error) {
+        // The car could not read its file, retrying would fail the same way
+        clearTimeout(recordingDownload.retryTimer);
+        recordingStatus.textContent = `Recording download failed: the car could not read its file at byte ${chunk.offset}`;
+        recordingDownload = null;
+        return;
+    }
+    if (chunk.offset !== recordingDownload.offset) {
+        // A notification was lost, the retry timer re-requests from the last good offset
+        return;
+    }
+    recordingDownload.bytes.set(chunk.data.subarray(0, recordingDownload.size - chunk.offset), chunk.offset);
+    recordingDownload.offset += chunk.data.byteLength;
+    recordingStatus.textContent = `Downloading recording: ${recordingDownload.offset} / ${recordingDownload.size} bytes`;
+
+    if (chunk.last) {
+        clearTimeout(recordingDownload.retryTimer);
+        finishRecordingDownload();
+    } else {
+        armRecordingRetry();
+    }
+}
+
+// Re-request from the last good offset if the stream stalls, e.g. the last chunk of a burst was lost
+function armRecordingRetry() {
+    clearTimeout(recordingDownload.retryTimer);
+    recordingDownload.retryTimer = setTimeout(() => {
+        if (recordingDownload && isConnected()) {
+            requestRecordingChunks();
+        }
+    }, RECORDING_RETRY_MS);
+}
+
+function finishRecordingDownload() {
+    const bytes = recordingDownload.bytes;
+    recordingDownload = null;
+
+    const name = `run-${new Date().toISOString().replace(/[:.]/g, '-')}`;
+    saveFile(`${name}.bin`, new Blob([bytes], { type: "application/octet-stream" }));
+    try {
+        const recording = decodeRecording(bytes);
+        saveFile(`${name}.csv`, new Blob([recordingToCsv(recording)], { type: "text/csv" }));
+        recordingStatus.textContent = `Recording saved: ${recording.ticks.length} control periods, ` +
+            `${recording.edges.length} hall edges (${recording.header.mode})`;
+    } catch (error) {
+        recordingStatus.textContent = `Recording saved, could not decode it: ${error.message}`;
+    }
+}
+
+function saveFile(name, blob) {
+    const link = document.createElement('a');
+    link.href = URL.createObjectURL(blob);
+    link.download = name;
+    link.click();
+    setTimeout(() => URL.revokeObjectURL(link.href), 0);
+}
+
+// One row per throttle table point, rows are replaced as the frames arrive
+export function updateThrottleTable(point) {
+    throttleStatus.textContent = point.calibrated ? "Calibrated" : "Not calibrated (motor model default)";
+    while (throttleTableBody.children.length < point.count) {
+        throttleTableBody.appendChild(document.createElement('tr'));
+    }
+    throttleTableBody.children[point.point].innerHTML = `<td>${point.pwm}</td><td>${point.speed.toFixed(3)}</td>`;
+}
+
+function sendCalibrate(action, message) {
+    if (!isConnected()) {
+        log("Not connected");
+        return;
+    }
+    throttleTableBody.innerHTML = '';
+    sendCommand(encodeCalibrate(action), log, true);
+    if (message) {
+        log(message);
+    }
+}
+
+// Pace plan editor: one row per segment, a ramp is a segment whose start and end speeds differ
+function addPlanSegment(segment = { byTime: false, length: 10, startSpeed: 2, endSpeed: 2 }) {
+    if (planBody.children.length >= PACE_PLAN_MAX_SEGMENTS) {
+        log(`A plan has at most ${PACE_PLAN_MAX_SEGMENTS} segments`);
+        return;
+    }
+    const row = document.createElement('tr');
+    row.innerHTML =
+        `<td class="segment-index"></td>` +
+        `<td><input type="number" class="segment-length" min="0" step="0.1" value="${segment.length}"></td>` +
+        `<td><select class="segment-unit"><option value="m">m</option><option value="s">s</option></select></td>` +
+        `<td><input type="number" class="segment-start" min="0" max="15" step="0.1" value="${segment.startSpeed}"></td>` +
+        `<td><input type="number" class="segment-end" min="0" max="15" step="0.1" value="${segment.endSpeed}"></td>` +
+        `<td><button class="segment-remove">Remove</button></td>`;
+    row.querySelector('.segment-unit').value = segment.byTime ? 's' : 'm';
+    row.querySelector('.segment-remove').addEventListener('click', () => {
+        row.remove();
+        updatePlanSummary();
+    });
+    row.addEventListener('input', updatePlanSummary);
+    planBody.appendChild(row);
+    updatePlanSummary();
+}
+
+function readPlanSegments() {
+    return Array.from(planBody.children, row => ({
+        byTime: row.querySelector('.segment-unit').value === 's',
+        length: parseFloat(row.querySelector('.segment-length').value),
+        startSpeed: parseFloat(row.querySelector('.segment-start').value),
+        endSpeed: parseFloat(row.querySelector('.segment-end').value),
+    }));
+}
+
+// Numbers the rows and estimates the plan's total distance and time
+function updatePlanSummary() {
+    let totalDistance = 0;
+    let totalTime = 0;
+    readPlanSegments().forEach((segment, i) => {
+        planBody.children[i].querySelector('.segment-index').textContent = i + 1;
+        const meanSpeed = (segment.startSpeed + segment.endSpeed) / 2;
+        if (segment.byTime) {
+            totalTime += segment.length;
+            totalDistance += segment.length * meanSpeed;
+        } else {
+            totalDistance += segment.length;
+            totalTime += meanSpeed > 0 ? segment.length / meanSpeed : Infinity;
+        }
+    });
+    planSummary.textContent = `About ${totalDistance.toFixed(1)} m in ${totalTime.toFixed(1)} s`;
+}
+
+function uploadPlan() {
+    if (!isConnected()) {
+        log("Not connected");
+        return;
+    }
+    const segments = readPlanSegments();
+    const bad = segments.findIndex(segment => !(segment.length > 0) ||
+        !(segment.startSpeed >= 0 && segment.startSpeed <= 15) || !(segment.endSpeed >= 0 && segment.endSpeed <= 15));
+    if (bad >= 0) {
+        log(`Plan segment ${bad + 1} needs a positive length and speeds between 0 and 15 m/s`);
+        return;
+    }
+    try {
+        sendCommand(encodePacePlan(segments), log, true);
+        log(`Uploaded pace plan with ${segments.length} segments`);
+    } catch (error) {
+        log(`Error uploading plan: ${error.message}`);
+    }
+}
+
+// Course editor: one row per track marker, positions from the start line in increasing order
+function addCourseMarker(marker = { type: 0, position: 0 }) {
+    if (courseBody.children.length >= COURSE_MAX_MARKERS) {
+        log(`A course has at most ${COURSE_MAX_MARKERS} markers`);
+        return;
+    }
+    const row = document.createElement('tr');
+    const options = MARKER_TYPE_NAMES.map((name, i) => `<option value="${i}">${name}</option>`).join('');
+    row.innerHTML =
+        `<td class="marker-index"></td>` +
+        `<td><select class="marker-type">${options}</select></td>` +
+        `<td><input type="number" class="marker-position" min="0" step="0.01" value="${marker.position}"></td>` +
+        `<td><button class="marker-remove">Remove</button></td>`;
+    row.querySelector('.marker-type').value = marker.type;
+    row.querySelector('.marker-remove').addEventListener('click', () => {
+        row.remove();
+        numberCourseMarkers();
+    });
+    courseBody.appendChild(row);
+    numberCourseMarkers();
+}
+
+function numberCourseMarkers() {
+    Array.from(courseBody.children).forEach((row, i) => {
+        row.querySelector('.marker-index').textContent = i + 1;
+    });
+}
+
+function readCourseMarkers() {
+    return Array.from(courseBody.children, row => ({
+        type: parseInt(row.querySelector('.marker-type').value, 10),
+        position: parseFloat(row.querySelector('.marker-position').value),
+    }));
+}
+
+function uploadCourse(markers) {
+    if (!isConnected()) {
+        log("Not connected");
+        return;
+    }
+    const bad = markers.findIndex((marker, i) => !(marker.position >= 0) ||
+        (i > 0 && !(marker.position >= markers[i - 1].position)));
+    if (bad >= 0) {
+        log(`Course marker ${bad + 1} needs a position at or after the one before it`);
+        return;
+    }
+    try {
+        sendCommand(encodeCourse(markers), log, true);
+        log(markers.length ? `Uploaded course with ${markers.length} markers` : "Course cleared");
+    } catch (error) {
+        log(`Error uploading course: ${error.message}`);
+    }
+}
+
+// A marker the car passed; the table is cleared at every run start
+export function logMarker(marker) {
+    const matched = marker.courseIndex !== null;
+    const row = document.createElement('tr');
+    row.innerHTML =
+        `<td>${marker.time.toFixed(2)}</td><td>${marker.name}</td><td>${marker.distance.toFixed(2)}</td>` +
+        `<td>${matched ? marker.courseIndex + 1 : '-'}</td>` +
+        `<td>${matched ? marker.correction.toFixed(3) : '-'}</td><td>${marker.odometryScale.toFixed(4)}</td>`;
+    markerEventBody.appendChild(row);
+}
+
 // Update display elements with BLE data
 function updateDataDisplay() {
     currentSpeedDisplay.innerHTML =
@@ -293,15 +724,10 @@ function m_to_ft(meters) {
 
 
 
-// Request movement update
+// Send the stick position while driving manually; only the newest one is written, see setMovement()
 function requestMovementUpdate() {
-    if (isConnected()) {
-        const result = bleRequestMovementUpdate(log, manualControl, lastSentX, lastSentY, currentX, currentY);
-        lastSentX = result.lastSentX;
-        lastSentY = result.lastSentY;
-        movementRequested = result.movementRequested;
-    } else {
-        movementRequested = true;
+    if (manualControl && isConnected()) {
+        setMovement(currentX, currentY);
     }
 }
 
@@ -363,18 +789,6 @@ function handleDTPInput(event) {
 
     // Update the UI
     updateUI(missingValue);
-
-    if (running && isConnected()) {
-        const data = JSON.stringify({
-            type: "settings",
-            distance: distance.value,
-            time: time.value,
-            pace: pace.value,
-            isWhiteLine: isWhiteLine,
-        });
-        sendCommand(data, log, true);
-        log(`Sent updated settings: ${data}`);
-    }
 }
 
 function updateMissingValue() {
@@ -447,6 +861,12 @@ function calculatePace(distance, time) {
     return distance / time;
 }
 
+// Read a numeric input, falling back to a default when it is empty or invalid
+function numberInput(id, fallback) {
+    const value = parseFloat(document.getElementById(id)?.value);
+    return Number.isFinite(value) ? value : fallback;
+}
+
 // Reset UI state
 function resetDataUIState() {
     currentSpeedDisplay.textContent = '0.00';
@@ -480,16 +900,11 @@ manualToggle.addEventListener('click', function () {
     try {
         manualControl = !manualControl;
         manualToggle.innerText = manualControl ? "Switch to Pacer" : "Switch to Manual Control";
-        const data = JSON.stringify({
-            type: "manualControl",
-            enabled: manualControl
-        });
+        const data = encodeManualControl(manualControl);
         log(`Manual Control ${manualControl ? 'enabled' : 'disabled'}`);
         sendCommand(data, log, true);
-        if (manualControl) {
-            // Queue an immediate position update after mode change
-            movementRequested = true;
-        }
+        // The position goes out after the mode change, acknowledged commands are written first
+        requestMovementUpdate();
     } catch (error) {
         log(`Error toggling manual control: ${error}`);
     }
@@ -499,26 +914,27 @@ startToggleButton.addEventListener('click', function () {
     try {
         running = !running;
         startToggleButton.innerText = running ? "STOP" : "GO";
-        speedReadings = running ? [] : speedReadings
-        steerReadings = running ? [] : steerReadings
+        if (running) {
+            clearTelemetry();
+            markerEventBody.innerHTML = '';
+        }
 
-        const data = JSON.stringify({
-            type: "running",
+        const data = encodeRunConfig({
             running: running,
-            distance: distanceInput.value,
-            time: timeInput.value,
-            pace: paceInput.value,
+            distance: parseFloat(distanceInput.value),
+            time: parseFloat(timeInput.value),
+            pace: parseFloat(paceInput.value),
             isWhiteLine: whiteLineToggle.checked,
             mode: document.querySelector('input[name="mode"]:checked')?.value,
-            speedKP: document.getElementById("speedKPInput")?.value || speedKP,
-            speedKI: document.getElementById("speedKDInput")?.value || speedKI,
-            speedKD: document.getElementById("speedKIInput")?.value || speedKD,
-            SPEED_MAX_INTEGRAL: document.getElementById("SPEED_MAX_INTEGRALInput")?.value || SPEED_MAX_INTEGRAL,
-            SPEED_MAX_ACCELERATION: document.getElementById("SPEED_MAX_ACCELERATIONInput")?.value || SPEED_MAX_ACCELERATION,
-            steerKP: document.getElementById("steerKPInput")?.value || steerKP,
-            steerKI: document.getElementById("steerKDInput")?.value || steerKI,
-            steerKD: document.getElementById("steerKIInput")?.value || steerKD,
-            STEER_MAX_INTEGRAL: document.getElementById("STEER_MAX_INTEGRALInput")?.value || STEER_MAX_INTEGRAL,
+            speedKP: numberInput("speedKPInput", speedKP),
+            speedKI: numberInput("speedKIInput", speedKI),
+            speedKD: numberInput("speedKDInput", speedKD),
+            SPEED_MAX_INTEGRAL: numberInput("SPEED_MAX_INTEGRALInput", SPEED_MAX_INTEGRAL),
+            SPEED_MAX_ACCELERATION: numberInput("SPEED_MAX_ACCELERATIONInput", SPEED_MAX_ACCELERATION),
+            steerKP: numberInput("steerKPInput", steerKP),
+            steerKI: numberInput("steerKIInput", steerKI),
+            steerKD: numberInput("steerKDInput", steerKD),
+            STEER_MAX_INTEGRAL: numberInput("STEER_MAX_INTEGRALInput", STEER_MAX_INTEGRAL),
         });
 
         sendCommand(data, log, true);
@@ -532,10 +948,7 @@ whiteLineToggle.addEventListener('change', function () {
     try {
         isWhiteLine = whiteLineToggle.checked;
 
-        const data = JSON.stringify({
-            type: "isWhiteLine",
-            enabled: isWhiteLine,
-        });
+        const data = encodeIsWhiteLine(isWhiteLine);
         sendCommand(data, log);
         log(`Set to follow ${isWhiteLine ? "WHITE" : "BLACK"} line`);
     } catch (error) {
@@ -547,6 +960,27 @@ distanceInput.addEventListener('input', (e) => handleDTPInput(e));
 timeInput.addEventListener('input', (e) => handleDTPInput(e));
 paceInput.addEventListener('input', (e) => handleDTPInput(e));
 
+statsBtn.addEventListener('click', () => requestProfileStats(false));
+statsResetBtn.addEventListener('click', () => requestProfileStats(true));
+downloadRecordingBtn.addEventListener('click', downloadRecording);
+addSegmentBtn.addEventListener('click', () => addPlanSegment());
+uploadPlanBtn.addEventListener('click', uploadPlan);
+addPlanSegment();
+addMarkerBtn.addEventListener('click', () => {
+    const markers = readCourseMarkers();
+    const last = markers[markers.length - 1];
+    addCourseMarker({ type: last ? last.type : 0, position: last ? last.position : 0 });
+});
+uploadCourseBtn.addEventListener('click', () => uploadCourse(readCourseMarkers()));
+clearCourseBtn.addEventListener('click', () => uploadCourse([]));
+calibrateBtn.addEventListener('click', () => {
+    if (confirm("The car will drive along the line for about 20 m while it sweeps the throttle. Start?")) {
+        sendCalibrate(CALIBRATE_ACTION_START, "Throttle calibration requested, press STOP to abort");
+    }
+});
+showThrottleBtn.addEventListener('click', () => sendCalibrate(CALIBRATE_ACTION_REPORT));
+clearCalibrationBtn.addEventListener('click', () => sendCalibrate(CALIBRATE_ACTION_CLEAR, "Throttle calibration cleared"));
+
 // Initial log
 log('Web app loaded. Click "Connect to ESP32" to begin.');
 log(`Browser: ${navigator.userAgent}`);
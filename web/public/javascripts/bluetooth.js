@@ -9,11 +9,84 @@ let server = null;
 let service = null;
 let characteristic = null;
 let dataCharacteristic = null;
-let pendingOperation = false;  // Tracks if any command is in flight
-let commandQueue = [];  // Queue for critical commands
+let writing = false;  // one GATT write at a time, Chrome rejects overlapping ones
+let commandQueue = [];  // acknowledged commands, critical ones first: { data, critical, logCallback, resolve }
+
+// Movement channel: a single slot the newest stick position overwrites, written without response at
+// most once per connection interval, so it never queues up behind the link. Each write carries a
+// sequence number and the car drops any that arrive older than one it already took
+const DEFAULT_CONNECTION_INTERVAL_MS = 15; // BLE_CONN_INTERVAL_MAX in rabbit_car/config.h, until a link frame says
+let connectionIntervalMs = DEFAULT_CONNECTION_INTERVAL_MS;
+let movementSlot = null;  // { angle, motorSpeed } not written yet
+let movementSeq = 0;
+let lastMovementWriteAt = -Infinity;  // performance.now()
+let movementTimer = null;
 
 // Import state update function
-import { updateDataState, log, handleRunStopped } from './app.js';
+import {
+    updateTelemetryView,
+    telemetryChanged,
+    updateLogStats,
+    updateProfileStats,
+    updateRecordingInfo,
+    updateThrottleTable,
+    updateLinkInfo,
+    logMarker,
+    handleRecordingChunk,
+    log,
+    handleRunStopped,
+} from './app.js';
+import {
+    CMD_MANUAL_CONTROL,
+    TELEMETRY_FRAME_LOG_STATS_V1,
+    TELEMETRY_FRAME_PROFILE_V1,
+    TELEMETRY_FRAME_THROTTLE_V1,
+    TELEMETRY_FRAME_MARKER_V1,
+    TELEMETRY_FRAME_LINK_V1,
+    TELEMETRY_FRAME_RECORDING_CHUNK_V1,
+    TELEMETRY_FRAME_RECORDING_INFO_V1,
+    encodeMovement,
+    encodeRunConfig,
+    describeCommand,
+} from './protocol.js';
+
+// Notifications are decoded and stored by the telemetry worker, see telemetryWorker.js
+const telemetryWorker = new Worker(new URL('./telemetryWorker.js', import.meta.url), { type: 'module' });
+
+// Handlers of the decoded frames the worker passes back one by one
+const FRAME_HANDLERS = {
+    [TELEMETRY_FRAME_LOG_STATS_V1]: frame => updateLogStats(frame),
+    [TELEMETRY_FRAME_PROFILE_V1]: frame => updateProfileStats(frame),
+    [TELEMETRY_FRAME_THROTTLE_V1]: frame => updateThrottleTable(frame),
+    [TELEMETRY_FRAME_MARKER_V1]: frame => logMarker(frame),
+    [TELEMETRY_FRAME_LINK_V1]: frame => {
+        connectionIntervalMs = frame.interval || DEFAULT_CONNECTION_INTERVAL_MS;
+        updateLinkInfo(frame);
+    },
+    [TELEMETRY_FRAME_RECORDING_CHUNK_V1]: frame => handleRecordingChunk(frame),
+    [TELEMETRY_FRAME_RECORDING_INFO_V1]: frame => updateRecordingInfo(frame),
+};
+
+telemetryWorker.onmessage = ({ data }) => {
+    switch (data.type) {
+        case 'frame':
+            FRAME_HANDLERS[data.id](data.frame);
+            break;
+        case 'stopped':
+            handleRunStopped(data.data);
+            break;
+        case 'changed':
+            telemetryChanged();
+            break;
+        case 'view':
+            updateTelemetryView(data);
+            break;
+        case 'unknown':
+            log(`Unknown data frame (${data.length} bytes, id ${data.id >= 0 ? data.id : '-'})`);
+            break;
+    }
+};
+
 
 // Connect to BLE device
 async function connect(logCallback) {
@@ -44,8 +117,7 @@ async function connect(logCallback) {
         }
 
         logCallback('Connected successfully!');
-        pendingOperation = false;
-        commandQueue = [];
+        resetWrites();
         return true;
     } catch (error) {
         logCallback(`Error: ${error}`);
@@ -62,27 +134,16 @@ function onDisconnected(logCallback) {
     service = null;
     characteristic = null;
     dataCharacteristic = null;
-    pendingOperation = false;
-    commandQueue = [];
+    resetWrites();
 }
 
 // Disconnect from device
 async function disconnect(logCallback) {
     if (device && device.gatt.connected) {
         try {
-            // Clear any pending commands and immediately stop
-            pendingOperation = false;
-            commandQueue = [];
-
-            // Send stop command directly (bypass queue for disconnect)
-            if (characteristic) {
-                const stopData = JSON.stringify({
-                    type: "running",
-                    running: false
-                });
-                const encoder = new TextEncoder();
-                const data = encoder.encode(stopData);
-                await characteristic.writeValue(data);
+            // Drop anything not written yet and stop the car, after the write in flight if there is one
+            resetWrites();
+            if (characteristic && await queueCommand(encodeRunConfig({ running: false }), logCallback, true)) {
                 logCallback('Sent stop command before disconnect');
             }
 
@@ -97,119 +158,103 @@ async function disconnect(logCallback) {
     }
 }
 
-async function sendCommand(valueData, logCallback, isCritical = false) {
+// data is a binary command encoded by protocol.js
+async function sendCommand(data, logCallback, isCritical = false) {
     if (!characteristic) {
         logCallback('Error: No characteristic available');
         return false;
     }
 
-    // Convert to JSON string if object is passed
-    let dataToSend = valueData;
-    if (typeof valueData === 'object') {
-        dataToSend = JSON.stringify(valueData);
-    }
-
     if (isCritical) {
-        // Critical commands go to the front of the queue
-        queueCriticalCommand(dataToSend, logCallback);
+        // Critical commands go ahead of the other queued ones, the caller does not wait for them
+        queueCommand(data, logCallback, true);
         return true;
-    } else {
-        // For non-critical commands
-        try {
-            const encoder = new TextEncoder();
-            const data = encoder.encode(dataToSend);
-            await characteristic.writeValue(data);
-            logCallback(`Sent command: ${dataToSend}`);
-            return true;
-        } catch (error) {
-            logCallback(`Error sending command: ${error}`);
-            return false;
-        }
     }
+    return queueCommand(data, logCallback, false);
 }
 
-// Add a critical command to the queue
-function queueCriticalCommand(valueString, logCallback) {
-    commandQueue.push({ valueString });
-    processCommandQueue(logCallback);
+// Queue an acknowledged write, resolves to whether it was written. Critical commands keep their order
+// among themselves but go ahead of the non-critical ones
+function queueCommand(data, logCallback, critical) {
+    return new Promise(resolve => {
+        const command = { data, critical, logCallback, resolve };
+        const firstNonCritical = critical ? commandQueue.findIndex(queued => !queued.critical) : -1;
+        commandQueue.splice(firstNonCritical >= 0 ? firstNonCritical : commandQueue.length, 0, command);
+        pumpWrites();
+    });
 }
 
-// Process command queue and movement updates with priority handling
-async function processCommandQueue(logCallback, manualControl, lastSentX, lastSentY, currentX, currentY, movementRequested) {
-    if (!characteristic || pendingOperation) return { lastSentX, lastSentY, movementRequested };
+// Latest wins: replaces a position that has not been written yet
+function setMovement(angle, motorSpeed) {
+    movementSlot = { angle, motorSpeed };
+    pumpWrites();
+}
 
-    pendingOperation = true;
-    let updatedLastSentX = lastSentX;
-    let updatedLastSentY = lastSentY;
-    let updatedMovementRequested = movementRequested;
+// Forget the queued writes, e.g. when the link goes; the next client starts a new movement count
+function resetWrites() {
+    commandQueue.forEach(command => command.resolve(false));
+    commandQueue = [];
+    movementSlot = null;
+    movementSeq = 0;
+    lastMovementWriteAt = -Infinity;
+    connectionIntervalMs = DEFAULT_CONNECTION_INTERVAL_MS;
+    clearTimeout(movementTimer);
+    movementTimer = null;
+}
 
-    try {
-        // Process critical commands first
-        if (commandQueue.length > 0) {
-            const command = commandQueue.shift();
-            const encoder = new TextEncoder();
-            const data = encoder.encode(command.valueString);
-
-            await characteristic.writeValue(data);
-            logCallback(`Sent critical command: ${command.valueString}`);
-
-            // If this was a manual control toggle, reset movement tracking
-            if (command.valueString.includes('"type":"manualControl"')) {
-                updatedLastSentX = null;
-                updatedLastSentY = null;
-            }
-        }
-        // Then process movement if no commands and movement is needed
-        else if (manualControl &&
-            (lastSentX !== currentX || lastSentY !== currentY || movementRequested)) {
-
-            updatedMovementRequested = false;
-            const movementData = JSON.stringify({
-                type: "movement",
-                angle: currentX,
-                motorSpeed: currentY
-            });
-
-            const encoder = new TextEncoder();
-            const data = encoder.encode(movementData);
-
-            await characteristic.writeValue(data);
-            updatedLastSentX = currentX;
-            updatedLastSentY = currentY;
-            logCallback(`Sent data ${movementData}`);
-        }
-    } catch (error) {
-        logCallback(`Error sending data: ${error}`);
-    } finally {
-        pendingOperation = false;
-
-        // Check if we need to send more commands
-        if (commandQueue.length > 0 ||
-            (manualControl && (updatedLastSentX !== currentX || updatedLastSentY !== currentY || updatedMovementRequested))) {
-            // Schedule next operation after a small delay
-            setTimeout(() => processCommandQueue(
-                logCallback,
-                manualControl,
-                updatedLastSentX,
-                updatedLastSentY,
-                currentX,
-                currentY,
-                updatedMovementRequested
-            ), 10);
+// Write the next acknowledged command, or else the movement slot once a connection interval has passed
+// since the last movement write
+async function pumpWrites() {
+    if (!characteristic || writing) {
+        return;
+    }
+
+    if (commandQueue.length > 0) {
+        const command = commandQueue.shift();
+        let written = false;
+        writing = true;
+        try {
+            await characteristic.writeValueWithResponse(command.data);
+            command.logCallback(`Sent ${command.critical ? 'critical ' : ''}command: ${describeCommand(command.data)}`);
+            written = true;
+        } catch (error) {
+            command.logCallback(`Error sending command: ${error}`);
         }
+        writing = false;
+        command.resolve(written);
+        pumpWrites();
+        return;
     }
 
-    return {
-        lastSentX: updatedLastSentX,
-        lastSentY: updatedLastSentY,
-        movementRequested: updatedMovementRequested
-    };
-}
+    if (movementSlot) {
+        const wait = lastMovementWriteAt + connectionIntervalMs - performance.now();
+        if (wait > 0) {
+            if (!movementTimer) {
+                movementTimer = setTimeout(() => {
+                    movementTimer = null;
+                    pumpWrites();
+                }, wait);
+            }
+            return;
+        }
 
-// Request movement update
-function requestMovementUpdate(logCallback, manualControl, lastSentX, lastSentY, currentX, currentY) {
-    const movementRequested = true;
-    return processCommandQueue(logCallback, manualControl, lastSentX, lastSentY, currentX, currentY, movementRequested);
+        movementSeq = (movementSeq + 1) & 0xffff;
+        const data = encodeMovement(movementSlot.angle, movementSlot.motorSpeed, movementSeq);
+        movementSlot = null;
+        lastMovementWriteAt = performance.now();
+        writing = true;
+        try {
+            if (characteristic.properties.writeWithoutResponse) {
+                await characteristic.writeValueWithoutResponse(data);
+            } else {
+                await characteristic.writeValueWithResponse(data); // firmware from before the movement channel
+            }
+        } catch (error) {
+            log(`Error sending movement: ${error}`);
+        }
+        writing = false;
+        pumpWrites();
+    }
 }
 
 // Check connection status
@@ -217,31 +262,29 @@ function isConnected() {
     return device !== null && characteristic !== null;
 }
 
-// Handle received data
+// Handle received data: hand a copy of the payload to the worker, the stack may reuse the buffer
 function handleDataReceived(event) {
-    const value = event.target.value;
-    const decoder = new TextDecoder('utf-8');
-    const jsonString = decoder.decode(value);
+    const value = event.target.value; // DataView over the notification payload
+    const bytes = value.buffer.slice(value.byteOffset, value.byteOffset + value.byteLength);
+    telemetryWorker.postMessage({ type: 'frame', bytes }, [bytes]);
+}
 
-    try {
-        const data = JSON.parse(jsonString);
-        if (data.stopped) {
-            handleRunStopped(data);
-        } else {
-            updateDataState(data); // Update app state
-        }
-        log(`Received data: ${jsonString}`);
-    } catch (error) {
-        console.error('Error parsing JSON data:', error);
-        log(`Error parsing data: ${error.message}`);
-    }
+// Ask the worker for the telemetry charts' series, columns is each chart's width in pixels
+function requestTelemetryView(columns) {
+    telemetryWorker.postMessage({ type: 'view', columns });
+}
+
+// Drop the stored telemetry samples
+function clearTelemetry() {
+    telemetryWorker.postMessage({ type: 'clear' });
 }
 
 export {
     connect,
     disconnect,
     sendCommand,
-    requestMovementUpdate,
-    processCommandQueue,
+    setMovement,
     isConnected,
+    requestTelemetryView,
+    clearTelemetry,
 };
\ No newline at end of file
@@ -0,0 +1,512 @@
+// Binary frame layouts shared with the firmware (see rabbit_car/Telemetry.h and rabbit_car/Commands.h)
+
+// Command opcodes (first byte of every write on the control characteristic)
+const CMD_MOVEMENT = 0x01;
+const CMD_MANUAL_CONTROL = 0x02;
+const CMD_RUNNING = 0x03;
+const CMD_IS_WHITE_LINE = 0x04;
+const CMD_LIGHTS = 0x05;
+const CMD_STATS = 0x06;
+const CMD_RECORDING = 0x07;
+const CMD_PLAN = 0x08;
+const CMD_CALIBRATE = 0x09;
+const CMD_COURSE = 0x0a;
+
+const CMD_NAMES = {
+    [CMD_MOVEMENT]: "movement",
+    [CMD_MANUAL_CONTROL]: "manualControl",
+    [CMD_RUNNING]: "running",
+    [CMD_IS_WHITE_LINE]: "isWhiteLine",
+    [CMD_LIGHTS]: "lights",
+    [CMD_STATS]: "stats",
+    [CMD_RECORDING]: "recording",
+    [CMD_PLAN]: "plan",
+    [CMD_CALIBRATE]: "calibrate",
+    [CMD_COURSE]: "course",
+};
+
+// CMD_RUNNING flags
+const RUN_FLAG_RUNNING = 0x01;
+const RUN_FLAG_WHITE_LINE = 0x02;
+const RUN_FLAG_HAS_DISTANCE = 0x04;
+const RUN_FLAG_HAS_TIME = 0x08;
+const RUN_FLAG_HAS_PACE = 0x10;
+const RUN_FLAG_HAS_WHITE_LINE = 0x20;
+const RUN_FLAG_HAS_GAINS = 0x40;
+
+// CMD_STATS flags
+const STATS_FLAG_RESET = 0x01;
+
+// CMD_CALIBRATE actions
+const CALIBRATE_ACTION_REPORT = 0;
+const CALIBRATE_ACTION_START = 1;
+const CALIBRATE_ACTION_CLEAR = 2;
+
+// CMD_RECORDING actions
+const RECORDING_ACTION_INFO = 0;
+const RECORDING_ACTION_READ = 1;
+const RECORDING_ACTION_CANCEL = 2;
+
+// Mode ids, index matches RUN_MODE_NAMES in the firmware
+const RUN_MODES = ["RACE", "TEMPO", "DISTANCE_PACE", "PLAN"];
+const RUN_MODE_UNCHANGED = 0xff;
+
+const CMD_RUNNING_SIZE = 15;
+const CMD_RUNNING_GAINS_SIZE = 36;
+// CMD_PLAN segments (see rabbit_car/PacePlan.h)
+const PACE_PLAN_MAX_SEGMENTS = 32;
+const PLAN_SEGMENT_SIZE = 13;
+const PLAN_SEGMENT_TIME = 0x01;
+// CMD_COURSE markers (see rabbit_car/Course.h)
+const COURSE_MAX_MARKERS = 32;
+const COURSE_MARKER_SIZE = 5;
+const MARKER_TYPE_NAMES = ["CROSS", "TRIANGLE"];
+const MARKER_UNMATCHED = 0xff;
+
+const RUN_GAIN_KEYS = [
+    "speedKP", "speedKI", "speedKD", "SPEED_MAX_INTEGRAL", "SPEED_MAX_ACCELERATION",
+    "steerKP", "steerKI", "steerKD", "STEER_MAX_INTEGRAL",
+];
+
+// Frame ids (first byte of every notification on the data characteristic)
+const TELEMETRY_FRAME_DTPS_V1 = 0x01;
+const TELEMETRY_FRAME_SIZE = 20;
+const TELEMETRY_FRAME_LOG_STATS_V1 = 0x02;
+const LOG_STATS_FRAME_SIZE = 12;
+const TELEMETRY_FRAME_PROFILE_V1 = 0x03;
+const PROFILE_FRAME_SIZE = 20;
+const TELEMETRY_FRAME_THROTTLE_V1 = 0x06;
+const THROTTLE_FRAME_SIZE = 8;
+const THROTTLE_FLAG_CALIBRATED = 0x01;
+const TELEMETRY_FRAME_MARKER_V1 = 0x07;
+const MARKER_FRAME_SIZE = 16;
+const TELEMETRY_FRAME_BATCH_V1 = 0x08;
+const TELEMETRY_BATCH_HEADER_SIZE = 8;
+const TELEMETRY_BATCH_SAMPLE_SIZE = 16;
+const TELEMETRY_FRAME_LINK_V1 = 0x09;
+const LINK_FRAME_SIZE = 20;
+const TELEMETRY_FRAME_RECORDING_CHUNK_V1 = 0x04;
+const RECORDING_CHUNK_HEADER_SIZE = 6;
+const RECORDING_CHUNK_FLAG_LAST = 0x01;
+const RECORDING_CHUNK_FLAG_ERROR = 0x02;
+const TELEMETRY_FRAME_RECORDING_INFO_V1 = 0x05;
+const RECORDING_INFO_FRAME_SIZE = 10;
+
+// Recorder states, index matches RecorderState in rabbit_car/RunRecorder.h
+const RECORDER_STATE_NAMES = ["idle", "recording", "flushing"];
+const RECORDER_STATE_IDLE = 0;
+
+// Run recording file (see rabbit_car/RunRecorder.h)
+const RECORDER_MAGIC = "RBR1";
+const RECORDER_HEADER_SIZE = 16;
+const RECORD_TICK = 0x01;
+const RECORD_EDGE = 0x02;
+const RUN_STATE_NAMES = ["IDLE", "RUNNING", "BRAKING", "COASTING", "CALIBRATING"];
+
+// Transmit PHY, index matches HalBlePhy in rabbit_car/Hal.h
+const BLE_PHY_NAMES = ["unknown", "1M", "2M", "Coded"];
+
+// Profiled stages, index matches ProfileStage in rabbit_car/Profile.h
+const PROFILE_STAGE_NAMES = ["controlStep", "irRead", "steerPID", "hsUpdate", "speedPID", "broadcast"];
+
+// Frame flags
+const TELEMETRY_FLAG_RUN_STOPPED = 0x01;
+const TELEMETRY_FLAG_FORCED = 0x02;
+
+// Decode a DTPS telemetry frame
+// Returns null if the frame is not a DTPS frame this client understands
+function decodeTelemetryFrame(view) {
+    if (view.byteLength < TELEMETRY_FRAME_SIZE || view.getUint8(0) !== TELEMETRY_FRAME_DTPS_V1) {
+        return null;
+    }
+
+    const flags = view.getUint8(1);
+    return {
+        seq: view.getUint16(2, true),
+        timestampMs: view.getUint16(4, true),
+        stopped: (flags & TELEMETRY_FLAG_RUN_STOPPED) !== 0,
+        forced: (flags & TELEMETRY_FLAG_FORCED) !== 0,
+        time: { value: view.getUint32(6, true) / 1000, unit: "seconds" },
+        distance: { value: view.getUint32(10, true) / 1000, unit: "meters" },
+        averagePace: { value: view.getUint16(14, true) / 1000, unit: "m/s" },
+        currentSpeed: { value: view.getUint16(16, true) / 1000, unit: "m/s" },
+        steeringAngle: view.getUint16(18, true) / 100,
+    };
+}
+
+// Decode a telemetry batch frame into samples shaped like decodeTelemetryFrame()'s, oldest first;
+// timestampMs is the car's millisecond clock when the sample was taken. Null if the frame is not one
+function decodeTelemetryBatch(view) {
+    if (view.byteLength < TELEMETRY_BATCH_HEADER_SIZE || view.getUint8(0) !== TELEMETRY_FRAME_BATCH_V1) {
+        return null;
+    }
+    const count = Math.min(view.getUint8(1),
+        Math.floor((view.byteLength - TELEMETRY_BATCH_HEADER_SIZE) / TELEMETRY_BATCH_SAMPLE_SIZE));
+    const seq = view.getUint16(2, true);
+    const firstMs = view.getUint32(4, true);
+    const samples = [];
+    for (let i = 0; i < count; i++) {
+        const offset = TELEMETRY_BATCH_HEADER_SIZE + i * TELEMETRY_BATCH_SAMPLE_SIZE;
+        samples.push({
+            seq,
+            timestampMs: firstMs + view.getUint16(offset, true),
+            stopped: false,
+            forced: false,
+            time: { value: view.getUint32(offset + 2, true) / 1000, unit: "seconds" },
+            distance: { value: view.getUint32(offset + 6, true) / 1000, unit: "meters" },
+            averagePace: { value: view.getUint16(offset + 10, true) / 1000, unit: "m/s" },
+            currentSpeed: { value: view.getUint16(offset + 12, true) / 1000, unit: "m/s" },
+            steeringAngle: view.getUint16(offset + 14, true) / 100,
+        });
+    }
+    return samples;
+}
+
+// Decode a BLE link frame, null if the frame is not one; interval and timeout are in ms
+function decodeLinkFrame(view) {
+    if (view.byteLength < LINK_FRAME_SIZE || view.getUint8(0) !== TELEMETRY_FRAME_LINK_V1) {
+        return null;
+    }
+    const phy = view.getUint8(1);
+    return {
+        phy: BLE_PHY_NAMES[phy] || `phy ${phy}`,
+        mtu: view.getUint16(2, true),
+        interval: view.getUint16(4, true) * 1.25,
+        latency: view.getUint16(6, true),
+        timeout: view.getUint16(8, true) * 10,
+        notifications: view.getUint32(10, true),
+        bytes: view.getUint32(14, true),
+        samplesDropped: view.getUint16(18, true),
+    };
+}
+
+// Decode a log stats frame, null if the frame is not one
+function decodeLogStatsFrame(view) {
+    if (view.byteLength < LOG_STATS_FRAME_SIZE || view.getUint8(0) !== TELEMETRY_FRAME_LOG_STATS_V1) {
+        return null;
+    }
+    return {
+        written: view.getUint32(2, true),
+        dropped: view.getUint32(6, true),
+        pending: view.getUint16(10, true),
+    };
+}
+
+// Decode a profile stats frame (one stage), null if the frame is not one; times are in microseconds
+function decodeProfileFrame(view) {
+    if (view.byteLength < PROFILE_FRAME_SIZE || view.getUint8(0) !== TELEMETRY_FRAME_PROFILE_V1) {
+        return null;
+    }
+    const stage = view.getUint8(1);
+    return {
+        stage,
+        name: PROFILE_STAGE_NAMES[stage] || `stage ${stage}`,
+        count: view.getUint32(2, true),
+        min: view.getUint16(6, true),
+        p50: view.getUint16(8, true),
+        p99: view.getUint16(10, true),
+        max: view.getUint32(12, true),
+        overruns: view.getUint32(16, true),
+    };
+}
+
+// Decode a throttle table frame (one point), null if the frame is not one
+function decodeThrottleFrame(view) {
+    if (view.byteLength < THROTTLE_FRAME_SIZE || view.getUint8(0) !== TELEMETRY_FRAME_THROTTLE_V1) {
+        return null;
+    }
+    return {
+        point: view.getUint8(1),
+        count: view.getUint8(2),
+        calibrated: (view.getUint8(3) & THROTTLE_FLAG_CALIBRATED) !== 0,
+        pwm: view.getUint16(4, true),
+        speed: view.getUint16(6, true) / 1000,
+    };
+}
+
+// Decode a track marker frame, null if the frame is not one; courseIndex is null when no course marker matched
+function decodeMarkerFrame(view) {
+    if (view.byteLength < MARKER_FRAME_SIZE || view.getUint8(0) !== TELEMETRY_FRAME_MARKER_V1) {
+        return null;
+    }
+    const type = view.getUint8(1);
+    const courseIndex = view.getUint8(2);
+    return {
+        type,
+        name: MARKER_TYPE_NAMES[type] || `type ${type}`,
+        courseIndex: courseIndex === MARKER_UNMATCHED ? null : courseIndex,
+        time: view.getUint32(4, true) / 1000,
+        distance: view.getUint32(8, true) / 1000,
+        correction: view.getInt16(12, true) / 1000,
+        odometryScale: 1 + view.getInt16(14, true) / 100000,
+    };
+}
+
+// Decode a recording chunk frame, null if the frame is not one; data is a view into the frame
+function decodeRecordingChunk(view) {
+    if (view.byteLength < RECORDING_CHUNK_HEADER_SIZE || view.getUint8(0) !== TELEMETRY_FRAME_RECORDING_CHUNK_V1) {
+        return null;
+    }
+    return {
+        last: (view.getUint8(1) & RECORDING_CHUNK_FLAG_LAST) !== 0,
+        error: (view.getUint8(1) & RECORDING_CHUNK_FLAG_ERROR) !== 0,
+        offset: view.getUint32(2, true),
+        data: new Uint8Array(view.buffer, view.byteOffset + RECORDING_CHUNK_HEADER_SIZE,
+            view.byteLength - RECORDING_CHUNK_HEADER_SIZE),
+    };
+}
+
+// Decode a recording info frame, null if the frame is not one
+function decodeRecordingInfo(view) {
+    if (view.byteLength < RECORDING_INFO_FRAME_SIZE || view.getUint8(0) !== TELEMETRY_FRAME_RECORDING_INFO_V1) {
+        return null;
+    }
+    const state = view.getUint8(1);
+    return {
+        state,
+        stateName: RECORDER_STATE_NAMES[state] || `state ${state}`,
+        size: view.getUint32(2, true),
+        dropped: view.getUint32(6, true),
+    };
+}
+
+// Parse a downloaded run recording into its header, one entry per control period and the hall edge times.
+// Throws if the file is not a recording this client understands.
+function decodeRecording(bytes) {
+    const view = new DataView(bytes.buffer, bytes.byteOffset, bytes.byteLength);
+    const magic = new TextDecoder().decode(bytes.subarray(0, 4));
+    if (bytes.byteLength < RECORDER_HEADER_SIZE || magic !== RECORDER_MAGIC) {
+        throw new Error("not a run recording");
+    }
+    const header = {
+        version: view.getUint8(4),
+        tickSize: view.getUint8(5),
+        edgeSize: view.getUint8(6),
+        mode: RUN_MODES[view.getUint8(7)] || `mode ${view.getUint8(7)}`,
+        controlHz: view.getUint16(8, true),
+        startMs: view.getUint32(12, true),
+    };
+
+    const ticks = [];
+    const edges = [];
+    let offset = RECORDER_HEADER_SIZE;
+    while (offset < bytes.byteLength) {
+        const type = view.getUint8(offset);
+        if (type === RECORD_TICK && offset + header.tickSize <= bytes.byteLength) {
+            ticks.push({
+                state: RUN_STATE_NAMES[view.getUint8(offset + 1)],
+                timeUs: view.getUint32(offset + 2, true),
+                irMask: view.getUint16(offset + 6, true),
+                position: view.getUint16(offset + 8, true),
+                steeringAngle: view.getUint16(offset + 10, true) / 100,
+                escPulse: view.getUint16(offset + 12, true),
+                speed: view.getUint16(offset + 14, true) / 1000,
+                distance: view.getUint32(offset + 16, true) / 1000,
+                steerError: view.getInt16(offset + 20, true),
+                steerIntegral: view.getInt16(offset + 22, true),
+                speedError: view.getInt16(offset + 24, true) / 1000,
+                speedIntegral: view.getInt16(offset + 26, true) / 100,
+            });
+            offset += header.tickSize;
+        } else if (type === RECORD_EDGE && offset + header.edgeSize <= bytes.byteLength) {
+            edges.push(view.getUint32(offset + 2, true));
+            offset += header.edgeSize;
+        } else {
+            break; // unknown record or truncated file, keep what was decoded
+        }
+    }
+    return { header, ticks, edges };
+}
+
+// One CSV row per control period; the edges column counts hall edges since the previous row
+function recordingToCsv(recording) {
+    const columns = ["timeUs", "state", "irMask", "position", "steeringAngle", "escPulse", "speed", "distance",
+        "steerError", "steerIntegral", "speedError", "speedIntegral"];
+    const rows = [columns.concat("edges").join(",")];
+    let edge = 0;
+    for (const tick of recording.ticks) {
+        let edgesInTick = 0;
+        while (edge < recording.edges.length && recording.edges[edge] <= tick.timeUs) {
+            edge++;
+            edgesInTick++;
+        }
+        rows.push(columns.map(column => column === "irMask"
+            ? "0x" + tick.irMask.toString(16).padStart(4, "0")
+            : tick[column]).concat(edgesInTick).join(","));
+    }
+    return rows.join("\n") + "\n";
+}
+
+// Movement: angle in degrees, motorSpeed in microseconds; seq (16 bit, wraps) lets the car drop a write
+// that is older than one it already took
+function encodeMovement(angle, motorSpeed, seq) {
+    const bytes = new Uint8Array(7);
+    const view = new DataView(bytes.buffer);
+    view.setUint8(0, CMD_MOVEMENT);
+    view.setUint16(1, Math.round(angle * 100), true);
+    view.setUint16(3, Math.round(motorSpeed), true);
+    view.setUint16(5, seq & 0xffff, true);
+    return bytes;
+}
+
+function encodeManualControl(enabled) {
+    return Uint8Array.of(CMD_MANUAL_CONTROL, enabled ? 1 : 0);
+}
+
+function encodeIsWhiteLine(enabled) {
+    return Uint8Array.of(CMD_IS_WHITE_LINE, enabled ? 1 : 0);
+}
+
+// Ask the car for its profile stats, optionally clearing them afterwards
+function encodeStatsRequest(reset) {
+    return Uint8Array.of(CMD_STATS, reset ? STATS_FLAG_RESET : 0);
+}
+
+// Throttle calibration: report the table, start a sweep or clear it (CALIBRATE_ACTION_*)
+function encodeCalibrate(action) {
+    return Uint8Array.of(CMD_CALIBRATE, action);
+}
+
+// Recording info, download from offset, or cancel (RECORDING_ACTION_*)
+function encodeRecordingRequest(action, offset = 0) {
+    const bytes = new Uint8Array(6);
+    const view = new DataView(bytes.buffer);
+    view.setUint8(0, CMD_RECORDING);
+    view.setUint8(1, action);
+    view.setUint32(2, offset, true);
+    return bytes;
+}
+
+// Pace plan upload; segments are { byTime, length, startSpeed, endSpeed } with length in s when byTime, else m.
+// Up to 418 bytes, Web Bluetooth sends it as a long write.
+function encodePacePlan(segments) {
+    if (segments.length === 0 || segments.length > PACE_PLAN_MAX_SEGMENTS) {
+        throw new Error(`a plan needs 1 to ${PACE_PLAN_MAX_SEGMENTS} segments`);
+    }
+    const bytes = new Uint8Array(2 + segments.length * PLAN_SEGMENT_SIZE);
+    const view = new DataView(bytes.buffer);
+    view.setUint8(0, CMD_PLAN);
+    view.setUint8(1, segments.length);
+    segments.forEach((segment, i) => {
+        const offset = 2 + i * PLAN_SEGMENT_SIZE;
+        view.setUint8(offset, segment.byTime ? PLAN_SEGMENT_TIME : 0);
+        view.setFloat32(offset + 1, segment.length, true);
+        view.setFloat32(offset + 5, segment.startSpeed, true);
+        view.setFloat32(offset + 9, segment.endSpeed, true);
+    });
+    return bytes;
+}
+
+// Course upload; markers are { type, position } with type an index into MARKER_TYPE_NAMES and position in m
+// from the start line, in increasing order. An empty list clears the course.
+function encodeCourse(markers) {
+    if (markers.length > COURSE_MAX_MARKERS) {
+        throw new Error(`a course has at most ${COURSE_MAX_MARKERS} markers`);
+    }
+    const bytes = new Uint8Array(2 + markers.length * COURSE_MARKER_SIZE);
+    const view = new DataView(bytes.buffer);
+    view.setUint8(0, CMD_COURSE);
+    view.setUint8(1, markers.length);
+    markers.forEach((marker, i) => {
+        const offset = 2 + i * COURSE_MARKER_SIZE;
+        view.setUint8(offset, marker.type);
+        view.setFloat32(offset + 1, marker.position, true);
+    });
+    return bytes;
+}
+
+// Run configuration; any numeric field that is missing or not a number is left unchanged on the car.
+// Gains are only sent when all of RUN_GAIN_KEYS are present.
+function encodeRunConfig(config) {
+    const hasGains = RUN_GAIN_KEYS.every(key => Number.isFinite(config[key]));
+    const bytes = new Uint8Array(CMD_RUNNING_SIZE + (hasGains ? CMD_RUNNING_GAINS_SIZE : 0));
+    const view = new DataView(bytes.buffer);
+
+    let flags = 0;
+    if (config.running) flags |= RUN_FLAG_RUNNING;
+    if (Number.isFinite(config.distance)) flags |= RUN_FLAG_HAS_DISTANCE;
+    if (Number.isFinite(config.time)) flags |= RUN_FLAG_HAS_TIME;
+    if (Number.isFinite(config.pace)) flags |= RUN_FLAG_HAS_PACE;
+    if (typeof config.isWhiteLine === 'boolean') {
+        flags |= RUN_FLAG_HAS_WHITE_LINE;
+        if (config.isWhiteLine) flags |= RUN_FLAG_WHITE_LINE;
+    }
+    if (hasGains) flags |= RUN_FLAG_HAS_GAINS;
+
+    const modeIndex = RUN_MODES.indexOf(config.mode);
+
+    view.setUint8(0, CMD_RUNNING);
+    view.setUint8(1, flags);
+    view.setUint8(2, modeIndex >= 0 ? modeIndex : RUN_MODE_UNCHANGED);
+    view.setFloat32(3, config.distance || 0, true);
+    view.setFloat32(7, config.time || 0, true);
+    view.setFloat32(11, config.pace || 0, true);
+    if (hasGains) {
+        RUN_GAIN_KEYS.forEach((key, i) => view.setFloat32(CMD_RUNNING_SIZE + i * 4, config[key], true));
+    }
+    return bytes;
+}
+
+// Short human readable form of an encoded command for the event log
+function describeCommand(bytes) {
+    const hex = Array.from(bytes, b => b.toString(16).padStart(2, '0')).join(' ');
+    return `${CMD_NAMES[bytes[0]] || 'unknown'} [${hex}]`;
+}
+
+export {
+    CMD_MOVEMENT,
+    CMD_MANUAL_CONTROL,
+    CMD_RUNNING,
+    CMD_IS_WHITE_LINE,
+    CMD_LIGHTS,
+    CMD_STATS,
+    CMD_RECORDING,
+    CMD_PLAN,
+    CMD_CALIBRATE,
+    CMD_COURSE,
+    CALIBRATE_ACTION_REPORT,
+    CALIBRATE_ACTION_START,
+    CALIBRATE_ACTION_CLEAR,
+    PACE_PLAN_MAX_SEGMENTS,
+    COURSE_MAX_MARKERS,
+    MARKER_TYPE_NAMES,
+    RECORDING_ACTION_INFO,
+    RECORDING_ACTION_READ,
+    RECORDING_ACTION_CANCEL,
+    RECORDER_STATE_IDLE,
+    RUN_MODES,
+    encodeMovement,
+    encodeManualControl,
+    encodeIsWhiteLine,
+    encodeRunConfig,
+    encodeStatsRequest,
+    encodeRecordingRequest,
+    encodePacePlan,
+    encodeCalibrate,
+    encodeCourse,
+    describeCommand,
+    TELEMETRY_FRAME_DTPS_V1,
+    TELEMETRY_FRAME_SIZE,
+    TELEMETRY_FRAME_LOG_STATS_V1,
+    TELEMETRY_FRAME_PROFILE_V1,
+    TELEMETRY_FRAME_THROTTLE_V1,
+    TELEMETRY_FRAME_MARKER_V1,
+    TELEMETRY_FRAME_BATCH_V1,
+    TELEMETRY_FRAME_LINK_V1,
+    TELEMETRY_FRAME_RECORDING_CHUNK_V1,
+    TELEMETRY_FRAME_RECORDING_INFO_V1,
+    PROFILE_STAGE_NAMES,
+    TELEMETRY_FLAG_RUN_STOPPED,
+    TELEMETRY_FLAG_FORCED,
+    decodeTelemetryFrame,
+    decodeTelemetryBatch,
+    decodeLinkFrame,
+    decodeLogStatsFrame,
+    decodeProfileFrame,
+    decodeThrottleFrame,
+    decodeMarkerFrame,
+    decodeRecordingChunk,
+    decodeRecordingInfo,
+    decodeRecording,
+    recordingToCsv,
+};
@@ -0,0 +1,201 @@
+// Telemetry worker: decodes every notification off the main thread and keeps the run's samples in
+// fixed-size typed array rings, so an hour at 100 Hz costs the page nothing but one chart redraw per
+// animation frame.
+//
+// Messages in:
+//   { type: 'frame', bytes }            a notification payload (ArrayBuffer, transferred)
+//   { type: 'view', columns: [n, ...] } min/max series for charts n pixels wide, answered with 'view'
+//   { type: 'clear' }                   drop the stored samples, e.g. at a run start
+// Messages out:
+//   { type: 'frame', id, frame }        a decoded non-sample frame, id is its TELEMETRY_FRAME_*
+//   { type: 'stopped', data }           a run stopped frame (decodeTelemetryFrame())
+//   { type: 'unknown', length, id }     a frame this client does not understand
+//   { type: 'changed' }                 samples arrived since the last view; sent once until a view is taken
+//   { type: 'view', latest, count, series, recentSpeed, recentSteer }
+import {
+    TELEMETRY_FRAME_DTPS_V1,
+    TELEMETRY_FRAME_BATCH_V1,
+    TELEMETRY_FRAME_LOG_STATS_V1,
+    TELEMETRY_FRAME_PROFILE_V1,
+    TELEMETRY_FRAME_THROTTLE_V1,
+    TELEMETRY_FRAME_MARKER_V1,
+    TELEMETRY_FRAME_LINK_V1,
+    TELEMETRY_FRAME_RECORDING_CHUNK_V1,
+    TELEMETRY_FRAME_RECORDING_INFO_V1,
+    decodeTelemetryFrame,
+    decodeTelemetryBatch,
+    decodeLogStatsFrame,
+    decodeProfileFrame,
+    decodeThrottleFrame,
+    decodeMarkerFrame,
+    decodeLinkFrame,
+    decodeRecordingChunk,
+    decodeRecordingInfo,
+} from './protocol.js';
+
+const SAMPLE_CAPACITY = 1 << 19; // 87 minutes at 100 Hz, a power of two; older samples are overwritten
+const RECENT_READINGS = 50;      // newest readings listed next to the charts
+
+// Frames the main thread handles one by one
+const FRAME_DECODERS = {
+    [TELEMETRY_FRAME_LOG_STATS_V1]: decodeLogStatsFrame,
+    [TELEMETRY_FRAME_PROFILE_V1]: decodeProfileFrame,
+    [TELEMETRY_FRAME_THROTTLE_V1]: decodeThrottleFrame,
+    [TELEMETRY_FRAME_MARKER_V1]: decodeMarkerFrame,
+    [TELEMETRY_FRAME_LINK_V1]: decodeLinkFrame,
+    [TELEMETRY_FRAME_RECORDING_CHUNK_V1]: decodeRecordingChunk,
+    [TELEMETRY_FRAME_RECORDING_INFO_V1]: decodeRecordingInfo,
+};
+
+// Sample ring, one typed array per channel; time is in s since the first sample after a clear
+const sampleTime = new Float64Array(SAMPLE_CAPACITY);
+const sampleSpeed = new Float32Array(SAMPLE_CAPACITY);
+const sampleSteer = new Float32Array(SAMPLE_CAPACITY);
+let sampleEnd = 0;    // samples ever pushed since the clear, the newest is at (sampleEnd - 1)
+let sampleCount = 0;  // samples held, at most SAMPLE_CAPACITY
+let firstMs = null;   // car clock of the first sample
+let lastMs = 0;       // car clock of the newest sample, unwraps the 16-bit DTPS timestamps
+let latest = null;    // newest decoded sample, for the metric cards
+let changePosted = false;
+
+function clearSamples() {
+    sampleEnd = 0;
+    sampleCount = 0;
+    firstMs = null;
+    latest = null;
+}
+
+// fullMs: the car's 32-bit millisecond clock, or null to extend lastMs by the 16-bit DTPS timestamp
+function pushSample(sample, fullMs) {
+    let ms = fullMs !== null ? fullMs : lastMs + ((sample.timestampMs - lastMs) & 0xffff);
+    if (firstMs === null) {
+        firstMs = ms;
+    } else if (ms < lastMs) {
+        ms = lastMs; // keep the time axis monotonic if the car restarts mid-stream
+    }
+    lastMs = ms;
+
+    const slot = sampleEnd & (SAMPLE_CAPACITY - 1);
+    sampleTime[slot] = (ms - firstMs) / 1000;
+    sampleSpeed[slot] = sample.currentSpeed.value;
+    sampleSteer[slot] = sample.steeringAngle;
+    sampleEnd++;
+    sampleCount = Math.min(sampleCount + 1, SAMPLE_CAPACITY);
+    latest = sample;
+}
+
+function postChanged() {
+    if (!changePosted) {
+        changePosted = true;
+        postMessage({ type: 'changed' });
+    }
+}
+
+function handleFrame(view) {
+    const id = view.byteLength > 0 ? view.getUint8(0) : -1;
+
+    if (id === TELEMETRY_FRAME_BATCH_V1) {
+        const samples = decodeTelemetryBatch(view);
+        if (samples) {
+            samples.forEach(sample => pushSample(sample, sample.timestampMs));
+            postChanged();
+            return;
+        }
+    } else if (id === TELEMETRY_FRAME_DTPS_V1) {
+        const data = decodeTelemetryFrame(view);
+        if (data && data.stopped) {
+            postMessage({ type: 'stopped', data });
+            return;
+        }
+        if (data) {
+            pushSample(data, null);
+            postChanged();
+            return;
+        }
+    } else if (FRAME_DECODERS[id]) {
+        const frame = FRAME_DECODERS[id](view);
+        if (frame) {
+            postMessage({ type: 'frame', id, frame });
+            return;
+        }
+    }
+    postMessage({ type: 'unknown', length: view.byteLength, id });
+}
+
+// Min/max decimation: split the held samples into one bucket per pixel column and keep the lowest and
+// highest value of each, in the order they came, so a chart of any length draws every spike with at
+// most two points per column
+function decimate(channel, columns) {
+    const oldest = sampleEnd - sampleCount;
+    const mask = SAMPLE_CAPACITY - 1;
+    const points = sampleCount <= 2 * columns ? sampleCount : 2 * columns;
+    const x = new Float32Array(points);
+    const y = new Float32Array(points);
+    let n = 0;
+
+    if (sampleCount <= 2 * columns) {
+        for (let i = oldest; i < sampleEnd; i++, n++) {
+            x[n] = sampleTime[i & mask];
+            y[n] = channel[i & mask];
+        }
+        return { x, y };
+    }
+
+    for (let column = 0; column < columns; column++) {
+        const from = oldest + Math.floor(column * sampleCount / columns);
+        const to = oldest + Math.floor((column + 1) * sampleCount / columns);
+        let min = from;
+        let max = from;
+        for (let i = from + 1; i < to; i++) {
+            const value = channel[i & mask];
+            if (value < channel[min & mask]) min = i;
+            if (value > channel[max & mask]) max = i;
+        }
+        const first = Math.min(min, max);
+        const second = Math.max(min, max);
+        x[n] = sampleTime[first & mask];
+        y[n++] = channel[first & mask];
+        if (second !== first) {
+            x[n] = sampleTime[second & mask];
+            y[n++] = channel[second & mask];
+        }
+    }
+    return { x: x.slice(0, n), y: y.slice(0, n) };
+}
+
+// Newest first
+function recent(channel) {
+    const count = Math.min(sampleCount, RECENT_READINGS);
+    const values = new Float32Array(count);
+    for (let i = 0; i < count; i++) {
+        values[i] = channel[(sampleEnd - 1 - i) & (SAMPLE_CAPACITY - 1)];
+    }
+    return values;
+}
+
+// One series pair per requested chart: [speed, steer] for columns [speedColumns, steerColumns]
+function postView(columns) {
+    changePosted = false;
+    const channels = [sampleSpeed, sampleSteer];
+    const series = columns.map((width, i) => decimate(channels[i], Math.max(1, Math.floor(width))));
+    const recentSpeed = recent(sampleSpeed);
+    const recentSteer = recent(sampleSteer);
+    const transfer = [recentSpeed.buffer, recentSteer.buffer];
+    series.forEach(s => transfer.push(s.x.buffer, s.y.buffer));
+    postMessage({ type: 'view', latest, count: sampleCount, series, recentSpeed, recentSteer }, transfer);
+}
+
+onmessage = ({ data }) => {
+    switch (data.type) {
+        case 'frame':
+            handleFrame(new DataView(data.bytes));
+            break;
+        case 'view':
+            postView(data.columns);
+            break;
+        case 'clear':
+            clearSamples();
+            postChanged();
+            break;
+    }
+};